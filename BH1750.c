@@ -20,10 +20,9 @@
 #include <metal/machine.h>
 #include <metal/i2c.h>
 #include "BH1750.h"
+#include "delay.h"
 
 //#define BH1750_DEBUG
-extern unsigned long millis(void);
-extern void delay(uint32_t miliseconds);
 #define _delay_ms(ms) delay(ms)
 
 unsigned int BH1750_I2CADDR = 0x23;  // default is 0x23
@@ -34,7 +33,14 @@ unsigned char BH1750_MTreg = (unsigned char)BH1750_DEFAULT_MTREG;
 const float BH1750_CONV_FACTOR = 1.2;
 Mode BH1750_MODE = BH1750_UNCONFIGURED;  // default is BH1750_CONTINUOUS_HIGH_RES_MODE
 struct metal_i2c *I2C;
-unsigned long long lastReadTimestamp;
+uint32_t lastReadTimestamp; // ticks32() of the last read or mode change
+// Mode and MTreg the sensor holds, 0 if unknown. Used to skip commands
+// that would not change anything.
+unsigned char BH1750_shadowMode = 0;
+unsigned char BH1750_shadowMTreg = 0;
+unsigned long BH1750_txIssued = 0;
+unsigned long BH1750_txElided = 0;
+unsigned long BH1750_txFailed = 0;
 
 /**
  * Configure sensor
@@ -54,11 +60,26 @@ int BH1750_begin(Mode mode, unsigned char addr, struct metal_i2c *i2c) {
     BH1750_I2CADDR = addr;
   }
 
+  // The sensor may have been power cycled since the last begin
+  BH1750_shadowMode = 0;
+  BH1750_shadowMTreg = 0;
+
   // Configure sensor in specified mode and set default MTreg
   return (BH1750_configure(mode) && BH1750_setMTreg(BH1750_DEFAULT_MTREG));
 }
 
 
+// Send one command byte to the sensor
+// @return 0 if the sensor acknowledged it, non-zero otherwise
+static int BH1750_command(unsigned char byte) {
+  BH1750_txIssued++;
+  int ret = metal_i2c_write(I2C, BH1750_I2CADDR, 1, &byte, METAL_I2C_STOP_ENABLE);
+  if (ret != 0) {
+    BH1750_txFailed++;
+  }
+  return ret;
+}
+
 /**
  * Configure BH1750 with specified mode
  * @param mode Measurement mode
@@ -76,8 +97,14 @@ int BH1750_configure(Mode mode) {
     case BH1750_ONE_TIME_HIGH_RES_MODE:
     case BH1750_ONE_TIME_HIGH_RES_MODE_2:
     case BH1750_ONE_TIME_LOW_RES_MODE:
-      // Send mode to sensor
-      metal_i2c_transfer(I2C, BH1750_I2CADDR, (unsigned char*)&mode, 1, &ack, 1);
+      // Nothing to do if the sensor already measures continuously in this
+      // mode; one-time modes are sent again to start a new measurement
+      if (mode == BH1750_shadowMode && mode == BH1750_MODE && !(mode & BH1750_ONE_TIME_HIGH_RES_MODE)) {
+        BH1750_txElided++;
+        return true;
+      }
+      // Send mode to sensor; a failed write is most likely a NACK
+      ack = (BH1750_command((unsigned char)mode) == 0) ? 0 : 2;
 
       // Wait a few moments to wake up
       _delay_ms(10);
@@ -91,10 +118,11 @@ int BH1750_configure(Mode mode) {
   }
 
   // Check result code
+  BH1750_shadowMode = (ack == 0) ? mode : 0;
   switch (ack) {
     case 0:
       BH1750_MODE = mode;
-      lastReadTimestamp = millis();
+      lastReadTimestamp = ticks32();
       return true;
     case 1: // too long for transmit buffer
       printf("[BH1750] ERROR: too long for transmit buffer\r\n");
@@ -130,24 +158,33 @@ int BH1750_setMTreg(unsigned char MTreg) {
     printf("[BH1750] ERROR: MTreg out of range\r\n");
     return false;
   }
-  unsigned char byte;
-  unsigned char ack = 5;
+  // In one-time modes the trailing mode command also starts the next
+  // measurement, so only continuous mode skips it
+  int known = (MTreg == BH1750_shadowMTreg && MTreg == BH1750_MTreg);
+  if (known && !(BH1750_MODE & BH1750_ONE_TIME_HIGH_RES_MODE)) {
+    BH1750_txElided += 3;
+    return true;
+  }
+  int failed = 0;
+  unsigned char ack;
   // Send MTreg and the current mode to the sensor
   //   High bit: 01000_MT[7,6,5]
   //    Low bit: 011_MT[4,3,2,1,0]
-  byte = (0b01000 << 3) | (MTreg >> 5);
-  metal_i2c_transfer(I2C, BH1750_I2CADDR, &byte, 1, &ack, 1);
-
-  byte = (0b011 << 5 )  | (MTreg & 0b11111);
-  metal_i2c_transfer(I2C, BH1750_I2CADDR, &byte, 1, &ack, 1);
-
-  byte = BH1750_MODE;
-  metal_i2c_transfer(I2C, BH1750_I2CADDR, &byte, 1, &ack, 1);
+  if (known) {
+    BH1750_txElided += 2;
+  } else {
+    failed |= BH1750_command((0b01000 << 3) | (MTreg >> 5));
+    failed |= BH1750_command((0b011 << 5 )  | (MTreg & 0b11111));
+  }
+  failed |= BH1750_command((unsigned char)BH1750_MODE);
+  // A failed write is most likely a NACK
+  ack = failed ? 2 : 0;
 
   // Wait a few moments to wake up
   _delay_ms(10);
 
   // Check result code
+  BH1750_shadowMTreg = (ack == 0) ? MTreg : 0;
   switch (ack) {
     case 0:
       BH1750_MTreg = MTreg;
@@ -172,6 +209,24 @@ int BH1750_setMTreg(unsigned char MTreg) {
   return false;
 }
 
+/**
+ * Bus transactions since start-up
+ * @param issued Commands sent to the sensor
+ * @param elided Commands skipped because the sensor already held the value
+ */
+void BH1750_transactionCounts(unsigned long *issued, unsigned long *elided) {
+  *issued = BH1750_txIssued;
+  *elided = BH1750_txElided;
+}
+
+/**
+ * Failed bus transactions since start-up, commands and re-arm reads
+ * @return number of transactions the sensor did not acknowledge
+ */
+unsigned long BH1750_failedTransactions() {
+  return BH1750_txFailed;
+}
+
 /**
  * Checks whether enough time has gone to read a new value
  * @param maxWait a boolean if to wait for typical or maximum delay
@@ -203,14 +258,41 @@ int BH1750_measurementReady(int maxWait) {
   // measurement time is used by default and if maxWait is set to True then
   // the maximum measurement time will be used. See data sheet pages 2, 5
   // and 7 for more details.
-  unsigned long long currentTimestamp = millis();
-    if (currentTimestamp - lastReadTimestamp >= delaytime) {
+  // Unsigned difference stays correct across the tick wraparound
+    if (ticks32() - lastReadTimestamp >= msToTicks(delaytime)) {
       return true;
     }
     else
       return false;
 }
 
+// Convert a data register value to lux
+static float BH1750_toLux(float level) {
+  // Print raw value if debug enabled
+  #ifdef BH1750_DEBUG
+  printf("[BH1750] Raw value: %f\r\n", level);
+  #endif
+
+  if (BH1750_MTreg != BH1750_DEFAULT_MTREG) {
+    level *= (float)((unsigned char)BH1750_DEFAULT_MTREG/(float)BH1750_MTreg);
+    // Print MTreg factor if debug enabled
+    #ifdef BH1750_DEBUG
+    printf("[BH1750] MTreg factor: %f\r\n", (float)((unsigned char)BH1750_DEFAULT_MTREG/(float)BH1750_MTreg));
+    #endif
+  }
+  if (BH1750_MODE == BH1750_ONE_TIME_HIGH_RES_MODE_2 || BH1750_MODE == BH1750_CONTINUOUS_HIGH_RES_MODE_2) {
+    level /= 2;
+  }
+  // Convert raw value to lux
+  level /= BH1750_CONV_FACTOR;
+
+  // Print converted value if debug enabled
+  #ifdef BH1750_DEBUG
+  printf("[BH1750] Converted float value: %f\r\n", level);
+  #endif
+  return level;
+}
+
 /**
  * Read light level from sensor
  * The return value range differs if the MTreg value is changed. The global
@@ -235,32 +317,41 @@ float BH1750_readLightLevel() {
   metal_i2c_read(I2C, BH1750_I2CADDR, 2, tmp, METAL_I2C_STOP_ENABLE);
   level = (float)((tmp[0] << 8) | tmp[1]);
 
-  lastReadTimestamp = millis();
+  lastReadTimestamp = ticks32();
 
   if (level != -1.0) {
-    // Print raw value if debug enabled
-    #ifdef BH1750_DEBUG
-    printf("[BH1750] Raw value: %f\r\n", level);
-    #endif
+    level = BH1750_toLux(level);
+  }
 
-    if (BH1750_MTreg != BH1750_DEFAULT_MTREG) {
-      level *= (float)((unsigned char)BH1750_DEFAULT_MTREG/(float)BH1750_MTreg);
-      // Print MTreg factor if debug enabled
-      #ifdef BH1750_DEBUG
-      printf("[BH1750] MTreg factor: %f\r\n", (float)((unsigned char)BH1750_DEFAULT_MTREG/(float)BH1750_MTreg));
-      #endif
-    }
-    if (BH1750_MODE == BH1750_ONE_TIME_HIGH_RES_MODE_2 || BH1750_MODE == BH1750_CONTINUOUS_HIGH_RES_MODE_2) {
-      level /= 2;
-    }
-    // Convert raw value to lux
-    level /= BH1750_CONV_FACTOR;
+  return level;
+}
 
-    // Print converted value if debug enabled
-    #ifdef BH1750_DEBUG
-    printf("[BH1750] Converted float value: %f\r\n", level);
-    #endif
+/**
+ * Read a one-time measurement and start the next one
+ * The one-time mode command follows the read after a repeated START, so
+ * the next conversion runs while the caller handles this one, with no
+ * BH1750_configure() and its 10 ms wait in between. In a continuous mode
+ * this is BH1750_readLightLevel().
+ * @return same as BH1750_readLightLevel()
+ */
+float BH1750_readLightLevelRearm() {
+  unsigned char mode = (unsigned char)BH1750_MODE;
+  unsigned char tmp[2] = {0, 0};
+
+  if (!(mode & BH1750_ONE_TIME_HIGH_RES_MODE)) {
+    return BH1750_readLightLevel();
   }
 
-  return level;
+  if (metal_i2c_read(I2C, BH1750_I2CADDR, 2, tmp, METAL_I2C_STOP_DISABLE) != 0) {
+    // No command follows, and the sensor may have been power cycled
+    BH1750_txFailed++;
+    BH1750_shadowMode = 0;
+    lastReadTimestamp = ticks32();
+    return -1.0;
+  }
+  BH1750_shadowMode = (BH1750_command(mode) == 0) ? mode : 0;
+  // The next conversion started with the command
+  lastReadTimestamp = ticks32();
+
+  return BH1750_toLux((float)((tmp[0] << 8) | tmp[1]));
 }
@@ -58,6 +58,9 @@ int BH1750_begin(Mode mode, unsigned char addr, struct metal_i2c *i2c);
 int BH1750_configure(Mode mode);
 int BH1750_setMTreg(unsigned char MTreg);
 int BH1750_measurementReady(int maxWait);// = false);
+void BH1750_transactionCounts(unsigned long *issued, unsigned long *elided);
+unsigned long BH1750_failedTransactions();
 float BH1750_readLightLevel();
+float BH1750_readLightLevelRearm();
 
 #endif // BH1750_H
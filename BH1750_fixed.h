@@ -0,0 +1,187 @@
+/*
+ * BH1750_fixed.h
+ *
+ * Single-sensor driver specialized at compile time for one address, mode
+ * and MTreg. The lux scale and the ready delays become constants: a read is
+ * the data register transfer (followed by the mode command that starts the
+ * next conversion in a one-time mode) and one multiply, with no mode
+ * switch, MTreg division or chained float divisions, and
+ * measurementReady() is a subtraction and a compare. Each inclusion defines one driver, prefixed by its name:
+ *
+ *   #define BH1750_FIXED_NAME  light
+ *   #define BH1750_FIXED_ADDR  0x23
+ *   #define BH1750_FIXED_MODE  BH1750_CONTINUOUS_HIGH_RES_MODE
+ *   #define BH1750_FIXED_MTREG 69          // optional, 69 by default
+ *   #include "BH1750_fixed.h"
+ *
+ *   light_begin(i2c);
+ *   if(light_measurementReady(0)) lux = light_readLightLevel();
+ *
+ * The parameters are checked at compile time and undefined at the end, so
+ * the header can be included again for another sensor. Define
+ * BH1750_FIXED_TIMEBASE_HZ to the ticks32() frequency to fold the ready
+ * delays into tick constants too; otherwise they are converted to ticks
+ * once, in begin(). The MTreg cannot change at run time, use the library
+ * of BH1750.c for that.
+ */
+#ifndef BH1750_FIXED_H
+#define BH1750_FIXED_H
+
+#include <stdint.h>
+#include <metal/i2c.h>
+#include "BH1750.h"
+#include "delay.h"
+
+// Low resolution modes, 0x13 and 0x23
+#define BH1750_FIXED_LOW_RES(mode) (((mode) & 0x0F) == 0x03)
+// High resolution mode 2, 0x11 and 0x21, counts in half lux
+#define BH1750_FIXED_HALF_LUX(mode) (((mode) & 0x0F) == 0x01)
+#define BH1750_FIXED_ONE_TIME(mode) (((mode) & BH1750_ONE_TIME_HIGH_RES_MODE) != 0)
+#define BH1750_FIXED_VALID_MODE(mode) \
+  ((mode) == BH1750_CONTINUOUS_HIGH_RES_MODE || (mode) == BH1750_CONTINUOUS_HIGH_RES_MODE_2 || \
+   (mode) == BH1750_CONTINUOUS_LOW_RES_MODE || (mode) == BH1750_ONE_TIME_HIGH_RES_MODE || \
+   (mode) == BH1750_ONE_TIME_HIGH_RES_MODE_2 || (mode) == BH1750_ONE_TIME_LOW_RES_MODE)
+
+// Typical and maximum conversion time in ms, as BH1750_measurementReady()
+#define BH1750_FIXED_TYPICAL_MS(mode, MTreg) \
+  ((BH1750_FIXED_LOW_RES(mode) ? 16 : 120) * (MTreg) / BH1750_DEFAULT_MTREG)
+#define BH1750_FIXED_MAX_MS(mode, MTreg) \
+  ((BH1750_FIXED_LOW_RES(mode) ? 24 : 180) * (MTreg) / BH1750_DEFAULT_MTREG)
+
+// Data register counts per lux, times 1.2: the MTreg and half lux counting
+#define BH1750_FIXED_DIVISOR(mode, MTreg) ((MTreg) * (BH1750_FIXED_HALF_LUX(mode) ? 2 : 1))
+// Lux per count, with the conversion factor of 1.2 of BH1750.c
+#define BH1750_FIXED_LUX_SCALE(mode, MTreg) \
+  ((float)(BH1750_DEFAULT_MTREG / (1.2 * BH1750_FIXED_DIVISOR(mode, MTreg))))
+// 1000 * BH1750_DEFAULT_MTREG / 1.2, a count of 65535 times it fits 32 bits
+#define BH1750_FIXED_MILLILUX_NUM 57500UL
+
+#define BH1750_FIXED_PASTE(name, fn) name##_##fn
+#define BH1750_FIXED_EXPAND(name, fn) BH1750_FIXED_PASTE(name, fn)
+#define BH1750_FIXED_FN(fn) BH1750_FIXED_EXPAND(BH1750_FIXED_NAME, fn)
+
+#endif // BH1750_FIXED_H
+
+#if !defined(BH1750_FIXED_NAME) || !defined(BH1750_FIXED_ADDR) || !defined(BH1750_FIXED_MODE)
+#error "BH1750_fixed.h: define BH1750_FIXED_NAME, BH1750_FIXED_ADDR and BH1750_FIXED_MODE first"
+#endif
+#ifndef BH1750_FIXED_MTREG
+#define BH1750_FIXED_MTREG BH1750_DEFAULT_MTREG
+#endif
+
+_Static_assert(BH1750_FIXED_ADDR == 0x23 || BH1750_FIXED_ADDR == 0x5C,
+               "BH1750_FIXED_ADDR must be 0x23 or 0x5C");
+_Static_assert(BH1750_FIXED_VALID_MODE(BH1750_FIXED_MODE), "BH1750_FIXED_MODE is not a measurement mode");
+_Static_assert(BH1750_FIXED_MTREG >= 32 && BH1750_FIXED_MTREG <= 254,
+               "BH1750_FIXED_MTREG must be between 32 and 254");
+
+static struct metal_i2c *BH1750_FIXED_FN(i2c);
+static uint32_t BH1750_FIXED_FN(lastReadTimestamp); // ticks32() of the last read or mode command
+#ifdef BH1750_FIXED_TIMEBASE_HZ
+#define BH1750_FIXED_READY_TICKS(maxWait) \
+  ((maxWait) ? (uint32_t)(BH1750_FIXED_MAX_MS(BH1750_FIXED_MODE, BH1750_FIXED_MTREG) * \
+                          (uint64_t)(BH1750_FIXED_TIMEBASE_HZ) / 1000) \
+             : (uint32_t)(BH1750_FIXED_TYPICAL_MS(BH1750_FIXED_MODE, BH1750_FIXED_MTREG) * \
+                          (uint64_t)(BH1750_FIXED_TIMEBASE_HZ) / 1000))
+#else
+static uint32_t BH1750_FIXED_FN(readyTicks)[2]; // typical, maximum
+#define BH1750_FIXED_READY_TICKS(maxWait) BH1750_FIXED_FN(readyTicks)[(maxWait) ? 1 : 0]
+#endif
+
+// Write one command byte
+static inline int BH1750_FIXED_FN(command)(unsigned char byte) {
+  return metal_i2c_write(BH1750_FIXED_FN(i2c), BH1750_FIXED_ADDR, 1, &byte, METAL_I2C_STOP_ENABLE) == 0;
+}
+
+/**
+ * Configure the sensor in the fixed mode and MTreg
+ * The MTreg commands are always sent: the sensor may not be freshly powered
+ * and still hold another MTreg.
+ * @param i2c I2C bus of the sensor, initialized by the caller
+ * @return 1 (true) or 0 (false) if the sensor did not acknowledge
+ */
+static inline int BH1750_FIXED_FN(begin)(struct metal_i2c *i2c) {
+  int ok;
+  BH1750_FIXED_FN(i2c) = i2c;
+#ifndef BH1750_FIXED_TIMEBASE_HZ
+  BH1750_FIXED_FN(readyTicks)[0] = msToTicks(BH1750_FIXED_TYPICAL_MS(BH1750_FIXED_MODE, BH1750_FIXED_MTREG));
+  BH1750_FIXED_FN(readyTicks)[1] = msToTicks(BH1750_FIXED_MAX_MS(BH1750_FIXED_MODE, BH1750_FIXED_MTREG));
+#endif
+  //   High bit: 01000_MT[7,6,5]
+  //    Low bit: 011_MT[4,3,2,1,0]
+  ok = BH1750_FIXED_FN(command)((0b01000 << 3) | (BH1750_FIXED_MTREG >> 5)) &&
+       BH1750_FIXED_FN(command)((0b011 << 5) | (BH1750_FIXED_MTREG & 0b11111));
+  ok = ok && BH1750_FIXED_FN(command)(BH1750_FIXED_MODE);
+  // Wait a few moments to wake up
+  delay(10);
+  BH1750_FIXED_FN(lastReadTimestamp) = ticks32();
+  return ok;
+}
+
+/**
+ * Checks whether enough time has gone to read a new value
+ * @param maxWait 1 (true) to wait for the maximum conversion time,
+ *                0 (false) for the typical one
+ * @return a boolean if a new measurement is possible
+ */
+static inline int BH1750_FIXED_FN(measurementReady)(int maxWait) {
+  return ticks32() - BH1750_FIXED_FN(lastReadTimestamp) >= BH1750_FIXED_READY_TICKS(maxWait);
+}
+
+/**
+ * Read the data register
+ * In a one-time mode the mode command follows after a repeated START and
+ * starts the next conversion, as BH1750_readLightLevelRearm().
+ * @param raw where to store the data register, left alone on failure
+ * @return 1 (true) or 0 (false) if the read failed
+ */
+static inline int BH1750_FIXED_FN(readRaw)(uint16_t *raw) {
+  unsigned char tmp[2];
+  int ok;
+  if(BH1750_FIXED_ONE_TIME(BH1750_FIXED_MODE)) {
+    unsigned char mode = BH1750_FIXED_MODE;
+    ok = metal_i2c_read(BH1750_FIXED_FN(i2c), BH1750_FIXED_ADDR, 2, tmp, METAL_I2C_STOP_DISABLE) == 0;
+    ok = ok && metal_i2c_write(BH1750_FIXED_FN(i2c), BH1750_FIXED_ADDR, 1, &mode, METAL_I2C_STOP_ENABLE) == 0;
+  } else {
+    ok = metal_i2c_read(BH1750_FIXED_FN(i2c), BH1750_FIXED_ADDR, 2, tmp, METAL_I2C_STOP_ENABLE) == 0;
+  }
+  BH1750_FIXED_FN(lastReadTimestamp) = ticks32();
+  if(ok) {
+    *raw = (uint16_t)((tmp[0] << 8) | tmp[1]);
+  }
+  return ok;
+}
+
+/**
+ * Read light level from sensor
+ * @return Light level in lux, -1 : no valid return value
+ */
+static inline float BH1750_FIXED_FN(readLightLevel)(void) {
+  uint16_t raw;
+  if(!BH1750_FIXED_FN(readRaw)(&raw)) {
+    return -1.0;
+  }
+  return raw * BH1750_FIXED_LUX_SCALE(BH1750_FIXED_MODE, BH1750_FIXED_MTREG);
+}
+
+/**
+ * Read light level from sensor in millilux, without floating point
+ * The division by a constant compiles to a multiply and a shift.
+ * @param millilux where to store the light level, rounded to nearest
+ * @return 1 (true) or 0 (false) if the read failed
+ */
+static inline int BH1750_FIXED_FN(readMilliLux)(uint32_t *millilux) {
+  const uint32_t divisor = BH1750_FIXED_DIVISOR(BH1750_FIXED_MODE, BH1750_FIXED_MTREG);
+  uint16_t raw;
+  if(!BH1750_FIXED_FN(readRaw)(&raw)) {
+    return 0;
+  }
+  *millilux = (raw * (uint32_t)BH1750_FIXED_MILLILUX_NUM + divisor / 2) / divisor;
+  return 1;
+}
+
+#undef BH1750_FIXED_READY_TICKS
+#undef BH1750_FIXED_NAME
+#undef BH1750_FIXED_ADDR
+#undef BH1750_FIXED_MODE
+#undef BH1750_FIXED_MTREG
@@ -0,0 +1,50 @@
+/*
+ * bench.h
+ *
+ * Helpers shared by the benchmarks. bench_now() reads the fastest
+ * free-running counter of the machine the benchmark runs on: mcycle on the
+ * FE310, the TSC on x86 hosts, a nanosecond clock elsewhere. Figures taken
+ * with it are only comparable within one run.
+ */
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+
+#if defined(__riscv)
+#define BENCH_UNIT "cycles"
+static inline uint64_t bench_now(void) {
+#if __riscv_xlen == 32
+  uint32_t hi, lo, hi2;
+  do {
+    __asm__ volatile ("rdcycleh %0" : "=r"(hi));
+    __asm__ volatile ("rdcycle %0" : "=r"(lo));
+    __asm__ volatile ("rdcycleh %0" : "=r"(hi2));
+  } while (hi != hi2);
+  return ((uint64_t)hi << 32) | lo;
+#else
+  uint64_t c;
+  __asm__ volatile ("rdcycle %0" : "=r"(c));
+  return c;
+#endif
+}
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_UNIT "tsc"
+static inline uint64_t bench_now(void) {
+  return __rdtsc();
+}
+#else
+#include <time.h>
+#define BENCH_UNIT "ns"
+static inline uint64_t bench_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#endif
+
+// Keep the compiler from optimizing a benchmarked result away
+#define BENCH_KEEP(x) __asm__ volatile ("" : : "g"(x) : "memory")
+
+#endif // BENCH_H
@@ -0,0 +1,122 @@
+/*
+ * bench_autorange.c
+ *
+ * Auto-ranging after a step in light level: the threshold ladder of the
+ * BH1750autoadjust example (MTreg 32 above 40000 lx, 138 below 10 lx, 69 in
+ * between, H-resolution mode) against the predictive engine of
+ * BH1750_autorange.c. For each step it reports the conversions and time
+ * until the range settles, the resolution the sensor ends up at and the
+ * error of the settled reading. A range that does not settle within
+ * MAX_CONVERSIONS counts as a failure.
+ *
+ * Build on the host from the repository root:
+ *   gcc -O2 -Isim -Iexamples/BH1750two_i2c -I. bench/bench_autorange.c \
+ *       examples/BH1750two_i2c/BH1750.c examples/BH1750two_i2c/BH1750_autorange.c \
+ *       delay.c sim/sim.c sim/bh1750_model.c -o bench_autorange
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include <metal/i2c.h>
+#include "BH1750.h"
+#include "BH1750_autorange.h"
+#include "sim.h"
+#include "bh1750_model.h"
+
+#define MAX_CONVERSIONS 10
+
+static const double steps[][2] = {
+  { 10.0, 100000.0 },
+  { 100000.0, 2.0 },
+  { 2.0, 300.0 },
+  { 300.0, 30000.0 },
+  { 500.0, 520.0 },
+};
+
+struct result {
+  int settled;
+  int conversions;
+  double ms;
+  double resolution;
+  double error;
+};
+
+// One step: settle at `from`, switch to `to`, read until the range holds
+static void run(int engine, double from, double to, struct result *r) {
+  struct bh1750_model model;
+  struct BH1750_autoRange autoRange;
+  struct BH1750_sample sample;
+  uint64_t start = 0;
+
+  sim_reset();
+  bh1750_model_init(&model, 0x23, from);
+  sim_attach(0, &model.dev);
+  struct metal_i2c *i2c = metal_i2c_get_device(0);
+  metal_i2c_init(i2c, 100000, METAL_I2C_MASTER);
+  struct BH1750_sensor *device = BH1750_begin(BH1750_CONTINUOUS_HIGH_RES_MODE, 0x23, i2c, 0);
+  BH1750_autoRangeInit(&autoRange);
+
+  r->conversions = 0;
+  r->error = 0.0;
+  for (int pass = 0; pass < 2; pass++) {
+    r->settled = false;
+    if (pass) {
+      bh1750_model_set_lux(&model, to);
+      // Pick up the new level from the next full conversion
+      device->lastReadTimestamp = ticks32();
+      start = sim_cycles();
+    }
+    for (int i = 0; i < MAX_CONVERSIONS; i++) {
+      while (!BH1750_measurementReady(device, 1)) {
+        sim_advance_us(1000);
+      }
+      BH1750_readRaw(device, &sample);
+      r->conversions += pass;
+
+      int changed;
+      if (engine) {
+        BH1750_Status status = BH1750_autoRangeUpdate(&autoRange, device, sample.raw);
+        changed = status != BH1750_DONE;
+        while (status == BH1750_IN_PROGRESS) {
+          sim_advance_us(1000);
+          status = BH1750_poll(device);
+        }
+      } else {
+        uint32_t mlx = BH1750_rawToMilliLux(device, sample.raw);
+        unsigned char MTreg = mlx > 40000000 ? 32 : mlx > 10000 ? 69 : 138;
+        changed = MTreg != device->BH1750_MTreg;
+        if (changed) {
+          BH1750_setMTreg(device, MTreg);
+        }
+      }
+      if (!changed) {
+        double lux = BH1750_rawToMilliLux(device, sample.raw) / 1000.0;
+        r->error = (lux - to) / to * 100.0;
+        if (r->error < 0) {
+          r->error = -r->error;
+        }
+        r->settled = true;
+        break;
+      }
+    }
+  }
+  r->ms = (sim_cycles() - start) * 1000.0 / SIM_TIMEBASE_HZ;
+  r->resolution = BH1750_autoRangeResolution(device) / 1000.0;
+}
+
+int main(void) {
+  int wrong = 0;
+
+  printf("step (lx)            | ladder: conv    ms  lx/count  error | engine: conv    ms  lx/count  error\r\n");
+  for (unsigned int i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+    struct result ladder, engine;
+    run(0, steps[i][0], steps[i][1], &ladder);
+    run(1, steps[i][0], steps[i][1], &engine);
+    printf("%8.0f -> %8.0f  |   %9d %5.0f %9.3f %5.1f%% |   %9d %5.0f %9.3f %5.1f%%\r\n",
+           steps[i][0], steps[i][1],
+           ladder.conversions, ladder.ms, ladder.resolution, ladder.error,
+           engine.conversions, engine.ms, engine.resolution, engine.error);
+    wrong += !ladder.settled + !engine.settled;
+  }
+  printf("%d ranges not settled within %d conversions\r\n", wrong, MAX_CONVERSIONS);
+  return wrong != 0;
+}
@@ -0,0 +1,131 @@
+/*
+ * bench_background.c
+ *
+ * Sampling jitter with a heavy printf workload: two sensors sampled every
+ * 200 ms, while the foreground prints 40 to 800 characters per sample over
+ * a 115200 baud UART (printf blocks until the UART has sent them).
+ *  - loop: the examples' pattern, read in main(), print, delay(200)
+ *  - background: BH1750_backgroundStart() reads from the timer interrupt
+ *    into a ring; main() drains it in batches and prints
+ * Reports the interval between consecutive samples of each sensor.
+ *
+ * Build on the host from the repository root:
+ *   gcc -O2 -Isim -Iexamples/BH1750two_i2c -I. bench/bench_background.c \
+ *       examples/BH1750two_i2c/BH1750.c examples/BH1750two_i2c/BH1750_background.c \
+ *       delay.c sim/sim.c sim/bh1750_model.c -lm -o bench_background
+ */
+#include <math.h>
+#include <stdio.h>
+#include <metal/i2c.h>
+#include "BH1750.h"
+#include "BH1750_background.h"
+#include "sim.h"
+#include "bh1750_model.h"
+
+#define SENSORS 2
+#define PERIOD_MS 200
+#define RUN_MS 60000
+#define UART_BAUD 115200
+#define RING_SIZE 16
+
+static struct bh1750_model model[SENSORS];
+static struct BH1750_sensor storage[SENSORS];
+static struct BH1750_registry registry;
+static struct BH1750_ringEntry ring_storage[RING_SIZE];
+static uint32_t rng = 12345;
+
+struct stats {
+  uint32_t last[SENSORS];
+  unsigned int count;
+  double sum, sum_sq, min, max;
+};
+
+static void setup(void) {
+  const unsigned char addr[SENSORS] = { 0x23, 0x5C };
+  sim_reset();
+  struct metal_i2c *i2c = metal_i2c_get_device(0);
+  metal_i2c_init(i2c, 100000, METAL_I2C_MASTER);
+  BH1750_registryInit(&registry, storage, SENSORS);
+  for (unsigned int i = 0; i < SENSORS; i++) {
+    bh1750_model_init(&model[i], addr[i], 300.0);
+    sim_attach(0, &model[i].dev);
+    BH1750_beginAt(&registry, BH1750_CONTINUOUS_HIGH_RES_MODE, addr[i], i2c, NULL, 0, 0);
+  }
+}
+
+// printf of 40 to 800 characters, blocking on the UART
+static void printf_workload(void) {
+  rng = rng * 1103515245 + 12345;
+  unsigned int chars = 40 + (rng >> 16) % 761;
+  sim_advance_cycles(chars * 10ULL * SIM_TIMEBASE_HZ / UART_BAUD);
+}
+
+static void record(struct stats *s, unsigned int sensor, uint32_t ticks) {
+  if (s->last[sensor] != 0) {
+    double ms = (uint32_t)(ticks - s->last[sensor]) * 1000.0 / SIM_TIMEBASE_HZ;
+    s->sum += ms;
+    s->sum_sq += ms * ms;
+    s->min = s->count == 0 || ms < s->min ? ms : s->min;
+    s->max = s->count == 0 || ms > s->max ? ms : s->max;
+    s->count++;
+  }
+  s->last[sensor] = ticks ? ticks : 1;
+}
+
+static void report(const char *name, const struct stats *s) {
+  double mean = s->sum / s->count;
+  double sd = sqrt(s->sum_sq / s->count - mean * mean);
+  printf("%-11s %6u intervals  mean %8.3f ms  sd %8.3f ms  min %8.3f  max %8.3f\r\n",
+         name, s->count, mean, sd, s->min, s->max);
+}
+
+int main(void) {
+  struct stats loop = { 0 }, background = { 0 };
+
+  setup();
+  uint64_t start = sim_cycles();
+  while (sim_cycles() - start < RUN_MS * (SIM_TIMEBASE_HZ / 1000)) {
+    for (unsigned int i = 0; i < SENSORS; i++) {
+      struct BH1750_sample sample;
+      uint32_t ticks = ticks32();
+      BH1750_readRaw(&storage[i], &sample);
+      record(&loop, i, ticks);
+      printf_workload();
+    }
+    delay(PERIOD_MS);
+  }
+
+  setup();
+  struct BH1750_ring ring;
+  struct BH1750_background sampler;
+  struct BH1750_ringEntry batch[RING_SIZE];
+  unsigned int batches = 0, largest = 0;
+  BH1750_ringInit(&ring, ring_storage, RING_SIZE);
+  if (!BH1750_backgroundStart(&sampler, &registry, &ring, PERIOD_MS)) {
+    printf("BH1750_backgroundStart() failed\r\n");
+    return 1;
+  }
+  start = sim_cycles();
+  while (sim_cycles() - start < RUN_MS * (SIM_TIMEBASE_HZ / 1000)) {
+    unsigned int n = BH1750_ringPop(&ring, batch, RING_SIZE);
+    if (n == 0) {
+      delay(10);
+      continue;
+    }
+    batches++;
+    largest = n > largest ? n : largest;
+    for (unsigned int i = 0; i < n; i++) {
+      record(&background, batch[i].sensor, batch[i].ticks);
+      printf_workload();
+    }
+  }
+  BH1750_backgroundStop(&sampler);
+
+  printf("%d sensors, %d ms period, printf workload of 40-800 chars at %d baud per sample\r\n",
+         SENSORS, PERIOD_MS, UART_BAUD);
+  report("loop", &loop);
+  report("background", &background);
+  printf("background: %u batches (largest %u), %u dropped, %u overruns\r\n",
+         batches, largest, (unsigned)ring.dropped, (unsigned)sampler.overruns);
+  return ring.dropped != 0;
+}
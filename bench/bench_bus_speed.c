@@ -0,0 +1,109 @@
+/*
+ * bench_bus_speed.c
+ *
+ * Fast-mode bring-up with BH1750_busBringUp() on two buses of two sensors:
+ * bus 0 is clean, bus 1 fails 30% of its transfers above 100 kHz (marginal
+ * pull-ups). Reports the speed each bus settles on, errors per speed, bus
+ * time per read and per setMTreg() sequence at each speed, and CPU time
+ * blocked per read. Then bus 0 starts failing 5% of its fast transfers
+ * mid-run and must fall back to standard mode on its own.
+ *
+ * Build on the host from the repository root:
+ *   gcc -O2 -Isim -Iexamples/BH1750two_i2c -I. bench/bench_bus_speed.c \
+ *       examples/BH1750two_i2c/BH1750.c delay.c sim/sim.c sim/bh1750_model.c \
+ *       -o bench_bus_speed
+ */
+#include <stdio.h>
+#include <metal/i2c.h>
+#include "BH1750.h"
+#include "sim.h"
+#include "bh1750_model.h"
+
+#define READS 200
+#define SEQUENCES 20
+
+static struct bh1750_model model[4];
+static struct BH1750_sensor storage[4];
+static struct BH1750_registry registry;
+static struct BH1750_bus bus[2];
+
+static const char *speed_name(const struct BH1750_bus *b) {
+  return b->speed == BH1750_BUS_FAST ? "400 kHz" : "100 kHz";
+}
+
+// Reads and setMTreg() sequences on the two sensors of a bus
+static void workload(int n, struct BH1750_bus *b, double *read_us, double *blocked_us, double *mtreg_us) {
+  unsigned int hz = b->speed == BH1750_BUS_FAST ? BH1750_BUS_FAST_HZ : BH1750_BUS_STANDARD_HZ;
+  uint64_t bits = b->bits[b->speed], blocked = 0;
+  for (int i = 0; i < READS; i++) {
+    uint64_t t0 = sim_cycles();
+    BH1750_readLightLevel(&storage[2 * n + i % 2]);
+    blocked += sim_cycles() - t0;
+  }
+  *read_us = (b->bits[b->speed] - bits) * 1e6 / hz / READS;
+  *blocked_us = blocked * 1e6 / SIM_TIMEBASE_HZ / READS;
+  bits = b->bits[b->speed];
+  for (int i = 0; i < SEQUENCES; i++) {
+    BH1750_setMTreg(&storage[2 * n], i % 2 ? 100 : 69);
+  }
+  *mtreg_us = (b->bits[b->speed] - bits) * 1e6 / hz / SEQUENCES;
+}
+
+static void print_bus(int n, const struct BH1750_bus *b) {
+  printf("bus %d  %s  fast: %4u tr %3u errors  standard: %4u tr %3u errors  %u fallbacks\r\n",
+         n, speed_name(b), (unsigned)b->transactions[BH1750_BUS_FAST], (unsigned)b->errors[BH1750_BUS_FAST],
+         (unsigned)b->transactions[BH1750_BUS_STANDARD], (unsigned)b->errors[BH1750_BUS_STANDARD],
+         b->fallbacks);
+}
+
+int main(void) {
+  const unsigned char addr[2] = { 0x23, 0x5C };
+  double read_us[2], blocked_us[2], mtreg_us[2];
+  int up[2];
+
+  sim_reset();
+  BH1750_registryInit(&registry, storage, 4);
+  for (int n = 0; n < 2; n++) {
+    struct metal_i2c *i2c = metal_i2c_get_device(n);
+    metal_i2c_init(i2c, BH1750_BUS_STANDARD_HZ, METAL_I2C_MASTER);
+    for (int i = 0; i < 2; i++) {
+      bh1750_model_init(&model[2 * n + i], addr[i], 300.0 + 100 * i);
+      sim_attach(n, &model[2 * n + i].dev);
+      BH1750_beginAt(&registry, BH1750_CONTINUOUS_HIGH_RES_MODE, addr[i], i2c, NULL, 0, 0);
+    }
+  }
+  sim_bus_set_faults(metal_i2c_get_device(1), BH1750_BUS_STANDARD_HZ, 300);
+  for (int n = 0; n < 2; n++) {
+    up[n] = BH1750_busBringUp(&bus[n], &registry, metal_i2c_get_device(n));
+  }
+
+  printf("bring-up, %d probe reads per sensor\r\n", BH1750_BUS_PROBES);
+  for (int n = 0; n < 2; n++) {
+    print_bus(n, &bus[n]);
+  }
+  for (int n = 0; n < 2; n++) {
+    workload(n, &bus[n], &read_us[n], &blocked_us[n], &mtreg_us[n]);
+  }
+  for (int n = 0; n < 2; n++) {
+    printf("bus %d  %s  bus time %6.1f us/read, %7.1f us/setMTreg  CPU blocked %6.1f us/read  %5u ns/transaction\r\n",
+           n, speed_name(&bus[n]), read_us[n], mtreg_us[n], blocked_us[n],
+           (unsigned)BH1750_busTimeNs(&bus[n], (BH1750_BusSpeed)bus[n].speed));
+  }
+  printf("fast mode gain: %.2fx per read, %.2fx per setMTreg\r\n", read_us[1] / read_us[0], mtreg_us[1] / mtreg_us[0]);
+
+  // Bus 0 degrades while in use
+  sim_bus_set_faults(metal_i2c_get_device(0), BH1750_BUS_STANDARD_HZ, 50);
+  uint32_t failed = 0, failed_after = 0;
+  for (int i = 0; i < 2000; i++) {
+    int fallen = bus[0].fallbacks > 0;
+    if (BH1750_readLightLevel(&storage[i % 2]) < 0) {
+      failed++;
+      failed_after += fallen;
+    }
+  }
+  printf("bus 0 degrades to 5%% faults above 100 kHz: %u failed reads of 2000, %u after the fallback\r\n",
+         (unsigned)failed, (unsigned)failed_after);
+  print_bus(0, &bus[0]);
+  return !(up[0] && up[1] && bus[0].speed == BH1750_BUS_STANDARD && bus[1].speed == BH1750_BUS_STANDARD &&
+           failed_after == 0);
+}
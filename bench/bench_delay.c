@@ -0,0 +1,75 @@
+/*
+ * bench_delay.c
+ *
+ * Requested versus actual length of delay() and delayMicroseconds(), and
+ * how much of it the hart spends asleep in wfi rather than spinning on the
+ * cycle counter. Each length is measured from 50 start times spread over
+ * an mtime period. The nop-loop delay this replaces cannot be measured
+ * here: the simulator charges no time for nops, and on the board its
+ * length depends on the core clock and the compiler.
+ *
+ * Build on the host from the repository root:
+ *   gcc -O2 -Isim -I. bench/bench_delay.c delay.c sim/sim.c -o bench_delay
+ */
+#include <stdio.h>
+#include "delay.h"
+#include "sim.h"
+
+#define TRIALS 50
+
+static double us(double cycles) {
+  return cycles * 1000000.0 / SIM_TIMEBASE_HZ;
+}
+
+static void measure(const char *name, uint32_t requested_us, int in_ms) {
+  struct sim_cpu_stats before, after;
+  double sum = 0, worst = 0;
+  uint64_t total = 0;
+
+  sim_cpu_stats(&before);
+  for (int i = 0; i < TRIALS; i++) {
+    // Start at a different phase of the mtime period every time
+    sim_advance_cycles(1 + i * (SIM_TIMEBASE_HZ / SIM_MTIME_HZ) / TRIALS);
+    uint64_t t0 = sim_cycles();
+    if (in_ms) {
+      delay(requested_us / 1000);
+    } else {
+      delayMicroseconds((int)requested_us);
+    }
+    uint64_t elapsed = sim_cycles() - t0;
+    double error = us(elapsed) - requested_us;
+    sum += error;
+    if (error > worst || -error > worst) {
+      worst = error < 0 ? -error : error;
+    }
+    total += elapsed;
+  }
+  sim_cpu_stats(&after);
+  printf("%-26s %+9.2f us %9.2f us %8.1f%%\r\n", name, sum / TRIALS, worst,
+         100.0 * (after.sleep_cycles - before.sleep_cycles) / total);
+}
+
+int main(void) {
+  const uint32_t ms[] = { 1, 5, 10, 50, 100, 1000, 5000 };
+  const uint32_t micro[] = { 10, 100, 500, 1000 };
+  char name[32];
+
+  sim_reset();
+  if (!delayInit()) {
+    printf("delayInit() failed, delays only spin\r\n");
+  }
+  printf("call                       mean error  max |error|   asleep\r\n");
+  for (unsigned int i = 0; i < sizeof(micro) / sizeof(micro[0]); i++) {
+    snprintf(name, sizeof(name), "delayMicroseconds(%u)", (unsigned)micro[i]);
+    measure(name, micro[i], 0);
+  }
+  for (unsigned int i = 0; i < sizeof(ms) / sizeof(ms[0]); i++) {
+    snprintf(name, sizeof(name), "delay(%u)", (unsigned)ms[i]);
+    measure(name, ms[i] * 1000, 1);
+  }
+  struct sim_cpu_stats stats;
+  sim_cpu_stats(&stats);
+  printf("%u wfi, %u timer interrupts, %u wfi with nothing to wake the hart\r\n",
+         (unsigned)stats.wfi, (unsigned)stats.timer_interrupts, (unsigned)stats.stuck);
+  return stats.stuck != 0;
+}
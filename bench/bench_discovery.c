@@ -0,0 +1,152 @@
+/*
+ * bench_discovery.c
+ *
+ * BH1750_scan() on three buses:
+ *  - bus 0: a full TCA9548A at 0x70 (16 sensors) and a second one at 0x74
+ *    with two sensors
+ *  - bus 1: a sensor at 0x23 on the bus itself and a mux at 0x70 with 0x5C
+ *    sensors on two channels
+ *  - bus 2: two sensors on the bus itself, no mux
+ * Checks that every sensor is registered once, at its bus, mux and
+ * channel, and nothing else; reports scan time and probes per bus at 100
+ * and 400 kHz. Then starts every sensor found with BH1750_beginAll() and
+ * checks the readings against the models.
+ *
+ * Build on the host from the repository root:
+ *   gcc -O2 -Isim -Iexamples/BH1750two_i2c -I. bench/bench_discovery.c \
+ *       examples/BH1750two_i2c/BH1750.c delay.c \
+ *       sim/sim.c sim/bh1750_model.c sim/tca9548a_model.c -o bench_discovery
+ */
+#include <stdio.h>
+#include <metal/i2c.h>
+#include "BH1750.h"
+#include "sim.h"
+#include "bh1750_model.h"
+#include "tca9548a_model.h"
+
+#define BUSES 3
+#define SENSORS 23
+#define MAX_MUXES 2
+
+// Where each sensor sits: bus, mux address (0 for none), channel, address
+struct placement {
+  unsigned int bus;
+  unsigned char mux;
+  unsigned char channel;
+  unsigned char addr;
+};
+
+static struct placement placements[SENSORS];
+static struct bh1750_model model[SENSORS];
+static struct tca9548a_model mux_model[3];
+static struct BH1750_sensor storage[SENSORS + 4];
+static struct BH1750_registry registry;
+static struct BH1750_mux muxes[BUSES][MAX_MUXES];
+static struct BH1750_setup setups[SENSORS];
+static struct BH1750_sensor *device[SENSORS];
+
+static unsigned int place(unsigned int n, unsigned int bus, struct tca9548a_model *mux, unsigned char channel,
+                          unsigned char addr) {
+  placements[n] = (struct placement){ bus, mux ? (unsigned char)mux->dev.addr : 0, channel, addr };
+  bh1750_model_init(&model[n], addr, 25.0 + 45.0 * n);
+  if (mux) {
+    tca9548a_model_attach(mux, channel, &model[n].dev);
+  } else {
+    sim_attach(bus, &model[n].dev);
+  }
+  return n + 1;
+}
+
+static void setup(unsigned int baud) {
+  unsigned int n = 0;
+  sim_reset();
+  for (unsigned int bus = 0; bus < BUSES; bus++) {
+    metal_i2c_init(metal_i2c_get_device(bus), baud, METAL_I2C_MASTER);
+  }
+  tca9548a_model_init(&mux_model[0], 0x70);
+  tca9548a_model_init(&mux_model[1], 0x74);
+  tca9548a_model_init(&mux_model[2], 0x70);
+  sim_attach(0, &mux_model[0].dev);
+  sim_attach(0, &mux_model[1].dev);
+  sim_attach(1, &mux_model[2].dev);
+  for (unsigned char ch = 0; ch < 8; ch++) {
+    n = place(n, 0, &mux_model[0], ch, 0x23);
+    n = place(n, 0, &mux_model[0], ch, 0x5C);
+  }
+  n = place(n, 0, &mux_model[1], 1, 0x23);
+  n = place(n, 0, &mux_model[1], 5, 0x5C);
+  n = place(n, 1, NULL, 0, 0x23);
+  n = place(n, 1, &mux_model[2], 0, 0x5C);
+  n = place(n, 1, &mux_model[2], 6, 0x5C);
+  n = place(n, 2, NULL, 0, 0x23);
+  n = place(n, 2, NULL, 0, 0x5C);
+  BH1750_registryInit(&registry, storage, SENSORS + 4);
+}
+
+// Model of the registered sensor, -1 if it matches none
+static int match(const struct BH1750_sensor *s) {
+  for (int n = 0; n < SENSORS; n++) {
+    const struct placement *p = &placements[n];
+    if (s->i2c == metal_i2c_get_device(p->bus) && s->BH1750_I2CADDR == p->addr &&
+        (s->mux ? s->mux->addr : 0) == p->mux && (!s->mux || s->muxChannel == p->channel)) {
+      return n;
+    }
+  }
+  return -1;
+}
+
+static int scan(unsigned int baud, int start) {
+  struct BH1750_scanResult result[BUSES];
+  int found[SENSORS] = { 0 };
+  int wrong = 0;
+
+  setup(baud);
+  for (unsigned int bus = 0; bus < BUSES; bus++) {
+    if (!BH1750_scan(&registry, metal_i2c_get_device(bus), muxes[bus], MAX_MUXES, &result[bus])) {
+      wrong++;
+    }
+  }
+  for (unsigned int i = 0; i < registry.count; i++) {
+    int n = match(&storage[i]);
+    if (n < 0 || found[n]++) {
+      wrong++;
+    }
+  }
+  wrong += registry.count != SENSORS;
+
+  for (unsigned int bus = 0; bus < BUSES; bus++) {
+    printf("%3u kHz  bus %u: %2u sensors, %u muxes, %3u probes, scan %7.2f ms\r\n", baud / 1000, bus,
+           result[bus].sensors, result[bus].muxes, result[bus].probes, result[bus].micros / 1000.0);
+  }
+  if (!start) {
+    return wrong;
+  }
+
+  for (unsigned int i = 0; i < registry.count; i++) {
+    const struct BH1750_sensor *s = &storage[i];
+    setups[i] = (struct BH1750_setup){ BH1750_CONTINUOUS_HIGH_RES_MODE, (unsigned char)s->BH1750_I2CADDR, s->i2c,
+                                       s->mux, s->muxChannel, 0 };
+  }
+  uint32_t t0 = micros();
+  unsigned int started = BH1750_beginAll(&registry, setups, registry.count, device);
+  uint32_t begin_us = micros() - t0;
+  int bad = started != registry.count;
+  for (unsigned int i = 0; i < started; i++) {
+    while (!BH1750_measurementReady(device[i], 1)) {
+      sim_advance_us(1000);
+    }
+    int n = match(device[i]);
+    float lux = BH1750_readLightLevel(device[i]);
+    bad += n < 0 || lux < model[n].lux - 1 || lux > model[n].lux + 1;
+  }
+  printf("%3u kHz  started %u sensors found by the scan in %.2f ms, %d wrong readings\r\n",
+         baud / 1000, started, begin_us / 1000.0, bad);
+  return wrong + bad;
+}
+
+int main(void) {
+  int wrong = scan(100000, 1);
+  wrong += scan(400000, 0);
+  printf("placement: %s\r\n", wrong ? "WRONG" : "every sensor registered once, at its bus, mux and channel");
+  return wrong != 0;
+}
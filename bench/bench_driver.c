@@ -0,0 +1,81 @@
+/*
+ * bench_driver.c
+ *
+ * Bus and blocking cost of the single-sensor library (BH1750.c, delay.c) on
+ * the host-side simulator: bytes and transactions on the wire, bus time at
+ * 100 kHz and 400 kHz, and how long the CPU is blocked in each call.
+ *
+ * Build on the host from the repository root:
+ *   gcc -O2 -Isim -I. bench/bench_driver.c BH1750.c delay.c sim/sim.c \
+ *       sim/bh1750_model.c -o bench_driver
+ */
+#include <stdio.h>
+#include <metal/i2c.h>
+#include "BH1750.h"
+#include "sim.h"
+#include "bh1750_model.h"
+#include "bench.h"
+
+#define READS 100
+
+struct sample {
+  struct sim_bus_stats bus;
+  uint64_t blocked_cycles;
+};
+
+static void report(const char *name, const struct sample *s, unsigned int calls) {
+  printf("%-24s %6.1f B %5.1f tr  bus %7.1f us @100k %7.1f us @400k  blocked %8.1f us\r\n",
+         name,
+         (double)s->bus.bytes / calls,
+         (double)s->bus.transactions / calls,
+         sim_bus_time_ns(s->bus.bits, 100000) / 1000.0 / calls,
+         sim_bus_time_ns(s->bus.bits, 400000) / 1000.0 / calls,
+         s->blocked_cycles * 1000000.0 / SIM_TIMEBASE_HZ / calls);
+}
+
+static void run(unsigned int baud) {
+  struct bh1750_model sensor;
+  struct sample begin = {0}, read = {0};
+  uint64_t t0, host = 0;
+
+  sim_reset();
+  bh1750_model_init(&sensor, 0x23, 500.0);
+  sim_attach(0, &sensor.dev);
+  struct metal_i2c *i2c = metal_i2c_get_device(0);
+  metal_i2c_init(i2c, baud, METAL_I2C_MASTER);
+
+  t0 = sim_cycles();
+  BH1750_begin(BH1750_CONTINUOUS_HIGH_RES_MODE, 0x23, i2c);
+  begin.blocked_cycles = sim_cycles() - t0;
+  sim_bus_stats(i2c, &begin.bus);
+
+  float lux = 0;
+  for (int i = 0; i < READS; i++) {
+    while (!BH1750_measurementReady(0)) {
+      sim_advance_us(1000);
+    }
+    sim_bus_stats_reset(i2c);
+    t0 = sim_cycles();
+    uint64_t h0 = bench_now();
+    lux = BH1750_readLightLevel();
+    host += bench_now() - h0;
+    read.blocked_cycles += sim_cycles() - t0;
+    struct sim_bus_stats s;
+    sim_bus_stats(i2c, &s);
+    read.bus.bytes += s.bytes;
+    read.bus.transactions += s.transactions;
+    read.bus.bits += s.bits;
+  }
+
+  printf("--- bus configured at %u Hz\r\n", baud);
+  report("BH1750_begin()", &begin, 1);
+  report("BH1750_readLightLevel()", &read, READS);
+  printf("%-24s %.1f %s/call on this host, last reading %.2f lx (model %.2f lx)\r\n",
+         "", (double)host / READS, BENCH_UNIT, lux, sensor.lux);
+}
+
+int main(void) {
+  run(100000);
+  run(400000);
+  return 0;
+}
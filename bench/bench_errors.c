@@ -0,0 +1,194 @@
+/*
+ * bench_errors.c
+ *
+ * Error codes, per-sensor counters and the log sink of the multi-sensor
+ * library. A sensor is driven through NACKs on a marginal bus, timeouts on
+ * a held bus, an invalid mode, an MTreg out of range, a trigger in a
+ * continuous mode, a read of an unconfigured sensor and stale reads of a
+ * unit slower than the datasheet; each call must return its error code,
+ * the counters must match the bus statistics of the simulation and the
+ * sink must see every error once. Then reports the time a failed read
+ * costs with a printf sink on a 115200 baud UART, with a counting sink and
+ * with no sink.
+ *
+ * Build on the host from the repository root:
+ *   gcc -O2 -Isim -Iexamples/BH1750two_i2c -I. bench/bench_errors.c \
+ *       examples/BH1750two_i2c/BH1750.c examples/BH1750two_i2c/BH1750_readiness.c delay.c \
+ *       sim/sim.c sim/bh1750_model.c -o bench_errors
+ */
+#include <stdio.h>
+#include <metal/i2c.h>
+#include "BH1750.h"
+#include "BH1750_readiness.h"
+#include "sim.h"
+#include "bh1750_model.h"
+
+#define READS 400
+#define STUCK_READS 10
+#define STALE_SAMPLES 20
+#define COST_READS 100
+#define UART_BAUD 115200
+
+static struct bh1750_model model_a, model_b;
+static struct BH1750_sensor storage[2];
+static struct BH1750_registry registry;
+static struct BH1750_mux muxes[1];
+
+static uint32_t logged[BH1750_ERRORS];
+
+static void count_error(const struct BH1750_sensor *device, BH1750_Error error, const char *message) {
+  (void)device;
+  (void)message;
+  logged[error]++;
+}
+
+// What a printf sink costs: the line goes out on the UART before printf returns
+static void uart_error(const struct BH1750_sensor *device, BH1750_Error error, const char *message) {
+  char line[128];
+  int chars = snprintf(line, sizeof(line), "[BH1750] ERROR: 0x%02X %s: %s\r\n",
+                       device ? device->BH1750_I2CADDR : 0, BH1750_errorName(error), message);
+  sim_advance_cycles(chars * 10ULL * SIM_TIMEBASE_HZ / UART_BAUD);
+}
+
+static struct BH1750_sensor *setup(unsigned int conv_permille) {
+  sim_reset();
+  struct metal_i2c *i2c = metal_i2c_get_device(0);
+  metal_i2c_init(i2c, 100000, METAL_I2C_MASTER);
+  bh1750_model_init(&model_a, 0x23, 100.0);
+  model_a.conv_permille = conv_permille;
+  sim_attach(0, &model_a.dev);
+  BH1750_registryInit(&registry, storage, 2);
+  return BH1750_beginAt(&registry, BH1750_CONTINUOUS_HIGH_RES_MODE, 0x23, i2c, NULL, 0, 0);
+}
+
+static int check(const char *what, uint32_t got, uint32_t expected) {
+  printf("  %-38s %6u  expected %6u  %s\r\n", what, (unsigned)got, (unsigned)expected,
+         got == expected ? "ok" : "WRONG");
+  return got != expected;
+}
+
+static int counters(void) {
+  struct BH1750_sensor *device = setup(1000);
+  struct metal_i2c *i2c = metal_i2c_get_device(0);
+  struct BH1750_sample sample;
+  struct BH1750_stats stats;
+  struct sim_bus_stats bus;
+  int wrong = 0;
+
+  BH1750_setLogSink(count_error);
+  BH1750_clearStats(device);
+  sim_bus_stats_reset(i2c);
+  sim_advance_us(200000);
+
+  // Marginal bus at 400 kHz
+  metal_i2c_set_baud_rate(i2c, 400000);
+  sim_bus_set_faults(i2c, 100000, 150);
+  uint32_t failed = 0;
+  for (int i = 0; i < READS; i++) {
+    failed += BH1750_readRaw(device, &sample) != BH1750_SAMPLE_OK;
+  }
+  sim_bus_set_faults(i2c, 0, 0);
+  wrong += BH1750_lastError(device) != (failed ? BH1750_ERR_NACK : BH1750_OK);
+
+  // Held bus
+  sim_bus_set_stuck(i2c, 1);
+  for (int i = 0; i < STUCK_READS; i++) {
+    BH1750_readRaw(device, &sample);
+  }
+  sim_bus_set_stuck(i2c, 0);
+  wrong += BH1750_lastError(device) != BH1750_ERR_TIMEOUT;
+  sim_bus_stats(i2c, &bus);
+  BH1750_getStats(device, &stats);
+  uint32_t transfers = stats.transfers;
+
+  // Calls the driver refuses before the bus
+  wrong += BH1750_configure(device, (BH1750_Mode)0x42) || BH1750_lastError(device) != BH1750_ERR_INVALID_MODE;
+  wrong += BH1750_setMTreg(device, 20) || BH1750_lastError(device) != BH1750_ERR_OUT_OF_RANGE;
+  wrong += BH1750_trigger(device) || BH1750_lastError(device) != BH1750_ERR_INVALID_MODE;
+  wrong += BH1750_configure(NULL, BH1750_CONTINUOUS_HIGH_RES_MODE);
+  wrong += !BH1750_configure(device, BH1750_CONTINUOUS_LOW_RES_MODE);
+  wrong += !BH1750_setMTreg(device, 100);
+
+  BH1750_getStats(device, &stats);
+  printf("sensor 0x23: %d reads on a marginal 400 kHz bus, %d on a held bus, 3 refused calls\r\n",
+         READS, STUCK_READS);
+  // Transfers on the held bus never reach the wire
+  wrong += check("transfers = bus transactions + held", transfers, bus.transactions + STUCK_READS);
+  wrong += check("NACKs = bus NACKs", stats.nacks, bus.nacks);
+  wrong += check("NACKs = failed reads", stats.nacks, failed);
+  wrong += check("timeouts", stats.timeouts, STUCK_READS);
+  wrong += check("invalid mode", stats.invalidMode, 2);
+  wrong += check("out of range", stats.outOfRange, 1);
+  wrong += check("logged NACKs", logged[BH1750_ERR_NACK], stats.nacks);
+  wrong += check("logged timeouts", logged[BH1750_ERR_TIMEOUT], stats.timeouts);
+
+  // A second sensor, found by a scan and not configured yet
+  bh1750_model_init(&model_b, 0x5C, 100.0);
+  sim_attach(0, &model_b.dev);
+  struct BH1750_scanResult scan;
+  BH1750_scan(&registry, i2c, muxes, 1, &scan);
+  struct BH1750_sensor *unconfigured = BH1750_registryFind(&registry, i2c, NULL, 0, 0x5C);
+  BH1750_readRaw(unconfigured, &sample);
+  BH1750_getStats(unconfigured, &stats);
+  wrong += unconfigured == NULL || BH1750_lastError(unconfigured) != BH1750_ERR_NOT_CONFIGURED;
+  printf("sensor 0x5C, read before it is configured\r\n");
+  wrong += check("invalid mode", stats.invalidMode, 1);
+  wrong += check("logged not configured", logged[BH1750_ERR_NOT_CONFIGURED], 1);
+  wrong += check("logged invalid mode and out of range",
+                 logged[BH1750_ERR_INVALID_MODE] + logged[BH1750_ERR_OUT_OF_RANGE], 3);
+
+  // Bad address, reported on the registry
+  wrong += BH1750_beginAt(&registry, BH1750_CONTINUOUS_HIGH_RES_MODE, 0x42, i2c, NULL, 0, 0) != NULL ||
+           registry.lastError != BH1750_ERR_BAD_ADDRESS;
+  BH1750_setLogSink(NULL);
+  return wrong;
+}
+
+// Unit converting in 120% of the typical time, read at the typical time
+static int stale(void) {
+  struct BH1750_sensor *device = setup(1200);
+  struct BH1750_readiness readiness;
+  struct BH1750_sample sample;
+  struct BH1750_stats stats;
+
+  BH1750_configure(device, BH1750_ONE_TIME_HIGH_RES_MODE);
+  BH1750_clearStats(device);
+  BH1750_readinessInit(&readiness, device, BH1750_READY_TYPICAL);
+  for (int i = 0; i < STALE_SAMPLES; i++) {
+    BH1750_readinessSample(&readiness, &sample);
+  }
+  BH1750_getStats(device, &stats);
+  printf("slow unit read at the typical time, %d samples\r\n", STALE_SAMPLES);
+  return check("stale reads", stats.staleReads, readiness.stale) |
+         check("stale reads, one per sample", stats.staleReads, STALE_SAMPLES);
+}
+
+// Time of a failed read, sink included
+static double cost(BH1750_logSink_t sink) {
+  struct BH1750_sensor *device = setup(1000);
+  struct metal_i2c *i2c = metal_i2c_get_device(0);
+  struct BH1750_sample sample;
+
+  BH1750_setLogSink(sink);
+  sim_bus_set_faults(i2c, 0, 1000);
+  uint64_t t0 = sim_cycles();
+  for (int i = 0; i < COST_READS; i++) {
+    BH1750_readRaw(device, &sample);
+  }
+  uint64_t cycles = sim_cycles() - t0;
+  BH1750_setLogSink(NULL);
+  return cycles * 1e6 / SIM_TIMEBASE_HZ / COST_READS;
+}
+
+int main(void) {
+  int wrong = counters();
+  wrong += stale();
+
+  double uart = cost(uart_error);
+  double counting = cost(count_error);
+  double none = cost(NULL);
+  printf("failed read: printf sink at %d baud %.1f us, counting sink %.1f us, no sink %.1f us\r\n",
+         UART_BAUD, uart, counting, none);
+  printf("%d wrong\r\n", wrong);
+  return wrong != 0 || uart < 10 * none;
+}
@@ -0,0 +1,160 @@
+/*
+ * bench_fixed.c
+ *
+ * Compile-time specialized driver (BH1750_fixed.h) against the generic
+ * single-sensor library (BH1750.c) in three configurations: continuous high
+ * resolution at MTreg 69, continuous high resolution 2 at MTreg 138 with the
+ * ready delays folded into tick constants, and one-time low resolution at
+ * MTreg 32. Every reading of both drivers is checked against the lux of the
+ * data register the model returns, the millilux reading to within one
+ * millilux. Reports the host cost of measurementReady() and of a read with
+ * each driver; the bench target also prints the code size of the
+ * BH1750fixed example next to the generic BH1750test.
+ *
+ * Build on the host from the repository root:
+ *   gcc -O2 -Isim -I. bench/bench_fixed.c BH1750.c delay.c sim/sim.c \
+ *       sim/bh1750_model.c -o bench_fixed
+ */
+#include <stdio.h>
+#include <math.h>
+#include <metal/i2c.h>
+#include "BH1750.h"
+#include "sim.h"
+#include "bh1750_model.h"
+#include "bench.h"
+
+#define BH1750_FIXED_NAME  hres
+#define BH1750_FIXED_ADDR  0x23
+#define BH1750_FIXED_MODE  BH1750_CONTINUOUS_HIGH_RES_MODE
+#include "BH1750_fixed.h"
+
+#define BH1750_FIXED_NAME  lowres
+#define BH1750_FIXED_ADDR  0x23
+#define BH1750_FIXED_MODE  BH1750_ONE_TIME_LOW_RES_MODE
+#define BH1750_FIXED_MTREG 32
+#include "BH1750_fixed.h"
+
+#define BH1750_FIXED_TIMEBASE_HZ SIM_TIMEBASE_HZ
+#define BH1750_FIXED_NAME  hres2
+#define BH1750_FIXED_ADDR  0x23
+#define BH1750_FIXED_MODE  BH1750_CONTINUOUS_HIGH_RES_MODE_2
+#define BH1750_FIXED_MTREG 138
+#include "BH1750_fixed.h"
+
+#define SAMPLES 400
+#define READY_CALLS 10000
+
+struct fixed_driver {
+  const char *name;
+  Mode mode;
+  unsigned char MTreg;
+  int (*begin)(struct metal_i2c *i2c);
+  int (*measurementReady)(int maxWait);
+  float (*readLightLevel)(void);
+  int (*readMilliLux)(uint32_t *millilux);
+};
+
+static const struct fixed_driver drivers[] = {
+  {"continuous high res, MTreg 69", BH1750_CONTINUOUS_HIGH_RES_MODE, 69,
+   hres_begin, hres_measurementReady, hres_readLightLevel, hres_readMilliLux},
+  {"continuous high res 2, MTreg 138", BH1750_CONTINUOUS_HIGH_RES_MODE_2, 138,
+   hres2_begin, hres2_measurementReady, hres2_readLightLevel, hres2_readMilliLux},
+  {"one-time low res, MTreg 32", BH1750_ONE_TIME_LOW_RES_MODE, 32,
+   lowres_begin, lowres_measurementReady, lowres_readLightLevel, lowres_readMilliLux},
+};
+
+static struct bh1750_model model;
+
+// Lux of the data register the model returns at this light level
+static double expected(const struct fixed_driver *d, double lux) {
+  uint16_t count = bh1750_model_count(d->mode, d->MTreg, lux);
+  int half = d->mode == BH1750_CONTINUOUS_HIGH_RES_MODE_2 || d->mode == BH1750_ONE_TIME_HIGH_RES_MODE_2;
+  return count * (double)BH1750_DEFAULT_MTREG / (1.2 * d->MTreg * (half ? 2 : 1));
+}
+
+// A new conversion at this light level, complete
+static void convert(double lux) {
+  bh1750_model_set_lux(&model, lux);
+  sim_advance_us(200 * 254 / 69 * 1000);
+}
+
+static int wrong_lux(float got, double want) {
+  return fabs(got - want) > 1e-6 * want + 1e-6;
+}
+
+static int run(const struct fixed_driver *d) {
+  uint64_t t0, generic_read = 0, fixed_read = 0, fixed_millilux = 0;
+  int wrong = 0;
+
+  sim_reset();
+  bh1750_model_init(&model, 0x23, 0.0);
+  sim_attach(0, &model.dev);
+  struct metal_i2c *i2c = metal_i2c_get_device(0);
+  metal_i2c_init(i2c, 400000, METAL_I2C_MASTER);
+
+  // Both drivers configure the sensor alike
+  wrong += !BH1750_begin(d->mode, 0x23, i2c) || !BH1750_setMTreg(d->MTreg);
+  wrong += !d->begin(i2c);
+
+  // Each driver reads its own conversion
+  for (int i = 0; i < SAMPLES; i++) {
+    double lux = 0.25 * i * i;
+    float level;
+    uint32_t millilux;
+
+    convert(lux);
+    t0 = bench_now();
+    level = (d->mode & BH1750_ONE_TIME_HIGH_RES_MODE) ? BH1750_readLightLevelRearm() : BH1750_readLightLevel();
+    generic_read += bench_now() - t0;
+    wrong += wrong_lux(level, expected(d, lux));
+
+    convert(lux);
+    t0 = bench_now();
+    level = d->readLightLevel();
+    fixed_read += bench_now() - t0;
+    wrong += wrong_lux(level, expected(d, lux));
+
+    convert(lux);
+    t0 = bench_now();
+    wrong += !d->readMilliLux(&millilux);
+    fixed_millilux += bench_now() - t0;
+    wrong += fabs(millilux - expected(d, lux) * 1000) > 1;
+  }
+
+  // Right after a read, so every call returns false
+  int ready = 0;
+  BH1750_readLightLevel();
+  t0 = bench_now();
+  for (int i = 0; i < READY_CALLS; i++) {
+    ready += BH1750_measurementReady(0);
+  }
+  uint64_t generic_ready = bench_now() - t0;
+  d->readLightLevel();
+  t0 = bench_now();
+  for (int i = 0; i < READY_CALLS; i++) {
+    ready += d->measurementReady(0);
+  }
+  uint64_t fixed_ready = bench_now() - t0;
+  BENCH_KEEP(ready);
+  wrong += ready != 0;
+
+  // Both wait the same time
+  convert(0);
+  wrong += BH1750_measurementReady(1) != d->measurementReady(1);
+
+  printf("--- %s: %d readings, %d wrong\r\n", d->name, 3 * SAMPLES, wrong);
+  printf("  %-24s generic %7.1f  fixed %7.1f %s/call\r\n", "measurementReady()",
+         (double)generic_ready / READY_CALLS, (double)fixed_ready / READY_CALLS, BENCH_UNIT);
+  printf("  %-24s generic %7.1f  fixed %7.1f %s/call, readMilliLux() %7.1f\r\n", "readLightLevel()",
+         (double)generic_read / SAMPLES, (double)fixed_read / SAMPLES, BENCH_UNIT,
+         (double)fixed_millilux / SAMPLES);
+  return wrong;
+}
+
+int main(void) {
+  int wrong = 0;
+  for (unsigned int i = 0; i < sizeof(drivers) / sizeof(drivers[0]); i++) {
+    wrong += run(&drivers[i]);
+  }
+  return wrong != 0;
+}
@@ -0,0 +1,102 @@
+/*
+ * bench_fixedpoint.c
+ *
+ * Fixed-point millilux conversion (BH1750_rawToMilliLux()) against the float
+ * arithmetic of BH1750_readLightLevel():
+ *  - equivalence: every raw count 0..65535 for every MTreg 32..254, in
+ *    H-resolution and H-resolution mode 2, must be within one millilux of
+ *    the exact value raw * 1000 * 69 / (1.2 * MTreg [* 2])
+ *  - cost per conversion of both paths, in bench_now() units. On the FE310
+ *    (no FPU) the float path runs in soft-float library calls.
+ *
+ * Build from the repository root:
+ *   gcc -O2 -Isim -Iexamples/BH1750two_i2c -I. bench/bench_fixedpoint.c \
+ *       examples/BH1750two_i2c/BH1750.c delay.c sim/sim.c -o bench_fixedpoint
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "BH1750.h"
+#include "bench.h"
+
+#define MTREG_MIN 32
+#define MTREG_MAX 254
+
+// Same arithmetic as BH1750_readLightLevel()
+__attribute__((noinline))
+static float float_path(const struct BH1750_sensor *device, uint16_t raw) {
+  float level = (float)raw;
+  if (device->BH1750_MTreg != BH1750_DEFAULT_MTREG) {
+    level *= (float)((unsigned char)BH1750_DEFAULT_MTREG/(float)device->BH1750_MTreg);
+  }
+  if (device->BH1750_MODE == BH1750_ONE_TIME_HIGH_RES_MODE_2 || device->BH1750_MODE == BH1750_CONTINUOUS_HIGH_RES_MODE_2) {
+    level /= 2;
+  }
+  level /= device->BH1750_CONV_FACTOR;
+  return level;
+}
+
+static void setup(struct BH1750_sensor *device, BH1750_Mode mode, unsigned char MTreg) {
+  *device = (struct BH1750_sensor){ .BH1750_CONV_FACTOR = 1.2, .BH1750_MODE = mode, .BH1750_MTreg = MTreg };
+  BH1750_updateLuxScale(device);
+}
+
+int main(void) {
+  const BH1750_Mode modes[2] = { BH1750_CONTINUOUS_HIGH_RES_MODE, BH1750_CONTINUOUS_HIGH_RES_MODE_2 };
+  struct BH1750_sensor device;
+  double fixed_err = 0, float_err = 0;
+  unsigned long long checked = 0, off = 0;
+
+  for (int m = 0; m < 2; m++) {
+    for (unsigned int MTreg = MTREG_MIN; MTreg <= MTREG_MAX; MTreg++) {
+      setup(&device, modes[m], MTreg);
+      // exact millilux = raw * 57500 / den
+      int64_t den = MTreg * (m ? 2 : 1);
+      for (uint32_t raw = 0; raw <= 0xFFFF; raw++) {
+        int64_t exact_num = (int64_t)raw * 57500;
+        int64_t fixed = BH1750_rawToMilliLux(&device, (uint16_t)raw);
+        int64_t diff = llabs(fixed * den - exact_num);
+        if (diff >= den) {
+          off++;
+        }
+        if ((double)diff / den > fixed_err) {
+          fixed_err = (double)diff / den;
+        }
+        double f = float_path(&device, (uint16_t)raw) * 1000.0 - (double)exact_num / den;
+        if (f < 0) {
+          f = -f;
+        }
+        if (f > float_err) {
+          float_err = f;
+        }
+        checked++;
+      }
+    }
+  }
+  printf("equivalence: %llu conversions, %llu off by one millilux or more\r\n", checked, off);
+  printf("  max error fixed %.4f mlx, float %.4f mlx\r\n", fixed_err, float_err);
+
+  // Cost per conversion over the same sweep
+  uint64_t t_fixed = 0, t_float = 0, t0;
+  uint32_t acc = 0;
+  float facc = 0;
+  for (int m = 0; m < 2; m++) {
+    for (unsigned int MTreg = MTREG_MIN; MTreg <= MTREG_MAX; MTreg++) {
+      setup(&device, modes[m], MTreg);
+      t0 = bench_now();
+      for (uint32_t raw = 0; raw <= 0xFFFF; raw++) {
+        acc += BH1750_rawToMilliLux(&device, (uint16_t)raw);
+      }
+      t_fixed += bench_now() - t0;
+      t0 = bench_now();
+      for (uint32_t raw = 0; raw <= 0xFFFF; raw++) {
+        facc += float_path(&device, (uint16_t)raw);
+      }
+      t_float += bench_now() - t0;
+    }
+  }
+  BENCH_KEEP(acc);
+  BENCH_KEEP(facc);
+  printf("cost per conversion: fixed %.2f %s, float %.2f %s\r\n",
+         (double)t_fixed / checked, BENCH_UNIT, (double)t_float / checked, BENCH_UNIT);
+  return off != 0;
+}
@@ -0,0 +1,214 @@
+/*
+ * bench_i2c_arbiter.c
+ *
+ * A 400 kHz bus shared by three clients through the arbiter:
+ *  - imu: a 6-byte register read every 1 ms, the tight deadline
+ *  - bh1750: two sensors read back to back without pause, which keeps
+ *    the bus saturated
+ *  - log: an 8-byte write every 10 ms
+ * run first come first served, with priorities (imu > bh1750 > log), and
+ * with priorities plus a 5 ms waiting bound for the log client. Reports the
+ * queueing latency of each client from its histogram (percentiles are
+ * histogram bin bounds). Then counts the bus transactions saved by
+ * coalescing: two clients reading the same sensor, and one-byte commands
+ * to a device that takes a byte stream.
+ *
+ * Build on the host from the repository root:
+ *   gcc -O2 -Isim -Iexamples/BH1750two_i2c -I. bench/bench_i2c_arbiter.c \
+ *       examples/BH1750two_i2c/BH1750.c examples/BH1750two_i2c/BH1750_async.c \
+ *       examples/BH1750two_i2c/i2c_engine.c examples/BH1750two_i2c/i2c_arbiter.c delay.c \
+ *       sim/sim.c sim/bh1750_model.c sim/ocores_i2c_model.c -o bench_i2c_arbiter
+ */
+#include <stdio.h>
+#include <metal/i2c.h>
+#include "BH1750.h"
+#include "BH1750_async.h"
+#include "i2c_arbiter.h"
+#include "sim.h"
+#include "bh1750_model.h"
+#include "ocores_i2c_model.h"
+
+#define BAUD 400000
+#define RUN_MS 2000
+#define IMU_PERIOD_MS 1
+#define LOG_PERIOD_MS 10
+#define LOG_BOUND_MS 5
+#define ROUNDS 100
+
+// Register-file device: a write sets the register pointer, reads count up
+struct reg_device {
+  struct sim_i2c_device dev;
+  unsigned char reg;
+  uint32_t writes;
+  uint32_t bytes;
+};
+
+static int reg_write(struct sim_i2c_device *dev, const unsigned char *buf, unsigned int len) {
+  struct reg_device *d = (struct reg_device *)dev;
+  d->reg = buf[0];
+  d->writes++;
+  d->bytes += len;
+  return 0;
+}
+
+static int reg_read(struct sim_i2c_device *dev, unsigned char *buf, unsigned int len) {
+  struct reg_device *d = (struct reg_device *)dev;
+  for (unsigned int i = 0; i < len; i++) {
+    buf[i] = (unsigned char)(d->reg + i);
+  }
+  return 0;
+}
+
+static struct bh1750_model model[2];
+static struct reg_device imu = { .dev = { 0x68, reg_write, reg_read, NULL } };
+static struct reg_device eeprom = { .dev = { 0x50, reg_write, reg_read, NULL } };
+static struct reg_device display = { .dev = { 0x3C, reg_write, reg_read, NULL } };
+static struct ocores_i2c_model core;
+static struct BH1750_sensor storage[2];
+static struct BH1750_registry registry;
+static struct i2cEngine engine;
+static struct i2cArbiter arbiter;
+static struct i2cArbiterClient imu_client, bh_client, log_client, ui_client;
+static struct BH1750_read reads[3];
+
+static void setup(void) {
+  const unsigned char addr[2] = { 0x23, 0x5C };
+  sim_reset();
+  struct metal_i2c *i2c = metal_i2c_get_device(0);
+  metal_i2c_init(i2c, BAUD, METAL_I2C_MASTER);
+  ocores_i2c_model_init(&core, I2C_ENGINE_FE310_BASE, I2C_ENGINE_FE310_IRQ, i2c);
+  i2cEngineInit(&engine, I2C_ENGINE_FE310_BASE, I2C_ENGINE_FE310_IRQ, SIM_TIMEBASE_HZ, BAUD);
+  i2cArbiterInit(&arbiter, &engine);
+  // Configuration goes through the arbiter too; run() sets the priority
+  i2cArbiterClientInit(&bh_client, &arbiter, 0, 0, 0);
+  BH1750_attachArbiter(i2c, &bh_client);
+  BH1750_registryInit(&registry, storage, 2);
+  for (int i = 0; i < 2; i++) {
+    bh1750_model_init(&model[i], addr[i], 200.0 + 300.0 * i);
+    sim_attach(0, &model[i].dev);
+    BH1750_beginAt(&registry, BH1750_CONTINUOUS_HIGH_RES_MODE, addr[i], i2c, NULL, 0, 0);
+  }
+  imu.writes = eeprom.writes = display.writes = 0;
+  imu.bytes = eeprom.bytes = display.bytes = 0;
+  sim_attach(0, &imu.dev);
+  sim_attach(0, &eeprom.dev);
+  sim_attach(0, &display.dev);
+}
+
+static int running;
+
+// Read the sensor again as soon as the last read is in
+static void read_again(struct BH1750_read *read, void *arg) {
+  if (running) {
+    BH1750_submitRead(&bh_client, read, read->device, read_again, arg);
+  }
+}
+
+static void report(const char *name, const struct i2cArbiterClient *client) {
+  double us = 1e6 / SIM_TIMEBASE_HZ;
+  printf("  %-7s %6u requests  p50 <%7.1f us  p99 <%7.1f us  max %7.1f us  %u overdue\r\n",
+         name, (unsigned)client->submitted, i2cArbiterPercentile(client, 50) * us,
+         i2cArbiterPercentile(client, 99) * us, client->maxLatency * us, (unsigned)client->overdue);
+}
+
+static void run(const char *name, int priorities, uint32_t logBoundMs) {
+  static const unsigned char reg = 0x3B;
+  static unsigned char imu_buf[6];
+  static unsigned char log_buf[8] = { 0x00, 0x10, 1, 2, 3, 4, 5, 6 };
+  struct i2cTransaction imu_tr = { .addr = 0x68, .tx = &reg, .txLen = 1, .rx = imu_buf, .rxLen = 6 };
+  struct i2cTransaction log_tr = { .addr = 0x50, .tx = log_buf, .txLen = sizeof(log_buf) };
+  struct i2cRequest imu_req = { .transactions = &imu_tr, .count = 1 };
+  struct i2cRequest log_req = { .transactions = &log_tr, .count = 1 };
+  uint32_t imu_skipped = 0, log_skipped = 0;
+
+  setup();
+  i2cArbiterClientInit(&imu_client, &arbiter, priorities ? 3 : 0, 0, 0);
+  i2cArbiterClientInit(&bh_client, &arbiter, priorities ? 1 : 0, 0, 0);
+  i2cArbiterClientInit(&log_client, &arbiter, 0, logBoundMs, 0);
+
+  running = 1;
+  for (int i = 0; i < 2; i++) {
+    BH1750_submitRead(&bh_client, &reads[i], &storage[i], read_again, NULL);
+  }
+  deadline_t start = ticks32();
+  for (uint32_t ms = 0; ms < RUN_MS; ms += IMU_PERIOD_MS) {
+    delayUntil(start + msToTicks(ms));
+    if (!i2cArbiterSubmit(&imu_client, &imu_req)) {
+      imu_skipped++;
+    }
+    if (ms % LOG_PERIOD_MS == 0 && !i2cArbiterSubmit(&log_client, &log_req)) {
+      log_skipped++;
+    }
+  }
+  running = 0;
+  for (int i = 0; i < 2; i++) {
+    BH1750_waitRead(&bh_client, &reads[i]);
+  }
+  i2cArbiterWait(&imu_client, &imu_req);
+  i2cArbiterWait(&log_client, &log_req);
+
+  printf("%s\r\n", name);
+  report("imu", &imu_client);
+  report("bh1750", &bh_client);
+  report("log", &log_client);
+  printf("  periods skipped, previous request still queued: imu %u, log %u\r\n",
+         (unsigned)imu_skipped, (unsigned)log_skipped);
+}
+
+static void coalescing(void) {
+  static const unsigned char commands[4] = { 0xAE, 0xA8, 0x3F, 0xAF };
+  static const unsigned char reg = 0x3B;
+  static unsigned char imu_buf[6];
+  struct i2cTransaction imu_tr = { .addr = 0x68, .tx = &reg, .txLen = 1, .rx = imu_buf, .rxLen = 6 };
+  struct i2cRequest imu_req = { .transactions = &imu_tr, .count = 1 };
+  struct i2cTransaction cmd_tr[4];
+  struct i2cRequest cmd_req[4];
+  int wrong = 0;
+
+  setup();
+  i2cArbiterClientInit(&imu_client, &arbiter, 3, 0, 0);
+  i2cArbiterClientInit(&bh_client, &arbiter, 1, 0, 0);
+  i2cArbiterClientInit(&ui_client, &arbiter, 0, 0, 0);
+  i2cArbiterClientInit(&log_client, &arbiter, 0, 0, I2C_ARBITER_MERGE_WRITES);
+
+  uint32_t transactions = arbiter.transactions;
+  for (int round = 0; round < ROUNDS; round++) {
+    // While the imu has the bus, the sampler asks for both sensors and a
+    // display for the second one, which comes next in priority order
+    i2cArbiterSubmit(&imu_client, &imu_req);
+    BH1750_submitRead(&bh_client, &reads[0], &storage[0], NULL, NULL);
+    BH1750_submitRead(&bh_client, &reads[1], &storage[1], NULL, NULL);
+    BH1750_submitRead(&ui_client, &reads[2], &storage[1], NULL, NULL);
+    BH1750_waitRead(&bh_client, &reads[0]);
+    BH1750_waitRead(&bh_client, &reads[1]);
+    BH1750_waitRead(&ui_client, &reads[2]);
+    i2cArbiterWait(&imu_client, &imu_req);
+    wrong += reads[2].sample.status != BH1750_SAMPLE_OK || reads[2].sample.raw != reads[1].sample.raw;
+  }
+  uint32_t read_tx = arbiter.transactions - transactions - ROUNDS;
+
+  transactions = arbiter.transactions;
+  for (int round = 0; round < ROUNDS; round++) {
+    for (int i = 0; i < 4; i++) {
+      cmd_tr[i] = (struct i2cTransaction){ .addr = 0x3C, .tx = &commands[i], .txLen = 1 };
+      cmd_req[i] = (struct i2cRequest){ .transactions = &cmd_tr[i], .count = 1 };
+      i2cArbiterSubmit(&log_client, &cmd_req[i]);
+    }
+    i2cArbiterWait(&log_client, &cmd_req[3]);
+  }
+  uint32_t cmd_tx = arbiter.transactions - transactions;
+
+  printf("coalescing\r\n");
+  printf("  shared sensor reads  %4u requests  %4u bus transactions  %u coalesced, %d wrong copies\r\n",
+         3 * ROUNDS, (unsigned)read_tx, (unsigned)ui_client.coalesced + (unsigned)bh_client.coalesced, wrong);
+  printf("  one-byte commands    %4u requests  %4u bus transactions  %u bytes received\r\n",
+         4 * ROUNDS, (unsigned)cmd_tx, (unsigned)display.bytes);
+}
+
+int main(void) {
+  run("first come first served", 0, 0);
+  run("priorities", 1, 0);
+  run("priorities, log bounded to 5 ms", 1, LOG_BOUND_MS);
+  coalescing();
+  return 0;
+}
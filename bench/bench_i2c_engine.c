@@ -0,0 +1,184 @@
+/*
+ * bench_i2c_engine.c
+ *
+ * The interrupt-driven I2C engine against the polling Metal driver, on the
+ * register-level model of the FE310's OpenCores I2C core:
+ *  - correctness: four sensors behind a TCA9548A read through both paths
+ *    (BH1750_submitRead() goes through the bus arbiter),
+ *    one at a time and with all reads queued at once, plus a read of an
+ *    absent address that must NACK without disturbing the reads around it
+ *  - CPU time per 2-byte read: the Metal driver keeps the CPU busy for the
+ *    whole transfer; with the engine the CPU sleeps in wfi between the
+ *    per-byte interrupts
+ *  - back-to-back throughput of queued reads against the bus limit, and
+ *    interrupts per read
+ *
+ * Build on the host from the repository root:
+ *   gcc -O2 -Isim -Iexamples/BH1750two_i2c -I. bench/bench_i2c_engine.c \
+ *       examples/BH1750two_i2c/BH1750.c examples/BH1750two_i2c/BH1750_async.c \
+ *       examples/BH1750two_i2c/i2c_engine.c examples/BH1750two_i2c/i2c_arbiter.c delay.c \
+ *       sim/sim.c sim/bh1750_model.c sim/tca9548a_model.c sim/ocores_i2c_model.c -o bench_i2c_engine
+ */
+#include <stdio.h>
+#include <metal/i2c.h>
+#include "BH1750.h"
+#include "BH1750_async.h"
+#include "i2c_engine.h"
+#include "i2c_arbiter.h"
+#include "sim.h"
+#include "bh1750_model.h"
+#include "tca9548a_model.h"
+#include "ocores_i2c_model.h"
+
+#define SENSORS 4
+#define ROUNDS 20
+#define READS 200
+#define QUEUED 32
+
+static struct bh1750_model model[SENSORS];
+static struct tca9548a_model mux_model;
+static struct ocores_i2c_model core;
+static struct BH1750_sensor storage[SENSORS];
+static struct BH1750_registry registry;
+static struct BH1750_mux mux;
+static struct i2cEngine engine;
+static struct i2cArbiter arbiter;
+static struct i2cArbiterClient client;
+static struct BH1750_read reads[QUEUED];
+
+static struct metal_i2c *setup(unsigned int baud, int behind_mux) {
+  const unsigned char addr[2] = { 0x23, 0x5C };
+  sim_reset();
+  struct metal_i2c *i2c = metal_i2c_get_device(0);
+  metal_i2c_init(i2c, baud, METAL_I2C_MASTER);
+  ocores_i2c_model_init(&core, I2C_ENGINE_FE310_BASE, I2C_ENGINE_FE310_IRQ, i2c);
+  i2cEngineInit(&engine, I2C_ENGINE_FE310_BASE, I2C_ENGINE_FE310_IRQ, SIM_TIMEBASE_HZ, baud);
+  i2cArbiterInit(&arbiter, &engine);
+  i2cArbiterClientInit(&client, &arbiter, 0, 0, 0);
+  BH1750_registryInit(&registry, storage, SENSORS);
+  if (behind_mux) {
+    tca9548a_model_init(&mux_model, 0x70);
+    sim_attach(0, &mux_model.dev);
+    BH1750_muxInit(&mux, i2c, 0x70);
+  }
+  for (unsigned int i = 0; i < (behind_mux ? SENSORS : 1); i++) {
+    bh1750_model_init(&model[i], addr[i % 2], 100.0 + 150.0 * i);
+    if (behind_mux) {
+      tca9548a_model_attach(&mux_model, i / 2, &model[i].dev);
+    } else {
+      sim_attach(0, &model[i].dev);
+    }
+    BH1750_beginAt(&registry, BH1750_CONTINUOUS_HIGH_RES_MODE, addr[i % 2], i2c,
+                   behind_mux ? &mux : NULL, i / 2, 0);
+  }
+  return i2c;
+}
+
+static int check(const struct BH1750_sample *blocking, const struct BH1750_read *read) {
+  return read->sample.status != BH1750_SAMPLE_OK || blocking->status != BH1750_SAMPLE_OK ||
+         read->sample.raw != blocking->raw;
+}
+
+static int correctness(void) {
+  struct BH1750_sample blocking[SENSORS];
+  int wrong = 0, nack_ok;
+
+  setup(100000, 1);
+  for (int round = 0; round < ROUNDS; round++) {
+    for (unsigned int i = 0; i < SENSORS; i++) {
+      bh1750_model_set_lux(&model[i], 50.0 + 700.0 * i + 31.0 * round);
+    }
+    sim_advance_us(BH1750_conversionTime(&storage[0], 1) * 1000);
+    // One at a time, each read checked against the Metal driver
+    for (unsigned int i = 0; i < SENSORS; i++) {
+      BH1750_readRaw(&storage[i], &blocking[i]);
+      BH1750_submitRead(&client, &reads[i], &storage[i], NULL, NULL);
+      wrong += BH1750_waitRead(&client, &reads[i]) != BH1750_SAMPLE_OK || check(&blocking[i], &reads[i]);
+    }
+    // All queued at once, mux selects interleaved by the driver
+    for (unsigned int i = 0; i < SENSORS; i++) {
+      BH1750_submitRead(&client, &reads[i], &storage[SENSORS - 1 - i], NULL, NULL);
+    }
+    for (unsigned int i = 0; i < SENSORS; i++) {
+      BH1750_waitRead(&client, &reads[i]);
+      wrong += check(&blocking[SENSORS - 1 - i], &reads[i]);
+    }
+  }
+
+  // A read of an absent address between two good ones
+  unsigned char buf[2];
+  struct i2cTransaction absent = { .addr = 0x44, .rx = buf, .rxLen = 2 };
+  struct i2cRequest request = { .transactions = &absent, .count = 1 };
+  BH1750_submitRead(&client, &reads[0], &storage[0], NULL, NULL);
+  i2cArbiterSubmit(&client, &request);
+  BH1750_submitRead(&client, &reads[1], &storage[1], NULL, NULL);
+  i2cArbiterWait(&client, &request);
+  BH1750_waitRead(&client, &reads[1]);
+  nack_ok = request.status == I2C_NACK && reads[0].sample.status == BH1750_SAMPLE_OK &&
+            reads[1].sample.status == BH1750_SAMPLE_OK && reads[1].sample.raw == blocking[1].raw;
+
+  printf("correctness: %d of %d engine reads differ from the Metal driver, absent address %s\r\n",
+         wrong, ROUNDS * SENSORS * 2, nack_ok ? "NACKed, queue intact" : "NOT handled");
+  printf("  %u commands, %u ignored while busy, %u failed transactions\r\n",
+         (unsigned)core.commands, (unsigned)core.ignored, (unsigned)engine.failed);
+  return wrong != 0 || !nack_ok || core.ignored != 0;
+}
+
+static void cpu_cost(unsigned int baud) {
+  struct BH1750_sample sample;
+  struct sim_cpu_stats before, after;
+  uint64_t blocking = 0, wall = 0;
+
+  setup(baud, 0);
+  for (int i = 0; i < READS; i++) {
+    uint64_t t0 = sim_cycles();
+    BH1750_readRaw(&storage[0], &sample);
+    blocking += sim_cycles() - t0;
+  }
+  uint32_t interrupts = engine.interrupts;
+  sim_cpu_stats(&before);
+  for (int i = 0; i < READS; i++) {
+    uint64_t t0 = sim_cycles();
+    BH1750_submitRead(&client, &reads[0], &storage[0], NULL, NULL);
+    BH1750_waitRead(&client, &reads[0]);
+    wall += sim_cycles() - t0;
+  }
+  sim_cpu_stats(&after);
+  uint64_t busy = wall - (after.sleep_cycles - before.sleep_cycles);
+  printf("%3u kHz  Metal driver: CPU busy %6.1f us/read  engine: %6.1f us/read of %6.1f us, %.1f interrupts/read\r\n",
+         baud / 1000, blocking * 1e6 / SIM_TIMEBASE_HZ / READS, busy * 1e6 / SIM_TIMEBASE_HZ / READS,
+         wall * 1e6 / SIM_TIMEBASE_HZ / READS, (double)(engine.interrupts - interrupts) / READS);
+}
+
+// Straight to the engine: the arbiter would coalesce identical reads
+static void throughput(unsigned int baud) {
+  static struct i2cTransaction transactions[QUEUED];
+  static unsigned char buf[QUEUED][2];
+  struct sim_cpu_stats before, after;
+
+  setup(baud, 0);
+  sim_cpu_stats(&before);
+  uint64_t t0 = sim_cycles();
+  for (int i = 0; i < QUEUED; i++) {
+    transactions[i] = (struct i2cTransaction){ .addr = 0x23, .rx = buf[i], .rxLen = 2 };
+    i2cEngineSubmit(&engine, &transactions[i]);
+  }
+  i2cEngineWait(&engine, &transactions[QUEUED - 1]);
+  uint64_t elapsed = sim_cycles() - t0;
+  sim_cpu_stats(&after);
+  // START, address, 2 data bytes, STOP
+  double limit = baud / (1.0 + 9 * 3 + 1);
+  printf("%3u kHz  %d queued reads: %7.1f reads/s, bus limit %7.1f (%.1f%%), CPU asleep %.1f%%\r\n",
+         baud / 1000, QUEUED, QUEUED * (double)SIM_TIMEBASE_HZ / elapsed, limit,
+         100.0 * QUEUED * SIM_TIMEBASE_HZ / elapsed / limit,
+         100.0 * (after.sleep_cycles - before.sleep_cycles) / elapsed);
+}
+
+int main(void) {
+  int failed = correctness();
+  cpu_cost(100000);
+  cpu_cost(400000);
+  throughput(100000);
+  throughput(400000);
+  return failed;
+}
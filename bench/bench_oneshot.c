@@ -0,0 +1,154 @@
+/*
+ * bench_oneshot.c
+ *
+ * One-time high resolution sampling with W ms of host work per sample,
+ * two ways:
+ *  - configure loop (examples/BH1750onetime): spin until the conversion is
+ *    done, read, do the host work, then BH1750_configure() the one-time
+ *    mode again, which blocks 10 ms
+ *  - pipeline (BH1750_oneshot.c): sleep until the conversion is done, read
+ *    and re-arm in one bus session, do the host work while the next
+ *    conversion runs
+ * Reports the effective sample period, the conversion duty cycle (from
+ * the pipeline metric and from the time the model was powered), bus bits
+ * per sample, the share of time the CPU sleeps, and checks that every
+ * sample comes from its own conversion.
+ *
+ * Build on the host from the repository root:
+ *   gcc -O2 -Isim -Iexamples/BH1750two_i2c -I. bench/bench_oneshot.c \
+ *       examples/BH1750two_i2c/BH1750.c examples/BH1750two_i2c/BH1750_oneshot.c delay.c \
+ *       sim/sim.c sim/bh1750_model.c -o bench_oneshot
+ */
+#include <stdio.h>
+#include <metal/i2c.h>
+#include "BH1750.h"
+#include "BH1750_oneshot.h"
+#include "sim.h"
+#include "bh1750_model.h"
+
+#define SAMPLES 50
+
+static struct bh1750_model model;
+static struct BH1750_sensor storage[1];
+static struct BH1750_registry registry;
+
+struct result {
+  double period_ms;
+  double duty;     // typical conversion time per period
+  double powered;  // share of the time the model was powered
+  double bits;     // bus bits per sample
+  double asleep;   // share of the time the CPU slept
+  int stale;       // samples that did not come from a new conversion
+};
+
+static struct BH1750_sensor *setup(void) {
+  sim_reset();
+  struct metal_i2c *i2c = metal_i2c_get_device(0);
+  metal_i2c_init(i2c, 100000, METAL_I2C_MASTER);
+  bh1750_model_init(&model, 0x23, 500.0);
+  sim_attach(0, &model.dev);
+  BH1750_registryInit(&registry, storage, 1);
+  return BH1750_beginAt(&registry, BH1750_ONE_TIME_HIGH_RES_MODE, 0x23, i2c, NULL, 0, 0);
+}
+
+// Measurement window: from the first sample to the last
+struct window {
+  uint64_t cycles;
+  uint64_t active;
+  uint64_t sleep;
+  uint32_t conversions;
+};
+
+static void window_start(struct window *w) {
+  struct sim_cpu_stats cpu;
+  sim_cpu_stats(&cpu);
+  w->cycles = sim_cycles();
+  w->active = bh1750_model_active_cycles(&model);
+  w->sleep = cpu.sleep_cycles;
+  w->conversions = model.conversions;
+  sim_bus_stats_reset(metal_i2c_get_device(0));
+}
+
+static void window_end(const struct window *w, struct result *r, unsigned int periods, uint32_t convMs) {
+  struct sim_cpu_stats cpu;
+  struct sim_bus_stats bus;
+  sim_cpu_stats(&cpu);
+  sim_bus_stats(metal_i2c_get_device(0), &bus);
+  uint64_t elapsed = sim_cycles() - w->cycles;
+  r->period_ms = elapsed * 1e3 / SIM_TIMEBASE_HZ / periods;
+  r->duty = convMs / r->period_ms;
+  r->powered = (double)(bh1750_model_active_cycles(&model) - w->active) / elapsed;
+  r->bits = (double)bus.bits / periods;
+  r->asleep = (double)(cpu.sleep_cycles - w->sleep) / elapsed;
+  r->stale = (int)periods - (int)(model.conversions - w->conversions);
+}
+
+static void configure_loop(uint32_t workMs, struct result *r) {
+  struct BH1750_sensor *device = setup();
+  struct BH1750_sample sample;
+  struct window w;
+  for (int i = 0; i <= SAMPLES; i++) {
+    while (!BH1750_measurementReady(device, 1)) {
+      ;
+    }
+    BH1750_readRaw(device, &sample);
+    if (i == 0) {
+      window_start(&w);
+    }
+    sim_advance_us(workMs * 1000);
+    BH1750_configure(device, BH1750_ONE_TIME_HIGH_RES_MODE);
+  }
+  // The last read is the end of the window
+  while (!BH1750_measurementReady(device, 1)) {
+    ;
+  }
+  window_end(&w, r, SAMPLES + 1, BH1750_conversionTime(device, 0));
+  r->stale = 0;
+}
+
+static void pipeline(uint32_t workMs, struct result *r, uint32_t *metricUs, uint32_t *metricDuty) {
+  struct BH1750_sensor *device = setup();
+  struct BH1750_oneShot shot;
+  struct BH1750_sample sample;
+  struct window w;
+  BH1750_oneShotBegin(&shot, device);
+  for (int i = 0; i <= SAMPLES; i++) {
+    delayUntil(BH1750_oneShotDue(&shot));
+    BH1750_oneShotRead(&shot, &sample);
+    if (i == 0) {
+      window_start(&w);
+    }
+    sim_advance_us(workMs * 1000);
+  }
+  delayUntil(BH1750_oneShotDue(&shot));
+  window_end(&w, r, SAMPLES + 1, BH1750_conversionTime(device, 0));
+  BH1750_oneShotRead(&shot, &sample);
+  *metricUs = BH1750_oneShotPeriodUs(&shot);
+  *metricDuty = BH1750_oneShotDutyPermille(&shot);
+}
+
+static void print(const char *name, const struct result *r) {
+  printf("  %-15s period %7.2f ms  duty %5.1f%%  powered %5.1f%%  %4.1f bus bits/sample  CPU asleep %5.1f%%",
+         name, r->period_ms, 100 * r->duty, 100 * r->powered, r->bits, 100 * r->asleep);
+}
+
+int main(void) {
+  const uint32_t work[] = { 20, 100, 250 };
+  int stale = 0;
+
+  for (unsigned int i = 0; i < sizeof(work) / sizeof(work[0]); i++) {
+    struct result loop, pipe;
+    uint32_t metricUs, metricDuty;
+    configure_loop(work[i], &loop);
+    pipeline(work[i], &pipe, &metricUs, &metricDuty);
+    printf("host work %u ms per sample\r\n", (unsigned)work[i]);
+    print("configure loop", &loop);
+    printf("\r\n");
+    print("pipeline", &pipe);
+    printf("  %d stale\r\n", pipe.stale);
+    printf("  pipeline metrics: period %.2f ms, duty %.1f%%; %.2fx the configure loop rate\r\n",
+           metricUs / 1000.0, metricDuty / 10.0, loop.period_ms / pipe.period_ms);
+    stale += pipe.stale;
+  }
+  return stale != 0;
+}
@@ -0,0 +1,125 @@
+/*
+ * bench_power.c
+ *
+ * Energy proxy of one H-resolution sample per second, in four modes:
+ *  - continuous, spinning: the sensor converts all the time, the CPU polls
+ *    the clock between samples
+ *  - continuous, wfi: same sensor, the CPU sleeps between samples
+ *  - power down between samples: BH1750_configure() wakes the sensor,
+ *    BH1750_sleepUntilReady() waits for a conversion, BH1750_powerDown()
+ *    after the read
+ *  - duty-cycled: BH1750_readDutyCycled(), one one-time conversion per
+ *    sample
+ * Reports sensor-active and CPU-awake milliseconds per sample, from the
+ * time the model was powered and the time the simulated CPU spent outside
+ * wfi, and checks every reading against a light level that changes
+ * between samples. Then checks that BH1750_reset() clears the data
+ * register.
+ *
+ * Build on the host from the repository root:
+ *   gcc -O2 -Isim -Iexamples/BH1750two_i2c -I. bench/bench_power.c \
+ *       examples/BH1750two_i2c/BH1750.c delay.c sim/sim.c sim/bh1750_model.c -o bench_power
+ */
+#include <stdio.h>
+#include <metal/i2c.h>
+#include "BH1750.h"
+#include "sim.h"
+#include "bh1750_model.h"
+
+#define SAMPLES 20
+#define PERIOD_MS 1000
+
+enum mode { CONTINUOUS_SPIN, CONTINUOUS_WFI, POWER_DOWN, DUTY_CYCLED };
+
+static const char *names[] = { "continuous, spinning", "continuous, wfi", "power down between samples",
+                               "duty-cycled" };
+
+static struct bh1750_model model;
+static struct BH1750_sensor storage[1];
+static struct BH1750_registry registry;
+
+static struct BH1750_sensor *setup(void) {
+  sim_reset();
+  struct metal_i2c *i2c = metal_i2c_get_device(0);
+  metal_i2c_init(i2c, 100000, METAL_I2C_MASTER);
+  bh1750_model_init(&model, 0x23, 100.0);
+  sim_attach(0, &model.dev);
+  BH1750_registryInit(&registry, storage, 1);
+  return BH1750_beginAt(&registry, BH1750_CONTINUOUS_HIGH_RES_MODE, 0x23, i2c, NULL, 0, 0);
+}
+
+static int run(enum mode mode) {
+  struct BH1750_sensor *device = setup();
+  struct BH1750_sample sample;
+  struct sim_cpu_stats before, after;
+  int wrong = 0;
+
+  if (mode == POWER_DOWN || mode == DUTY_CYCLED) {
+    BH1750_powerDown(device);
+  }
+  // Let the calibration of the delay service happen before the window
+  delay(PERIOD_MS);
+  uint64_t active = bh1750_model_active_cycles(&model);
+  uint64_t t0 = sim_cycles();
+  sim_cpu_stats(&before);
+  deadline_t next = ticks32();
+
+  for (int i = 0; i < SAMPLES; i++) {
+    double lux = 100.0 + 37.0 * i;
+    bh1750_model_set_lux(&model, lux);
+    next += msToTicks(PERIOD_MS);
+    switch (mode) {
+      case CONTINUOUS_SPIN:
+        while (!deadlineReached(next)) {
+        }
+        BH1750_readRaw(device, &sample);
+        break;
+      case CONTINUOUS_WFI:
+        delayUntil(next);
+        BH1750_readRaw(device, &sample);
+        break;
+      case POWER_DOWN:
+        delayUntil(next);
+        BH1750_configure(device, BH1750_CONTINUOUS_HIGH_RES_MODE);
+        BH1750_sleepUntilReady(device, 1);
+        BH1750_readRaw(device, &sample);
+        BH1750_powerDown(device);
+        break;
+      case DUTY_CYCLED:
+        delayUntil(next);
+        BH1750_readDutyCycled(device, &sample);
+        break;
+    }
+    float read = BH1750_convertSample(&sample, device->BH1750_CONV_FACTOR);
+    wrong += sample.status != BH1750_SAMPLE_OK || read < lux - 1 || read > lux + 1;
+  }
+
+  sim_cpu_stats(&after);
+  uint64_t elapsed = sim_cycles() - t0;
+  double ms = 1e3 / SIM_TIMEBASE_HZ / SAMPLES;
+  printf("%-27s sensor active %7.2f ms/sample  CPU awake %7.2f ms/sample  %d wrong\r\n", names[mode],
+         (bh1750_model_active_cycles(&model) - active) * ms,
+         (elapsed - (after.sleep_cycles - before.sleep_cycles)) * ms, wrong);
+  return wrong;
+}
+
+int main(void) {
+  struct BH1750_sample sample;
+  int wrong = 0;
+
+  printf("one H-resolution sample every %d ms\r\n", PERIOD_MS);
+  for (int mode = CONTINUOUS_SPIN; mode <= DUTY_CYCLED; mode++) {
+    wrong += run((enum mode)mode);
+  }
+
+  // Reset clears the data register of a powered sensor
+  struct BH1750_sensor *device = setup();
+  sim_advance_us(200000);
+  BH1750_readRaw(device, &sample);
+  uint16_t before = sample.raw;
+  int reset = BH1750_powerOn(device) && BH1750_reset(device);
+  BH1750_readRaw(device, &sample);
+  int reset_ok = reset && before != 0 && sample.raw == 0;
+  printf("reset: data register %u -> %u, %s\r\n", before, sample.raw, reset_ok ? "cleared" : "NOT cleared");
+  return wrong != 0 || !reset_ok;
+}
@@ -0,0 +1,122 @@
+/*
+ * bench_profile.c
+ *
+ * Cycle histograms of the driver operations (BH1750_PROFILE). Two sensors
+ * at 0x23 behind channels 0 and 1 of a mux are read in turn, so every read
+ * selects the mux channel first, then reconfigured and given new MTreg
+ * values. Prints the histograms of each sensor with BH1750_profileDump(),
+ * checks that every call was recorded once and that the I2C reads and the
+ * configure calls fall in the buckets of their bus and settle times.
+ * Prints the cycles spent in the driver, so a build without
+ * BH1750_PROFILE shows the cost of the instrumentation.
+ *
+ * Build on the host from the repository root, with and without profiling:
+ *   gcc -O2 -DBH1750_PROFILE -Isim -Iexamples/BH1750two_i2c -I. bench/bench_profile.c \
+ *       examples/BH1750two_i2c/BH1750.c delay.c sim/sim.c sim/bh1750_model.c \
+ *       sim/tca9548a_model.c -o bench_profile
+ */
+#include <stdio.h>
+#include <metal/i2c.h>
+#include "BH1750.h"
+#include "sim.h"
+#include "bh1750_model.h"
+#include "tca9548a_model.h"
+
+#define READS 100
+#define CHANGES 10
+
+static struct bh1750_model model[2];
+static struct tca9548a_model mux_model;
+static struct BH1750_mux mux;
+static struct BH1750_sensor storage[2];
+static struct BH1750_registry registry;
+
+#ifdef BH1750_PROFILE
+// Calls recorded in a histogram
+static uint32_t calls(const struct BH1750_histogram *histogram) {
+  uint32_t n = 0;
+  for (unsigned int b = 0; b < BH1750_PROFILE_BUCKETS; b++) {
+    n += histogram->buckets[b];
+  }
+  return n;
+}
+
+// Bucket of a duration
+static unsigned int bucket(uint64_t cycles) {
+  unsigned int b = 0;
+  while (cycles >>= 1) {
+    b++;
+  }
+  return b;
+}
+
+static int check(const char *what, uint32_t got, uint32_t expected) {
+  if (got != expected) {
+    printf("  %s: %u, expected %u\r\n", what, (unsigned)got, (unsigned)expected);
+  }
+  return got != expected;
+}
+#endif
+
+int main(void) {
+  struct BH1750_sensor *devices[2];
+  int wrong = 0;
+
+  sim_reset();
+  struct metal_i2c *i2c = metal_i2c_get_device(0);
+  metal_i2c_init(i2c, 100000, METAL_I2C_MASTER);
+  tca9548a_model_init(&mux_model, 0x70);
+  sim_attach(0, &mux_model.dev);
+  BH1750_muxInit(&mux, i2c, 0x70);
+  BH1750_registryInit(&registry, storage, 2);
+  for (unsigned int i = 0; i < 2; i++) {
+    bh1750_model_init(&model[i], 0x23, 100.0 + 400.0 * i);
+    tca9548a_model_attach(&mux_model, i, &model[i].dev);
+    devices[i] = BH1750_beginAt(&registry, BH1750_CONTINUOUS_HIGH_RES_MODE, 0x23, i2c, &mux, i, 0);
+  }
+#ifdef BH1750_PROFILE
+  BH1750_profileClear(devices[0]);
+  BH1750_profileClear(devices[1]);
+#endif
+
+  // Cycles spent in the driver, the waits between reads left out
+  uint64_t readCycles = 0, changeCycles = 0;
+  for (int i = 0; i < READS; i++) {
+    sim_advance_us(200000);
+    uint64_t t0 = sim_cycles();
+    BH1750_readLightLevel(devices[0]);
+    BH1750_readLightLevel(devices[1]);
+    readCycles += sim_cycles() - t0;
+  }
+  for (int i = 0; i < CHANGES; i++) {
+    uint64_t t0 = sim_cycles();
+    BH1750_configure(devices[i % 2], i % 4 < 2 ? BH1750_CONTINUOUS_LOW_RES_MODE : BH1750_CONTINUOUS_HIGH_RES_MODE);
+    BH1750_setMTreg(devices[i % 2], i % 4 < 2 ? 100 : 69);
+    changeCycles += sim_cycles() - t0;
+  }
+
+#ifdef BH1750_PROFILE
+  char text[512];
+  // Two byte read: START, address, two bytes, STOP
+  uint64_t busCycles = sim_bus_time_ns(1 + 9 * 3 + 1, 100000) * SIM_TIMEBASE_HZ / 1000000000ULL;
+  uint64_t settleCycles = BH1750_SETTLE_MS * SIM_TIMEBASE_HZ / 1000;
+  for (unsigned int i = 0; i < 2; i++) {
+    const struct BH1750_histogram *profile = devices[i]->profile;
+    BH1750_profileDump(devices[i], text, sizeof(text));
+    printf("sensor on mux channel %u:\r\n%s", i, text);
+    wrong += check("readLightLevel calls", calls(&profile[BH1750_PROF_READ_LIGHT_LEVEL]), READS);
+    wrong += check("readRaw calls", calls(&profile[BH1750_PROF_READ_RAW]), READS);
+    wrong += check("i2c_read calls", calls(&profile[BH1750_PROF_I2C_READ]), READS);
+    wrong += check("configure calls", calls(&profile[BH1750_PROF_CONFIGURE]), CHANGES / 2);
+    wrong += check("setMTreg calls", calls(&profile[BH1750_PROF_SET_MTREG]), CHANGES / 2);
+    wrong += check("i2c_read bucket", profile[BH1750_PROF_I2C_READ].buckets[bucket(busCycles)], READS);
+    wrong += check("configure bucket", profile[BH1750_PROF_CONFIGURE].buckets[bucket(settleCycles)], CHANGES / 2);
+  }
+  printf("profiled: ");
+#else
+  printf("not profiled: ");
+#endif
+  printf("%.1f cycles per readLightLevel, %.1f per configure and setMTreg pair\r\n",
+         (double)readCycles / (2 * READS), (double)changeCycles / CHANGES);
+  return wrong != 0;
+}
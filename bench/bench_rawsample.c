@@ -0,0 +1,76 @@
+/*
+ * bench_rawsample.c
+ *
+ * Logging raw samples and converting them later, against converting every
+ * sample as it is read. Reports the CPU cost of each read path, the cost of
+ * batch conversion, bytes logged per sample, and checks that deferred
+ * conversion gives the same lux as BH1750_readLightLevel().
+ *
+ * Build on the host from the repository root:
+ *   gcc -O2 -Isim -Iexamples/BH1750two_i2c -I. bench/bench_rawsample.c \
+ *       examples/BH1750two_i2c/BH1750.c delay.c sim/sim.c sim/bh1750_model.c \
+ *       -o bench_rawsample
+ */
+#include <stdio.h>
+#include <metal/i2c.h>
+#include "BH1750.h"
+#include "sim.h"
+#include "bh1750_model.h"
+#include "bench.h"
+
+#define SAMPLES 1000
+
+static struct BH1750_sample samples[SAMPLES];
+static uint16_t log_raw[SAMPLES];
+static float lux_now[SAMPLES];
+static float lux_later[SAMPLES];
+static uint32_t millilux_later[SAMPLES];
+
+int main(void) {
+  struct bh1750_model model;
+  uint64_t t0, t_float = 0, t_raw = 0;
+
+  sim_reset();
+  bh1750_model_init(&model, 0x23, 0.0);
+  sim_attach(0, &model.dev);
+  struct metal_i2c *i2c = metal_i2c_get_device(0);
+  metal_i2c_init(i2c, 100000, METAL_I2C_MASTER);
+  struct BH1750_sensor *device = BH1750_begin(BH1750_CONTINUOUS_HIGH_RES_MODE_2, 0x23, i2c, 138);
+
+  for (int i = 0; i < SAMPLES; i++) {
+    bh1750_model_set_lux(&model, 10.0 + i * 37.0);
+    sim_advance_us(BH1750_conversionTime(device, 1) * 1000);
+    // Same data register, read through both paths
+    t0 = bench_now();
+    lux_now[i] = BH1750_readLightLevel(device);
+    t_float += bench_now() - t0;
+    t0 = bench_now();
+    BH1750_readRaw(device, &samples[i]);
+    t_raw += bench_now() - t0;
+    log_raw[i] = samples[i].raw;
+  }
+
+  t0 = bench_now();
+  BH1750_convertSamples(samples, lux_later, SAMPLES, device->BH1750_CONV_FACTOR);
+  uint64_t t_batch = bench_now() - t0;
+  t0 = bench_now();
+  BH1750_convertSamplesMilliLux(samples, millilux_later, SAMPLES, device->BH1750_CONV_FACTOR);
+  uint64_t t_batch_fixed = bench_now() - t0;
+
+  int mismatch = 0;
+  for (int i = 0; i < SAMPLES; i++) {
+    float mlx = millilux_later[i] / 1000.0f;
+    if (lux_later[i] != lux_now[i] || mlx < lux_now[i] - 0.01f || mlx > lux_now[i] + 0.01f) {
+      mismatch++;
+    }
+  }
+
+  printf("read + convert (readLightLevel)  %8.1f %s/sample\r\n", (double)t_float / SAMPLES, BENCH_UNIT);
+  printf("read raw (readRaw)               %8.1f %s/sample\r\n", (double)t_raw / SAMPLES, BENCH_UNIT);
+  printf("batch convert, float             %8.1f %s/sample\r\n", (double)t_batch / SAMPLES, BENCH_UNIT);
+  printf("batch convert, millilux          %8.1f %s/sample\r\n", (double)t_batch_fixed / SAMPLES, BENCH_UNIT);
+  printf("log size: %u bytes/sample raw, %u bytes/sample with metadata, %u as float\r\n",
+         (unsigned)sizeof(log_raw[0]), (unsigned)sizeof(samples[0]), (unsigned)sizeof(lux_now[0]));
+  printf("%d of %d deferred conversions differ from readLightLevel()\r\n", mismatch, SAMPLES);
+  return mismatch != 0;
+}
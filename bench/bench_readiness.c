@@ -0,0 +1,104 @@
+/*
+ * bench_readiness.c
+ *
+ * One-time H-resolution samples of four units converting in 85%, 100%,
+ * 120% and 145% of the datasheet typical time, read at the typical time
+ * (maxWait = 0), at the maximum time (maxWait = 1) and at the learned
+ * safe point (BH1750_readiness.c). Reports the latency from the start of
+ * the conversion to the sample, the stale-read counter and the learned
+ * point, and checks every sample against its light level. Then a unit
+ * slows from 100% to 130% while in use and the learned point must follow.
+ *
+ * Build on the host from the repository root:
+ *   gcc -O2 -Isim -Iexamples/BH1750two_i2c -I. bench/bench_readiness.c \
+ *       examples/BH1750two_i2c/BH1750.c examples/BH1750two_i2c/BH1750_readiness.c delay.c \
+ *       sim/sim.c sim/bh1750_model.c -o bench_readiness
+ */
+#include <stdio.h>
+#include <metal/i2c.h>
+#include "BH1750.h"
+#include "BH1750_readiness.h"
+#include "sim.h"
+#include "bh1750_model.h"
+
+#define SAMPLES 200
+
+static const char *policies[] = { "typical", "maximum", "learned" };
+
+static struct bh1750_model model;
+static struct BH1750_sensor storage[1];
+static struct BH1750_registry registry;
+
+static struct BH1750_sensor *setup(unsigned int conv_permille) {
+  sim_reset();
+  struct metal_i2c *i2c = metal_i2c_get_device(0);
+  metal_i2c_init(i2c, 100000, METAL_I2C_MASTER);
+  bh1750_model_init(&model, 0x23, 100.0);
+  model.conv_permille = conv_permille;
+  sim_attach(0, &model.dev);
+  BH1750_registryInit(&registry, storage, 1);
+  return BH1750_beginAt(&registry, BH1750_ONE_TIME_HIGH_RES_MODE, 0x23, i2c, NULL, 0, 0);
+}
+
+// Samples with a changing light level; returns samples that read wrong
+static int sample(struct BH1750_readiness *readiness, int n, unsigned int slow_at, double *latency_ms) {
+  struct BH1750_sample s;
+  uint64_t total = 0;
+  int wrong = 0;
+  for (int i = 0; i < n; i++) {
+    if (slow_at && i == (int)slow_at) {
+      model.conv_permille = 1300;
+    }
+    double lux = 50.0 + 13.0 * (i % 40);
+    bh1750_model_set_lux(&model, lux);
+    uint64_t t0 = sim_cycles();
+    BH1750_readinessSample(readiness, &s);
+    total += sim_cycles() - t0;
+    float read = BH1750_convertSample(&s, 1.2);
+    wrong += s.status != BH1750_SAMPLE_OK || read < lux - 1 || read > lux + 1;
+    sim_advance_us(5000);
+  }
+  *latency_ms = total * 1e3 / SIM_TIMEBASE_HZ / n;
+  return wrong;
+}
+
+int main(void) {
+  const unsigned int units[] = { 850, 1000, 1200, 1450 };
+  struct BH1750_readiness readiness;
+  int wrong = 0;
+  uint32_t stale[3] = { 0 };
+  double latency[3] = { 0 };
+
+  printf("unit | policy  | latency ms | stale reads | reads/sample | learned point\r\n");
+  for (unsigned int u = 0; u < sizeof(units) / sizeof(units[0]); u++) {
+    for (int p = BH1750_READY_TYPICAL; p <= BH1750_READY_LEARNED; p++) {
+      double ms;
+      struct BH1750_sensor *device = setup(units[u]);
+      BH1750_readinessInit(&readiness, device, (BH1750_ReadyPolicy)p);
+      wrong += sample(&readiness, SAMPLES, 0, &ms);
+      printf("%3u%% | %-7s | %10.2f | %4u (%4.1f%%) | %12.2f |", units[u] / 10, policies[p], ms,
+             (unsigned)readiness.stale, 100.0 * readiness.stale / SAMPLES, (double)readiness.reads / SAMPLES);
+      if (p == BH1750_READY_LEARNED) {
+        printf(" %u permille\r\n", readiness.safePermille);
+      } else {
+        printf("\r\n");
+      }
+      stale[p] += readiness.stale;
+      latency[p] += ms / 4;
+    }
+  }
+  printf("all units: mean latency typical %.2f ms, maximum %.2f ms, learned %.2f ms; stale reads %u, %u, %u\r\n",
+         latency[0], latency[1], latency[2], (unsigned)stale[0], (unsigned)stale[1], (unsigned)stale[2]);
+
+  double ms;
+  struct BH1750_sensor *device = setup(1000);
+  BH1750_readinessInit(&readiness, device, BH1750_READY_LEARNED);
+  wrong += sample(&readiness, SAMPLES / 2, 0, &ms);
+  uint32_t before = readiness.safePermille;
+  wrong += sample(&readiness, SAMPLES / 2, 1, &ms);
+  printf("unit slows from 100%% to 130%%: learned point %u -> %u permille, %u stale reads\r\n",
+         (unsigned)before, readiness.safePermille, (unsigned)readiness.stale);
+  printf("%d wrong samples\r\n", wrong);
+  return wrong != 0 || stale[BH1750_READY_LEARNED] > stale[BH1750_READY_MAX] ||
+         latency[BH1750_READY_LEARNED] >= latency[BH1750_READY_MAX] || readiness.safePermille < 1300;
+}
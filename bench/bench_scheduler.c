@@ -0,0 +1,106 @@
+/*
+ * bench_scheduler.c
+ *
+ * Samples per second versus sensor count: the polling loop of the
+ * BH1750two_i2c example (read whatever is ready, then delay(1000)) against
+ * the measurement scheduler. Sensors sit behind a TCA9548A, two per
+ * channel, with a mix of modes and MTreg values so their conversion times
+ * differ (120, 16, 55 and 240 ms).
+ *
+ * Build on the host from the repository root:
+ *   gcc -O2 -Isim -Iexamples/BH1750two_i2c -I. bench/bench_scheduler.c \
+ *       examples/BH1750two_i2c/BH1750.c examples/BH1750two_i2c/BH1750_scheduler.c \
+ *       delay.c sim/sim.c sim/bh1750_model.c sim/tca9548a_model.c -o bench_scheduler
+ */
+#include <stdio.h>
+#include <metal/i2c.h>
+#include "BH1750.h"
+#include "BH1750_scheduler.h"
+#include "sim.h"
+#include "bh1750_model.h"
+#include "tca9548a_model.h"
+
+#define MAX_SENSORS 16
+#define RUN_MS 10000
+
+extern void delay(uint32_t miliseconds);
+
+static const struct {
+  BH1750_Mode mode;
+  unsigned char MTreg;
+} profile[4] = {
+  { BH1750_CONTINUOUS_HIGH_RES_MODE, 69 },
+  { BH1750_CONTINUOUS_LOW_RES_MODE, 69 },
+  { BH1750_CONTINUOUS_HIGH_RES_MODE, 32 },
+  { BH1750_CONTINUOUS_HIGH_RES_MODE_2, 138 },
+};
+
+static struct bh1750_model model[MAX_SENSORS];
+static struct tca9548a_model mux_model;
+static struct BH1750_sensor storage[MAX_SENSORS];
+static struct BH1750_registry registry;
+static struct BH1750_mux mux;
+
+static void setup(unsigned int n) {
+  const unsigned char addr[2] = { 0x23, 0x5C };
+  sim_reset();
+  struct metal_i2c *i2c = metal_i2c_get_device(0);
+  metal_i2c_init(i2c, 100000, METAL_I2C_MASTER);
+  tca9548a_model_init(&mux_model, 0x70);
+  sim_attach(0, &mux_model.dev);
+  BH1750_registryInit(&registry, storage, n);
+  BH1750_muxInit(&mux, i2c, 0x70);
+  for (unsigned int i = 0; i < n; i++) {
+    bh1750_model_init(&model[i], addr[i % 2], 300.0);
+    tca9548a_model_attach(&mux_model, i / 2, &model[i].dev);
+    BH1750_beginAt(&registry, profile[i % 4].mode, addr[i % 2], i2c, &mux, i / 2, profile[i % 4].MTreg);
+  }
+}
+
+static void count_sample(struct BH1750_sensor *device, float lux, void *arg) {
+  (void)device;
+  (void)lux;
+  (*(unsigned int *)arg)++;
+}
+
+static double sample_rate(unsigned int samples, uint64_t start) {
+  return samples * (double)SIM_TIMEBASE_HZ / (sim_cycles() - start);
+}
+
+int main(void) {
+  printf("sensors  loop+delay(1000)  scheduler  (samples/s)  datasheet limit\r\n");
+  for (unsigned int n = 1; n <= MAX_SENSORS; n *= 2) {
+    unsigned int samples = 0;
+    uint64_t start;
+    double limit = 0;
+
+    setup(n);
+    for (unsigned int i = 0; i < n; i++) {
+      limit += 1000.0 / BH1750_conversionTime(&storage[i], 0);
+    }
+    start = sim_cycles();
+    while (sim_cycles() - start < RUN_MS * (SIM_TIMEBASE_HZ / 1000)) {
+      for (unsigned int i = 0; i < n; i++) {
+        if (BH1750_measurementReady(&storage[i], 0)) {
+          BH1750_readLightLevel(&storage[i]);
+          samples++;
+        }
+      }
+      delay(1000);
+    }
+    double loop = sample_rate(samples, start);
+
+    setup(n);
+    struct BH1750_scheduler scheduler;
+    samples = 0;
+    BH1750_schedulerInit(&scheduler, &registry, 0, count_sample, &samples);
+    start = sim_cycles();
+    while (sim_cycles() - start < RUN_MS * (SIM_TIMEBASE_HZ / 1000)) {
+      BH1750_schedulerRun(&scheduler);
+    }
+    double sched = sample_rate(samples, start);
+
+    printf("%7u  %16.1f  %9.1f  %27.1f\r\n", n, loop, sched, limit);
+  }
+  return 0;
+}
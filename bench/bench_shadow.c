@@ -0,0 +1,77 @@
+/*
+ * bench_shadow.c
+ *
+ * The BH1750autoadjust loop on the multi-sensor driver: a read every 5 s,
+ * each followed by setMTreg() with the value the lux thresholds pick. Under
+ * steady light the MTreg never changes. With the register shadow a
+ * continuous-mode sensor then costs no bus traffic and no delay for those
+ * calls; a one-time sensor still gets the mode command that starts its next
+ * measurement. The same loop with the shadow invalidated before every call
+ * shows the old cost, and every reading is checked against the light level.
+ *
+ * Build on the host from the repository root:
+ *   gcc -O2 -Isim -Iexamples/BH1750two_i2c -I. bench/bench_shadow.c \
+ *       examples/BH1750two_i2c/BH1750.c delay.c sim/sim.c sim/bh1750_model.c \
+ *       -o bench_shadow
+ */
+#include <stdio.h>
+#include <metal/i2c.h>
+#include "BH1750.h"
+#include "sim.h"
+#include "bh1750_model.h"
+
+#define CYCLES 12
+
+extern void delay(uint32_t miliseconds);
+
+static void run(const char *name, BH1750_Mode mode, int shadow) {
+  struct bh1750_model model;
+  struct sim_bus_stats bus;
+  uint64_t blocked = 0;
+  uint32_t issued, elided;
+  int stale = 0;
+
+  sim_reset();
+  bh1750_model_init(&model, 0x23, 250.0);
+  sim_attach(0, &model.dev);
+  struct metal_i2c *i2c = metal_i2c_get_device(0);
+  metal_i2c_init(i2c, 100000, METAL_I2C_MASTER);
+  struct BH1750_sensor *device = BH1750_begin(mode, 0x23, i2c, 0);
+  sim_bus_stats_reset(i2c);
+  BH1750_clearStats(device);
+
+  for (int i = 0; i < CYCLES; i++) {
+    while (!BH1750_measurementReady(device, 1)) {
+      sim_advance_us(1000);
+    }
+    float lux = BH1750_readLightLevel(device);
+    if (lux < model.lux - 1 || lux > model.lux + 1) {
+      stale++;
+    }
+    unsigned char MTreg = lux > 40000.0 ? 32 : lux > 10.0 ? 69 : 138;
+    if (!shadow) {
+      device->shadowMTreg = 0;
+    }
+    uint64_t t0 = sim_cycles();
+    BH1750_setMTreg(device, MTreg);
+    blocked += sim_cycles() - t0;
+    // Steady enough to keep MTreg, changing enough to spot stale readings
+    bh1750_model_set_lux(&model, 250.0 + 20 * i);
+    delay(5000);
+  }
+
+  sim_bus_stats(i2c, &bus);
+  BH1750_transactionCounts(device, &issued, &elided);
+  printf("%-22s %-9s %3u issued %3u elided  %4u bus bytes  setMTreg blocked %5.1f ms/cycle  %d stale\r\n",
+         name, shadow ? "shadow" : "no shadow", (unsigned)issued, (unsigned)elided, (unsigned)bus.bytes,
+         blocked * 1000.0 / SIM_TIMEBASE_HZ / CYCLES, stale);
+}
+
+int main(void) {
+  printf("%d autoadjust cycles under steady light\r\n", CYCLES);
+  run("one-time H-res", BH1750_ONE_TIME_HIGH_RES_MODE, 0);
+  run("one-time H-res", BH1750_ONE_TIME_HIGH_RES_MODE, 1);
+  run("continuous H-res", BH1750_CONTINUOUS_HIGH_RES_MODE, 0);
+  run("continuous H-res", BH1750_CONTINUOUS_HIGH_RES_MODE, 1);
+  return 0;
+}
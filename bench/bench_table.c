@@ -0,0 +1,211 @@
+/*
+ * bench_table.c
+ *
+ * 256 sensors in the packed table (BH1750_table.c) against the same
+ * sensors in a registry of struct BH1750_sensor read by the measurement
+ * scheduler. Four buses carry four linked TCA9548A each, with two sensors
+ * per channel, the mode and MTreg mix of bench_scheduler plus one-time low
+ * resolution, and two calibrations. Reports bytes per sensor of both, the
+ * samples per second of each over the same virtual time and the host cost
+ * of a pass that finds no sensor due. Checks that every sensor was read at
+ * its conversion rate and that the last sample of each matches its model.
+ *
+ * Build on the host from the repository root:
+ *   gcc -O2 -Isim -Iexamples/BH1750two_i2c -I. bench/bench_table.c \
+ *       examples/BH1750two_i2c/BH1750.c examples/BH1750two_i2c/BH1750_scheduler.c \
+ *       examples/BH1750two_i2c/BH1750_table.c delay.c sim/sim.c sim/bh1750_model.c \
+ *       sim/tca9548a_model.c -o bench_table
+ */
+#include <stdio.h>
+#include <math.h>
+#include <metal/i2c.h>
+#include "BH1750.h"
+#include "BH1750_scheduler.h"
+#include "BH1750_table.h"
+#include "sim.h"
+#include "bh1750_model.h"
+#include "tca9548a_model.h"
+#include "bench.h"
+
+#define BUSES 4
+#define MUXES_PER_BUS 4
+#define SENSORS (BUSES * MUXES_PER_BUS * 16)
+#define RUN_MS 2000
+#define IDLE_PASSES 100
+
+static const struct {
+  BH1750_Mode mode;
+  unsigned char MTreg;
+} profile[5] = {
+  { BH1750_CONTINUOUS_HIGH_RES_MODE, 69 },
+  { BH1750_CONTINUOUS_LOW_RES_MODE, 69 },
+  { BH1750_CONTINUOUS_HIGH_RES_MODE, 32 },
+  { BH1750_CONTINUOUS_HIGH_RES_MODE_2, 138 },
+  { BH1750_ONE_TIME_LOW_RES_MODE, 100 },
+};
+static const float calibration[2] = { 1.2f, 1.1f };
+
+static struct bh1750_model model[SENSORS];
+static struct tca9548a_model mux_model[BUSES][MUXES_PER_BUS];
+static struct BH1750_mux mux[BUSES][MUXES_PER_BUS];
+static struct BH1750_table table;
+static struct BH1750_sensor storage[SENSORS];
+static struct BH1750_registry registry;
+static uint32_t samples[SENSORS];
+
+// Buses, muxes and sensor models, sensor n at bus, mux, channel and
+// address from its number
+static void setup(void) {
+  sim_reset();
+  for (unsigned int bus = 0; bus < BUSES; bus++) {
+    struct metal_i2c *i2c = metal_i2c_get_device(bus);
+    metal_i2c_init(i2c, 400000, METAL_I2C_MASTER);
+    for (unsigned int m = 0; m < MUXES_PER_BUS; m++) {
+      tca9548a_model_init(&mux_model[bus][m], 0x70 + m);
+      sim_attach(bus, &mux_model[bus][m].dev);
+      BH1750_muxInit(&mux[bus][m], i2c, 0x70 + m);
+      if (m) {
+        BH1750_muxLink(&mux[bus][0], &mux[bus][m]);
+      }
+    }
+  }
+  for (unsigned int n = 0; n < SENSORS; n++) {
+    bh1750_model_init(&model[n], n % 2 ? 0x5C : 0x23, 20.0 + 7.0 * n);
+    tca9548a_model_attach(&mux_model[n / 64][n / 16 % 4], n / 2 % 8, &model[n].dev);
+  }
+}
+
+static void count_table(struct BH1750_table *t, unsigned int index, void *arg) {
+  (void)t;
+  (void)arg;
+  samples[index]++;
+}
+
+static void count_registry(struct BH1750_sensor *device, float lux, void *arg) {
+  (void)lux;
+  (void)arg;
+  samples[device - storage]++;
+}
+
+// Reads a sensor must have had in the run, at its slowest conversion and
+// less a tenth for the bus time and the re-arm of the one-time mode
+static int too_few(unsigned int n, uint32_t got) {
+  unsigned int p = n % 5;
+  unsigned long ms = (profile[p].mode == BH1750_CONTINUOUS_LOW_RES_MODE ||
+                      profile[p].mode == BH1750_ONE_TIME_LOW_RES_MODE ? 24 : 180) * profile[p].MTreg / 69;
+  return got < RUN_MS / ms * 9 / 10;
+}
+
+static uint32_t total(void) {
+  uint32_t sum = 0;
+  for (unsigned int n = 0; n < SENSORS; n++) {
+    sum += samples[n];
+  }
+  return sum;
+}
+
+// Bus transactions on every bus so far
+static uint32_t transactions(void) {
+  uint32_t sum = 0;
+  for (unsigned int bus = 0; bus < BUSES; bus++) {
+    struct sim_bus_stats stats;
+    sim_bus_stats(metal_i2c_get_device(bus), &stats);
+    sum += stats.transactions;
+  }
+  return sum;
+}
+
+static struct BH1750_scheduler scheduler;
+
+static void table_pass(void) {
+  BH1750_tablePoll(&table, count_table, NULL);
+}
+
+static void registry_pass(void) {
+  BH1750_schedulerPoll(&scheduler);
+}
+
+// Host time of the fastest of IDLE_PASSES passes that found no sensor to
+// read or re-arm, the others may have been preempted
+static uint64_t idle_pass(void (*pass)(void)) {
+  uint64_t fastest = UINT64_MAX;
+  for (int p = 0; p < IDLE_PASSES;) {
+    uint32_t before = transactions();
+    uint64_t h0 = bench_now();
+    pass();
+    uint64_t h1 = bench_now();
+    if (transactions() == before) {
+      fastest = h1 - h0 < fastest ? h1 - h0 : fastest;
+      p++;
+    }
+  }
+  return fastest;
+}
+
+int main(void) {
+  int wrong = 0;
+
+  // Packed table
+  setup();
+  BH1750_tableInit(&table);
+  for (unsigned int bus = 0; bus < BUSES; bus++) {
+    for (unsigned int m = 0; m < MUXES_PER_BUS; m++) {
+      BH1750_tableRoute(&table, metal_i2c_get_device(bus), &mux[bus][m]);
+    }
+  }
+  BH1750_tableCalibration(&table, calibration[0]);
+  BH1750_tableCalibration(&table, calibration[1]);
+  for (unsigned int n = 0; n < SENSORS; n++) {
+    int index = BH1750_tableAdd(&table, n % 2 ? 0x5C : 0x23, n / 16, n / 2 % 8, profile[n % 5].mode,
+                                profile[n % 5].MTreg, n / 3 % 2);
+    wrong += index != (int)n;
+  }
+  uint64_t t0 = sim_cycles();
+  while (sim_cycles() - t0 < RUN_MS * (SIM_TIMEBASE_HZ / 1000)) {
+    BH1750_tableRun(&table, count_table, NULL);
+  }
+  uint32_t table_samples = total();
+  int slow = 0, mismatch = 0;
+  for (unsigned int n = 0; n < SENSORS; n++) {
+    double want = bh1750_model_count(profile[n % 5].mode, profile[n % 5].MTreg, model[n].lux) * 69.0 /
+                  profile[n % 5].MTreg / (profile[n % 5].mode == BH1750_CONTINUOUS_HIGH_RES_MODE_2 ? 2 : 1) /
+                  calibration[n / 3 % 2];
+    mismatch += fabs(BH1750_tableLux(&table, n) - want) > 1e-4 * want + 1e-4;
+    slow += too_few(n, samples[n]);
+    samples[n] = 0;
+  }
+  wrong += slow + mismatch + table.failed;
+
+  uint64_t idle_table = idle_pass(table_pass);
+
+  // Registry and scheduler
+  setup();
+  BH1750_registryInit(&registry, storage, SENSORS);
+  for (unsigned int n = 0; n < SENSORS; n++) {
+    struct BH1750_sensor *device = BH1750_beginAt(&registry, profile[n % 5].mode, n % 2 ? 0x5C : 0x23,
+                                                  metal_i2c_get_device(n / 64), &mux[n / 64][n / 16 % 4],
+                                                  n / 2 % 8, profile[n % 5].MTreg);
+    wrong += device == NULL;
+  }
+  BH1750_schedulerInit(&scheduler, &registry, 0, count_registry, NULL);
+  t0 = sim_cycles();
+  while (sim_cycles() - t0 < RUN_MS * (SIM_TIMEBASE_HZ / 1000)) {
+    BH1750_schedulerRun(&scheduler);
+  }
+  uint32_t registry_samples = total();
+  uint64_t idle_registry = idle_pass(registry_pass);
+
+  unsigned int columns = sizeof(table.location[0]) + sizeof(table.config[0]) + sizeof(table.MTreg[0]) +
+                         sizeof(table.deadline[0]) + sizeof(table.raw[0]);
+  printf("%d sensors on %d buses, %d muxes each, %d ms\r\n", SENSORS, BUSES, MUXES_PER_BUS, RUN_MS);
+  printf("  %-22s %5.1f B/sensor, %6u B in all (columns %u B/sensor)  %7.1f samples/s  idle pass %5.1f %s/sensor\r\n",
+         "packed table", (double)sizeof(table) / BH1750_TABLE_SIZE, (unsigned)sizeof(table), columns,
+         table_samples * 1000.0 / RUN_MS, (double)idle_table / SENSORS, BENCH_UNIT);
+  printf("  %-22s %5.1f B/sensor, %6u B in all                      %7.1f samples/s  idle pass %5.1f %s/sensor\r\n",
+         "registry + scheduler", (double)sizeof(struct BH1750_sensor), (unsigned)sizeof(storage),
+         registry_samples * 1000.0 / RUN_MS, (double)idle_registry / SENSORS, BENCH_UNIT);
+  printf("  table: %d sensors read too rarely, %d samples off the model, %u failed reads\r\n",
+         slow, mismatch, (unsigned)table.failed);
+  printf("%d wrong\r\n", wrong);
+  return wrong != 0;
+}
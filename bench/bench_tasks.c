@@ -0,0 +1,251 @@
+/*
+ * bench_tasks.c
+ *
+ * Stackless tasks (BH1750_task.c) against the callback scheduler
+ * (BH1750_scheduler.c) and a hand-written polling loop with delay(1), for
+ * 32 sensors behind two TCA9548A on two buses, with the mix of modes and
+ * MTreg values of bench_scheduler. Each variant runs for the same virtual
+ * time; reports samples per second and how long after the end of a
+ * conversion it is read, then the host cost of a pass over the sensors
+ * when none is due and of resuming a task, and the RAM each variant needs
+ * per sensor. Checks that every task read every conversion the scheduler
+ * read, give or take the one in flight at the end, and that no read
+ * failed.
+ *
+ * Build on the host from the repository root:
+ *   gcc -O2 -Isim -Iexamples/BH1750two_i2c -I. bench/bench_tasks.c \
+ *       examples/BH1750two_i2c/BH1750.c examples/BH1750two_i2c/BH1750_scheduler.c \
+ *       examples/BH1750two_i2c/BH1750_task.c delay.c sim/sim.c sim/bh1750_model.c \
+ *       sim/tca9548a_model.c -o bench_tasks
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <metal/i2c.h>
+#include "BH1750.h"
+#include "BH1750_scheduler.h"
+#include "BH1750_task.h"
+#include "sim.h"
+#include "bh1750_model.h"
+#include "tca9548a_model.h"
+#include "bench.h"
+
+#define BUSES 2
+#define SENSORS 32
+#define RUN_MS 5000
+#define YIELDS 1000
+#define IDLE_PASSES 1000
+
+static const struct {
+  BH1750_Mode mode;
+  unsigned char MTreg;
+} profile[4] = {
+  { BH1750_CONTINUOUS_HIGH_RES_MODE, 69 },
+  { BH1750_CONTINUOUS_LOW_RES_MODE, 69 },
+  { BH1750_CONTINUOUS_HIGH_RES_MODE, 32 },
+  { BH1750_CONTINUOUS_HIGH_RES_MODE_2, 138 },
+};
+
+static struct bh1750_model model[SENSORS];
+static struct tca9548a_model mux_model[BUSES];
+static struct BH1750_sensor storage[SENSORS];
+static struct BH1750_registry registry;
+static struct BH1750_mux mux[BUSES];
+static struct BH1750_task tasks[SENSORS];
+static struct BH1750_executor executor;
+
+struct result {
+  const char *name;
+  uint32_t samples[SENSORS];
+  uint32_t failed;
+  uint32_t last[SENSORS]; // lastReadTimestamp of the previous read
+  uint64_t late; // ticks from the end of each conversion to its read
+};
+
+static struct result polling = { "polling + delay(1)", { 0 }, 0, { 0 }, 0 };
+static struct result callback = { "scheduler, callback", { 0 }, 0, { 0 }, 0 };
+static struct result tasked = { "tasks", { 0 }, 0, { 0 }, 0 };
+
+static void setup(void) {
+  const unsigned char addr[2] = { 0x23, 0x5C };
+  sim_reset();
+  BH1750_registryInit(&registry, storage, SENSORS);
+  for (unsigned int bus = 0; bus < BUSES; bus++) {
+    struct metal_i2c *i2c = metal_i2c_get_device(bus);
+    metal_i2c_init(i2c, 400000, METAL_I2C_MASTER);
+    tca9548a_model_init(&mux_model[bus], 0x70);
+    sim_attach(bus, &mux_model[bus].dev);
+    BH1750_muxInit(&mux[bus], i2c, 0x70);
+  }
+  for (unsigned int i = 0; i < SENSORS; i++) {
+    unsigned int bus = i / 16, channel = i % 16 / 2;
+    bh1750_model_init(&model[i], addr[i % 2], 100.0 + 10.0 * i);
+    tca9548a_model_attach(&mux_model[bus], channel, &model[i].dev);
+    BH1750_beginAt(&registry, profile[i % 4].mode, addr[i % 2], metal_i2c_get_device(bus), &mux[bus],
+                   channel, profile[i % 4].MTreg);
+  }
+}
+
+static int run_for(uint64_t start) {
+  return sim_cycles() - start < RUN_MS * (SIM_TIMEBASE_HZ / 1000);
+}
+
+static void start(struct result *r) {
+  for (unsigned int i = 0; i < SENSORS; i++) {
+    r->last[i] = storage[i].lastReadTimestamp;
+  }
+}
+
+static void count(struct result *r, struct BH1750_sensor *device, const struct BH1750_sample *sample) {
+  unsigned int i = device - storage;
+  r->samples[i]++;
+  r->failed += sample->status != BH1750_SAMPLE_OK;
+  r->late += device->lastReadTimestamp - (r->last[i] + msToTicks(BH1750_conversionTime(device, 0)));
+  r->last[i] = device->lastReadTimestamp;
+}
+
+static void run_polling(void) {
+  struct BH1750_sample sample;
+  setup();
+  start(&polling);
+  uint64_t t0 = sim_cycles();
+  while (run_for(t0)) {
+    for (unsigned int i = 0; i < SENSORS; i++) {
+      if (BH1750_measurementReady(&storage[i], 0)) {
+        BH1750_readRaw(&storage[i], &sample);
+        count(&polling, &storage[i], &sample);
+      }
+    }
+    delay(1);
+  }
+}
+
+static void on_sample(struct BH1750_sensor *device, float lux, void *arg) {
+  (void)arg;
+  struct BH1750_sample sample = { .status = lux < 0 ? BH1750_SAMPLE_READ_FAILED : BH1750_SAMPLE_OK };
+  count(&callback, device, &sample);
+}
+
+static void run_callback(void) {
+  struct BH1750_scheduler scheduler;
+  setup();
+  BH1750_schedulerInit(&scheduler, &registry, 0, on_sample, NULL);
+  start(&callback);
+  uint64_t t0 = sim_cycles();
+  while (run_for(t0)) {
+    BH1750_schedulerRun(&scheduler);
+  }
+}
+
+// One task per sensor, reading as long as the run lasts
+static char sensor_task(struct BH1750_task *task) {
+  struct BH1750_sensor *device = task->arg;
+  BH1750_TASK_BEGIN(task);
+  while (1) {
+    BH1750_AWAIT_READ(task, device, 0);
+    count(&tasked, device, &task->sample);
+  }
+  BH1750_TASK_END(task);
+}
+
+static void run_tasks(void) {
+  setup();
+  BH1750_executorInit(&executor, tasks, SENSORS);
+  for (unsigned int i = 0; i < SENSORS; i++) {
+    BH1750_spawn(&executor, sensor_task, &storage[i]);
+  }
+  start(&tasked);
+  uint64_t t0 = sim_cycles();
+  while (run_for(t0)) {
+    BH1750_executorRun(&executor);
+  }
+}
+
+static uint32_t total(const struct result *r) {
+  uint32_t n = 0;
+  for (unsigned int i = 0; i < SENSORS; i++) {
+    n += r->samples[i];
+  }
+  return n;
+}
+
+static void report(const struct result *r) {
+  uint32_t n = total(r);
+  printf("  %-22s %7.1f samples/s  read %6.1f us after the conversion  %u failed\r\n", r->name,
+         n * 1000.0 / RUN_MS, (double)ticksToUs(r->late / n), (unsigned)r->failed);
+}
+
+// Yields a fixed number of times, to time the executor round trip
+static char yield_task(struct BH1750_task *task) {
+  int *left = task->arg;
+  BH1750_TASK_BEGIN(task);
+  while (--*left > 0) {
+    BH1750_YIELD(task);
+  }
+  BH1750_TASK_END(task);
+}
+
+int main(void) {
+  int wrong = 0;
+
+  run_polling();
+  run_callback();
+  run_tasks();
+  printf("%d sensors on %d buses, %d ms each\r\n", SENSORS, BUSES, RUN_MS);
+  report(&polling);
+  report(&callback);
+  report(&tasked);
+  for (unsigned int i = 0; i < SENSORS; i++) {
+    wrong += abs((int)tasked.samples[i] - (int)callback.samples[i]) > 1 || tasked.samples[i] == 0;
+  }
+  wrong += polling.failed + callback.failed + tasked.failed != 0;
+
+  // A pass when nothing is due, right after every sensor was read
+  struct BH1750_scheduler scheduler;
+  struct BH1750_sample sample;
+  BH1750_schedulerInit(&scheduler, &registry, 0, on_sample, NULL);
+  for (unsigned int i = 0; i < SENSORS; i++) {
+    BH1750_readRaw(&storage[i], &sample);
+  }
+  uint64_t t0 = bench_now();
+  int due = 0;
+  for (int p = 0; p < IDLE_PASSES; p++) {
+    for (unsigned int i = 0; i < SENSORS; i++) {
+      due += BH1750_measurementReady(&storage[i], 0);
+    }
+  }
+  uint64_t idle_polling = bench_now() - t0;
+  t0 = bench_now();
+  for (int p = 0; p < IDLE_PASSES; p++) {
+    BH1750_schedulerPoll(&scheduler);
+  }
+  uint64_t idle_callback = bench_now() - t0;
+  t0 = bench_now();
+  for (int p = 0; p < IDLE_PASSES; p++) {
+    BH1750_executorPoll(&executor);
+  }
+  uint64_t idle_tasks = bench_now() - t0;
+  BENCH_KEEP(due);
+  printf("pass with nothing due, per sensor: polling %.1f  scheduler %.1f  tasks %.1f %s\r\n",
+         (double)idle_polling / (IDLE_PASSES * SENSORS), (double)idle_callback / (IDLE_PASSES * SENSORS),
+         (double)idle_tasks / (IDLE_PASSES * SENSORS), BENCH_UNIT);
+
+  // Task switch: every task yields back to the executor YIELDS times
+  static int left[SENSORS];
+  BH1750_executorInit(&executor, tasks, SENSORS);
+  for (unsigned int i = 0; i < SENSORS; i++) {
+    left[i] = YIELDS;
+    BH1750_spawn(&executor, yield_task, &left[i]);
+  }
+  t0 = bench_now();
+  while (BH1750_executorPoll(&executor)) {
+  }
+  uint64_t switching = bench_now() - t0;
+  wrong += executor.resumes != SENSORS * YIELDS || executor.live != 0;
+  printf("task resume and yield: %.1f %s, %u resumes\r\n",
+         (double)switching / executor.resumes, BENCH_UNIT, (unsigned)executor.resumes);
+
+  printf("RAM per sensor beyond struct BH1750_sensor: polling 0 B, scheduler 0 B (%u B in all), "
+         "task slot %u B\r\n", (unsigned)sizeof(struct BH1750_scheduler), (unsigned)sizeof(struct BH1750_task));
+  printf("%d wrong\r\n", wrong);
+  return wrong != 0;
+}
@@ -0,0 +1,101 @@
+/*
+ * bench_timebase.c
+ *
+ * The cached timebase of delay.c against the original millis(), which read
+ * the timebase frequency and did a 64-bit multiply and divide on every call
+ * (soft-arithmetic library calls on RV32):
+ *  - millis() and micros() checked against the exact value at virtual times
+ *    up to a year, including across the 2^32 tick and 2^32 ms wraparounds
+ *  - deadlines that straddle the 2^32 tick wraparound
+ *  - cost per call of each time function, in bench_now() units
+ *
+ * Build on the host from the repository root:
+ *   gcc -O2 -Isim -I. bench/bench_timebase.c delay.c sim/sim.c -o bench_timebase
+ */
+#include <stdio.h>
+#include <metal/timer.h>
+#include "delay.h"
+#include "sim.h"
+#include "bench.h"
+
+#define CALLS 100000
+
+// millis() as it was before the timebase was cached
+__attribute__((noinline))
+static unsigned long long legacy_millis(void) {
+  int rv;
+  unsigned long long mcc, timebase;
+  rv = metal_timer_get_cyclecount(0, &mcc);
+  if (rv != 0) {
+    return -1;
+  }
+  rv = metal_timer_get_timebase_frequency(0, &timebase);
+  if (rv != 0) {
+    return -1;
+  }
+  return mcc * 1000 / timebase;
+}
+
+// Whether f() lies between the exact values before and after the call
+static int check(uint32_t (*f)(void), unsigned long long ticks_per_unit) {
+  unsigned long long before = sim_cycles() / ticks_per_unit;
+  uint32_t value = f();
+  unsigned long long after = sim_cycles() / ticks_per_unit;
+  return (uint32_t)(value - (uint32_t)before) <= (uint32_t)(after - before);
+}
+
+static double cost(uint32_t (*f)(void)) {
+  uint32_t acc = 0;
+  uint64_t t0 = bench_now();
+  for (int i = 0; i < CALLS; i++) {
+    acc += f();
+  }
+  BENCH_KEEP(acc);
+  return (double)(bench_now() - t0) / CALLS;
+}
+
+static uint32_t legacy(void) {
+  return (uint32_t)legacy_millis();
+}
+
+int main(void) {
+  const unsigned long long at[] = {
+    0, 1, 15999, 16000, 123456789,
+    (1ULL << 32) - 16, (1ULL << 32), (1ULL << 32) + 16,      // tick wrap
+    4294967296ULL * SIM_TIMEBASE_HZ / 1000 - 16,             // millis wrap
+    4294967296ULL * SIM_TIMEBASE_HZ / 1000 + 16,
+    365ULL * 24 * 3600 * SIM_TIMEBASE_HZ,
+  };
+  int wrong = 0, checked = 0;
+
+  sim_reset();
+  timebaseInit();
+  for (unsigned int i = 0; i < sizeof(at) / sizeof(at[0]); i++) {
+    for (unsigned int step = 0; step < 2000; step++) {
+      metal_timer_set_machine_time(0, at[i] + step * 997);
+      wrong += !check(millis, SIM_TIMEBASE_HZ / 1000);
+      wrong += !check(micros, SIM_TIMEBASE_HZ / 1000000);
+      checked += 2;
+    }
+  }
+  printf("millis()/micros(): %d of %d readings off\r\n", wrong, checked);
+
+  // Deadlines set just before the tick counter wraps
+  int early = 0, late = 0;
+  for (uint32_t ms = 1; ms <= 100; ms++) {
+    metal_timer_set_machine_time(0, (1ULL << 32) - msToTicks(ms) / 2);
+    uint64_t start = sim_cycles();
+    deadline_t deadline = deadlineAfter(ms);
+    while (!deadlineReached(deadline)) {
+      sim_advance_cycles(1);
+    }
+    uint64_t waited = sim_cycles() - start;
+    early += waited < msToTicks(ms);
+    late += waited > msToTicks(ms) + 64;
+  }
+  printf("deadlines across the tick wraparound: %d early, %d late of 100\r\n", early, late);
+
+  printf("cost per call (%s): legacy millis %.1f, millis %.1f, micros %.1f, ticks32 %.1f\r\n", BENCH_UNIT,
+         cost(legacy), cost(millis), cost(micros), cost(ticks32));
+  return wrong != 0 || early != 0 || late != 0;
+}
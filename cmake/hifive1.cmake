@@ -0,0 +1,20 @@
+# Toolchain of the HiFive1 Rev B (FE310-G002, RV32IMAC)
+#   cmake -S . -B build-hifive1 -DCMAKE_TOOLCHAIN_FILE=cmake/hifive1.cmake \
+#         -DHIFIVE1_BSP_DIR=<freedom-e-sdk>/bsp/sifive-hifive1-revb
+# The BSP must be built first (make -C <freedom-e-sdk> PROGRAM=hello
+# TARGET=sifive-hifive1-revb), which installs its headers, libmetal.a and
+# libmetal-gloss.a. RISCV_PREFIX selects another toolchain, e.g.
+# riscv-none-elf- for the xPack one.
+set(CMAKE_SYSTEM_NAME Generic)
+set(CMAKE_SYSTEM_PROCESSOR riscv32)
+
+set(RISCV_PREFIX riscv64-unknown-elf- CACHE STRING "Prefix of the RISC-V toolchain")
+set(CMAKE_C_COMPILER ${RISCV_PREFIX}gcc)
+set(CMAKE_OBJCOPY ${RISCV_PREFIX}objcopy CACHE FILEPATH "objcopy")
+set(CMAKE_SIZE ${RISCV_PREFIX}size CACHE FILEPATH "size")
+
+set(CMAKE_C_FLAGS_INIT "-march=rv32imac -mabi=ilp32 -mcmodel=medlow -ffunction-sections -fdata-sections")
+set(CMAKE_EXE_LINKER_FLAGS_INIT "-nostartfiles --specs=nano.specs -Wl,--gc-sections")
+
+# The compiler check cannot link without the BSP
+set(CMAKE_TRY_COMPILE_TARGET_TYPE STATIC_LIBRARY)
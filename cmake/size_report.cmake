@@ -0,0 +1,16 @@
+# Print the .text and .data sizes of a set of objects and archives
+#   cmake -DSIZE=<size tool> -DNAME=<label> -DFILES=<file;file...> -P size_report.cmake
+if(NOT SIZE)
+  message(FATAL_ERROR "no size tool")
+endif()
+execute_process(COMMAND ${SIZE} -t ${FILES}
+  OUTPUT_VARIABLE output
+  RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+  message(FATAL_ERROR "${SIZE} failed on ${FILES}")
+endif()
+# Berkeley format, the last line holds the totals: text data bss dec hex
+string(STRIP "${output}" output)
+string(REGEX REPLACE ".*\n" "" totals "${output}")
+string(REGEX MATCH "^[ \t]*([0-9]+)[ \t]+([0-9]+)[ \t]+([0-9]+)" totals "${totals}")
+message("${NAME}: .text ${CMAKE_MATCH_1}  .data ${CMAKE_MATCH_2}  .bss ${CMAKE_MATCH_3}")
@@ -4,48 +4,404 @@
  *  Created on: April 28, 2021
  *      Author: Hoang Ta
  */
+#include <stddef.h>
 #include <stdint.h>
 #include <metal/time.h>
 #include <metal/timer.h>
+#include <metal/cpu.h>
+#include <metal/interrupt.h>
+#include "delay.h"
 
-// Return current time in milliseconds
-unsigned long long millis(void) {
-    int rv;
-    unsigned long long mcc, timebase;
-    rv = metal_timer_get_cyclecount(0, &mcc);  // get current clock
-    if (rv != 0) {
-        return -1;
+// x * num / den as a multiply and a shift: x * mul >> shift, with mul
+// holding 64 significant bits so 64-bit tick counts convert exactly
+struct timebaseScale {
+  uint64_t mul;
+  unsigned char shift;
+};
+
+static unsigned long long timebaseHz = 0;
+static struct timebaseScale ticksToUsScale;
+static struct timebaseScale ticksToMsScale;
+static struct timebaseScale msToTicksScale;
+static struct timebaseScale usToTicksScale;
+
+// Binary long division of num by den, once at init, rounded up
+static void timebaseScaleInit(struct timebaseScale *scale, unsigned long long num, unsigned long long den) {
+  uint64_t mul = num / den;
+  unsigned long long rem = num % den;
+  unsigned char shift = 0;
+  while(mul < (1ULL << 63)) {
+    rem <<= 1;
+    mul <<= 1;
+    if(rem >= den) {
+      rem -= den;
+      mul |= 1;
+    }
+    shift++;
+  }
+  scale->mul = mul + (rem != 0);
+  scale->shift = shift;
+}
+
+// Low 32 bits of x * mul >> shift, from four 32x32-bit multiplies
+static uint32_t timebaseScaleApply(unsigned long long x, const struct timebaseScale *scale) {
+  uint64_t xl = (uint32_t)x, xh = x >> 32;
+  uint64_t ml = (uint32_t)scale->mul, mh = scale->mul >> 32;
+  uint64_t ll = xl * ml, lh = xl * mh, hl = xh * ml, hh = xh * mh;
+  uint64_t mid = (ll >> 32) + (uint32_t)lh + (uint32_t)hl;
+  uint64_t lo = (mid << 32) | (uint32_t)ll;
+  uint64_t hi = hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+  if(scale->shift >= 64) {
+    return (uint32_t)(hi >> (scale->shift - 64));
+  }
+  if(scale->shift == 0) {
+    return (uint32_t)lo;
+  }
+  return (uint32_t)((lo >> scale->shift) | (hi << (64 - scale->shift)));
+}
+
+/**
+ * Read the timebase frequency once and derive the tick conversions
+ * Called by the first time function if not called before.
+ * @return 1 (true) or 0 (false) if the frequency is not available
+ */
+int timebaseInit(void) {
+  unsigned long long freq;
+  if(metal_timer_get_timebase_frequency(0, &freq) != 0 || freq == 0) {
+    return 0;
+  }
+  timebaseScaleInit(&ticksToUsScale, 1000000, freq);
+  timebaseScaleInit(&ticksToMsScale, 1000, freq);
+  timebaseScaleInit(&msToTicksScale, freq, 1000);
+  timebaseScaleInit(&usToTicksScale, freq, 1000000);
+  timebaseHz = freq;
+  return 1;
+}
+
+static unsigned long long cyclecount(void) {
+  unsigned long long mcc = 0;
+  if(!timebaseHz) {
+    timebaseInit();
+  }
+  metal_timer_get_cyclecount(0, &mcc);
+  return mcc;
+}
+
+// Return current time in timebase ticks, wraps around every 2^32 ticks
+uint32_t ticks32(void) {
+  return (uint32_t)cyclecount();
+}
+
+// Return current time in microseconds, wraps around every 2^32 us
+uint32_t micros(void) {
+  return timebaseScaleApply(cyclecount(), &ticksToUsScale);
+}
+
+// Return current time in milliseconds, wraps around every 2^32 ms
+uint32_t millis(void) {
+  return timebaseScaleApply(cyclecount(), &ticksToMsScale);
+}
+
+uint32_t msToTicks(uint32_t ms) {
+  if(!timebaseHz) {
+    timebaseInit();
+  }
+  return timebaseScaleApply(ms, &msToTicksScale);
+}
+
+uint32_t ticksToMs(uint32_t ticks) {
+  if(!timebaseHz) {
+    timebaseInit();
+  }
+  return timebaseScaleApply(ticks, &ticksToMsScale);
+}
+
+uint32_t ticksToUs(uint32_t ticks) {
+  if(!timebaseHz) {
+    timebaseInit();
+  }
+  return timebaseScaleApply(ticks, &ticksToUsScale);
+}
+
+// Return the deadline ms milliseconds from now
+deadline_t deadlineAfter(uint32_t ms) {
+  return ticks32() + msToTicks(ms);
+}
+
+// Return 1 (true) once the deadline is now or in the past
+int deadlineReached(deadline_t deadline) {
+  return (int32_t)(ticks32() - deadline) >= 0;
+}
+
+/*
+ * Sleeping delays and alarms. The hart sleeps in wfi until a machine timer
+ * (mtimecmp) interrupt shortly before the deadline, then spins on the cycle
+ * counter for the rest. mtime runs from a different clock than the cycle
+ * counter (the 32.768 kHz RTC on the FE310), so its rate is measured
+ * against the timebase once, during the first delay long enough to hide it.
+ * The timer interrupt serves both a sleeping delay and one alarm.
+ */
+
+// Length of the mtime rate measurement
+#define DELAY_CALIBRATION_MS 10
+// Bound on the relative error of the measured mtime rate, 2^-10
+#define DELAY_RATE_ERROR_SHIFT 10
+// mtimecmp value that never fires
+#define DELAY_NEVER (~0ULL)
+
+static struct metal_cpu *delayCpu;
+static struct metal_interrupt *delayCpuIntr;
+static struct metal_interrupt *delayTimerIntr;
+static int delayTimerId;
+// 0: not calibrated yet, 1: sleeping delays, -1: spinning only
+static int delayMode = 0;
+static struct timebaseScale ticksToMtimeScale;
+// Ticks left for the spin after waking: an mtime period and the wake-up
+static uint32_t delayGuardTicks;
+
+static volatile int delayTimerFired;
+static unsigned long long delayWakeMtime = DELAY_NEVER;
+static unsigned long long alarmMtime = DELAY_NEVER;
+static deadline_t alarmDeadline;
+static alarm_handler_t alarmHandler;
+static void *alarmArg;
+static int delayInHandler;
+
+// mtime to wake at for a deadline, early enough to absorb the error of
+// the measured mtime rate. Returns 0 (false) with the current mtime if the
+// deadline is too close to sleep.
+static int delayWakeFor(deadline_t deadline, unsigned long long *wake) {
+  int32_t remaining = (int32_t)(deadline - ticks32());
+  uint32_t margin, sleep = 0;
+
+  *wake = metal_cpu_get_mtime(delayCpu);
+  if(remaining > 0) {
+    margin = delayGuardTicks + ((uint32_t)remaining >> DELAY_RATE_ERROR_SHIFT);
+    if(remaining > (int32_t)margin) {
+      sleep = timebaseScaleApply((uint32_t)remaining - margin, &ticksToMtimeScale);
+    }
+  }
+  *wake += sleep;
+  return sleep > 0;
+}
+
+// Program mtimecmp for the earlier of the delay wake-up and the alarm.
+// Called with interrupts disabled or from the handler.
+static void delayTimerProgram(void) {
+  unsigned long long cmp = delayWakeMtime < alarmMtime ? delayWakeMtime : alarmMtime;
+  metal_cpu_set_mtimecmp(delayCpu, cmp);
+  if(cmp == DELAY_NEVER) {
+    metal_interrupt_disable(delayTimerIntr, delayTimerId);
+  } else {
+    metal_interrupt_enable(delayTimerIntr, delayTimerId);
+  }
+}
+
+static void delayTimerHandler(int id, void *priv) {
+  unsigned long long now = metal_cpu_get_mtime(delayCpu);
+  (void)id;
+  (void)priv;
+
+  delayInHandler = 1;
+  if(now >= delayWakeMtime) {
+    delayWakeMtime = DELAY_NEVER;
+    delayTimerFired = 1;
+  }
+  if(now >= alarmMtime) {
+    // Still far from the deadline after a long sleep on the estimated rate
+    if(!delayWakeFor(alarmDeadline, &alarmMtime)) {
+      alarm_handler_t handler = alarmHandler;
+      alarmMtime = DELAY_NEVER;
+      alarmHandler = 0;
+      while(!deadlineReached(alarmDeadline)) {
+      }
+      // May start the next alarm
+      handler(alarmArg);
     }
-    rv = metal_timer_get_timebase_frequency(0, &timebase);
-    if (rv != 0) {
-        return -1;
+  }
+  delayTimerProgram();
+  delayInHandler = 0;
+}
+
+static void delayWaitForInterrupt(void) {
+#ifdef METAL_SIM_WFI
+  metal_sim_wfi();
+#else
+  __asm__ volatile ("wfi");
+#endif
+}
+
+/**
+ * Set up sleeping delays: hook the machine timer interrupt and measure the
+ * mtime rate against the timebase. Busy-waits DELAY_CALIBRATION_MS.
+ * Called by the first delay of at least that length, or the first alarm,
+ * if not called before. Leaves machine interrupts enabled.
+ * @return 1 (true) or 0 (false) if delays can only spin
+ */
+int delayInit(void) {
+  unsigned long long m0, m1;
+  uint32_t t0, t1;
+
+  delayMode = -1;
+  if(!timebaseHz && !timebaseInit()) {
+    return 0;
+  }
+  delayCpu = metal_cpu_get(metal_cpu_get_current_hartid());
+  if(!delayCpu) {
+    return 0;
+  }
+  delayCpuIntr = metal_cpu_interrupt_controller(delayCpu);
+  delayTimerIntr = metal_cpu_timer_interrupt_controller(delayCpu);
+  if(!delayCpuIntr || !delayTimerIntr) {
+    return 0;
+  }
+  metal_interrupt_init(delayCpuIntr);
+  metal_interrupt_init(delayTimerIntr);
+  delayTimerId = metal_cpu_timer_get_interrupt_id(delayCpu);
+  if(metal_interrupt_register_handler(delayTimerIntr, delayTimerId, delayTimerHandler, NULL) != 0) {
+    return 0;
+  }
+  metal_cpu_set_mtimecmp(delayCpu, DELAY_NEVER);
+
+  // Count mtime ticks between two mtime edges about DELAY_CALIBRATION_MS apart
+  m0 = metal_cpu_get_mtime(delayCpu);
+  t0 = ticks32();
+  while((m1 = metal_cpu_get_mtime(delayCpu)) == m0) {
+    if(ticks32() - t0 >= msToTicks(DELAY_CALIBRATION_MS)) {
+      return 0; // mtime is not running
     }
-    return mcc * 1000 / timebase;
+  }
+  m0 = m1;
+  t0 = ticks32();
+  while(ticks32() - t0 < msToTicks(DELAY_CALIBRATION_MS)) {
+  }
+  m1 = metal_cpu_get_mtime(delayCpu);
+  while(metal_cpu_get_mtime(delayCpu) == m1) {
+  }
+  t1 = ticks32();
+  m1++;
+  timebaseScaleInit(&ticksToMtimeScale, m1 - m0, t1 - t0);
+  delayGuardTicks = 2 * (t1 - t0) / (uint32_t)(m1 - m0);
+
+  metal_interrupt_enable(delayCpuIntr, 0);
+  delayMode = 1;
+  return 1;
+}
+
+// Sleep until the deadline is close, alarms keep firing meanwhile
+// Returns 0 (false) if it is already too close to sleep.
+static int delaySleep(deadline_t deadline) {
+  metal_interrupt_disable(delayCpuIntr, 0);
+  if(!delayWakeFor(deadline, &delayWakeMtime)) {
+    delayWakeMtime = DELAY_NEVER;
+    metal_interrupt_enable(delayCpuIntr, 0);
+    return 0;
+  }
+  delayTimerFired = 0;
+  delayTimerProgram();
+  while(!delayTimerFired) {
+    // A pending interrupt wakes wfi with interrupts off, so one that fires
+    // before wfi is not lost; the handler runs once they are enabled
+    delayWaitForInterrupt();
+    metal_interrupt_enable(delayCpuIntr, 0);
+    metal_interrupt_disable(delayCpuIntr, 0);
+  }
+  metal_interrupt_enable(delayCpuIntr, 0);
+  return 1;
+}
+
+/**
+ * Wait until a deadline, asleep for all but the last mtime period
+ * @param deadline from deadlineAfter() or a tick count
+ */
+void delayUntil(deadline_t deadline) {
+  if(delayMode == 0 && (int32_t)(deadline - ticks32()) >= (int32_t)msToTicks(2 * DELAY_CALIBRATION_MS)) {
+    delayInit();
+  }
+  // Sleeping needs the timer interrupt, which an alarm handler holds; a
+  // long sleep on the estimated rate is followed by a shorter one
+  while(delayMode > 0 && !delayInHandler && delaySleep(deadline)) {
+  }
+  while(!deadlineReached(deadline)) {
+  }
+}
+
+/**
+ * Call a handler from the timer interrupt at a deadline
+ * There is one alarm; starting it again replaces the pending one. The
+ * handler may start the next alarm.
+ * @param deadline Tick count to fire at, within 2^31 ticks from now
+ * @param handler Called in interrupt context
+ * @param arg Passed to handler
+ * @return 1 (true) or 0 (false) if the timer interrupt is not available
+ */
+int alarmStart(deadline_t deadline, alarm_handler_t handler, void *arg) {
+  if(delayMode == 0) {
+    delayInit();
+  }
+  if(delayMode < 0) {
+    return 0;
+  }
+  if(!delayInHandler) {
+    metal_interrupt_disable(delayCpuIntr, 0);
+  }
+  alarmDeadline = deadline;
+  alarmHandler = handler;
+  alarmArg = arg;
+  delayWakeFor(deadline, &alarmMtime);
+  if(!delayInHandler) {
+    delayTimerProgram();
+    metal_interrupt_enable(delayCpuIntr, 0);
+  }
+  return 1;
+}
+
+// Cancel the pending alarm, if any
+void alarmStop(void) {
+  if(delayMode <= 0) {
+    return;
+  }
+  if(!delayInHandler) {
+    metal_interrupt_disable(delayCpuIntr, 0);
+  }
+  alarmMtime = DELAY_NEVER;
+  alarmHandler = 0;
+  if(!delayInHandler) {
+    delayTimerProgram();
+    metal_interrupt_enable(delayCpuIntr, 0);
+  }
 }
 
 void delayMicroseconds(int microseconds)
 {
-	volatile uint32_t ul;
-	for(ul = 0; ul < microseconds; ul++)
-	{
-		__asm__ volatile ("nop");
-	}
+  if(microseconds <= 0) {
+    return;
+  }
+  if(!timebaseHz) {
+    timebaseInit();
+  }
+  delayUntil(ticks32() + timebaseScaleApply((uint32_t)microseconds, &usToTicksScale));
+}
+
+// Deadlines reach 2^31 ticks ahead, longer delays are waited in steps of
+// half that, so a step still fits when the one before it ended late
+static uint32_t delayStepMs(void) {
+  unsigned long long step;
+  if(!timebaseHz) {
+    return UINT32_MAX;
+  }
+  step = (unsigned long long)(INT32_MAX / 2) * 1000 / timebaseHz;
+  return step == 0 ? 1 : step > UINT32_MAX ? UINT32_MAX : (uint32_t)step;
 }
 
 void delay(uint32_t miliseconds)
 {
-  unsigned long long wait, current, timeout;
-  unsigned long long cyclecount = 0, freq = 0;
-  metal_timer_get_timebase_frequency(0, &freq); // freq = 16000000 Hz
-  wait = miliseconds * freq / 1000;  // convert milliseconds to clocks
-
-  metal_timer_get_cyclecount(0, &cyclecount); // get current clock
-  current = cyclecount;
-  timeout = current + wait;
-  while(cyclecount < timeout)
-  {
-    metal_timer_get_cyclecount(0, &cyclecount);
+  deadline_t deadline = ticks32();
+  uint32_t maxStep = delayStepMs();
+  while(miliseconds > 0) {
+    uint32_t step = miliseconds < maxStep ? miliseconds : maxStep;
+    deadline += msToTicks(step);
+    delayUntil(deadline);
+    miliseconds -= step;
   }
 }
-
-
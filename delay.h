@@ -0,0 +1,38 @@
+/*
+ * delay.h
+ *
+ *  Created on: April 28, 2021
+ *      Author: Hoang Ta
+ */
+#ifndef DELAY_H
+#define DELAY_H
+
+#include <stdint.h>
+
+// A point in time in timebase ticks. Ticks wrap around every 2^32 ticks,
+// 2^32 / timebase Hz seconds: 268 s at 16 MHz, only 13.4 s at 320 MHz.
+// Compare deadlines only through deadlineReached(), which orders them
+// within 2^31 ticks, and keep them less than that ahead (134 s at 16 MHz,
+// 6.7 s at 320 MHz).
+typedef uint32_t deadline_t;
+
+// Called from the timer interrupt when an alarm fires
+typedef void (*alarm_handler_t)(void *arg);
+
+int timebaseInit(void);
+uint32_t ticks32(void);
+uint32_t micros(void);
+uint32_t millis(void);
+uint32_t msToTicks(uint32_t ms);
+uint32_t ticksToMs(uint32_t ticks);
+uint32_t ticksToUs(uint32_t ticks);
+deadline_t deadlineAfter(uint32_t ms);
+int deadlineReached(deadline_t deadline);
+int delayInit(void);
+void delayUntil(deadline_t deadline);
+void delayMicroseconds(int microseconds);
+int alarmStart(deadline_t deadline, alarm_handler_t handler, void *arg);
+void alarmStop(void);
+void delay(uint32_t miliseconds);
+
+#endif // DELAY_H
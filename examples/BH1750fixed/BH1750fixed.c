@@ -0,0 +1,53 @@
+/*
+  BH1750fixed.c
+
+  Example of the compile-time specialized driver (BH1750_fixed.h).
+
+  This example does the same as BH1750test: the sensor at 0x23 in high
+  resolution continuous mode, a light level reading every second. Its
+  address, mode and MTreg are fixed at compile time, so the lux scale is a
+  constant and the library of BH1750.c is not linked; only delay.c is.
+
+  Connection:
+
+    VCC -> 3V3 or 5V
+    GND -> GND
+    SCL -> SCL
+    SDA -> SDA
+    ADD -> (not connected) or GND
+
+ */
+
+#include <stdio.h>
+#include <metal/i2c.h>
+
+#define BH1750_FIXED_NAME light
+#define BH1750_FIXED_ADDR 0x23
+#define BH1750_FIXED_MODE BH1750_CONTINUOUS_HIGH_RES_MODE
+#include "BH1750_fixed.h"
+
+struct metal_i2c *bh1750_i2c;
+
+int main() {
+  asm (".global _printf_float");  // add this line for printf and scanf be able to support float type
+
+  // Initialize the I2C bus (BH1750 library doesn't do this automatically)
+  bh1750_i2c = metal_i2c_get_device(0);
+  if (bh1750_i2c == NULL) {
+    printf("I2C not available\r\n");
+    return -1;
+  }
+  metal_i2c_init(bh1750_i2c, 100000, METAL_I2C_MASTER); // configure to 100000Hz, master mode
+  if (!light_begin(bh1750_i2c)) {
+    printf("BH1750 not found\r\n");
+  }
+  printf("Test BH1750 fixed begin\r\n");
+
+  while(1) {
+    float lux = light_readLightLevel();
+    printf("Light: %f lx\r\n", lux);
+    delay(1000);
+  }
+
+  return 0;
+}
@@ -9,9 +9,10 @@
   This example initializes the BH1750 object using the high resolution
   one-time mode and then makes a light level reading every second.
 
-  The BH1750 component starts up in default mode when it next powers up.
-  The BH1750 library automatically reconfigures the one-time mode in
-  preparation for the next measurement.
+  The BH1750 component powers down after each one-time measurement.
+  BH1750_readLightLevelRearm() starts the next measurement in the same
+  bus session as the read, so the sensor converts while the light level
+  is printed and the loop sleeps.
 
   Connection:
 
@@ -51,13 +52,12 @@ int main() {
 
   while(1) {
     while(BH1750_measurementReady(1) == false) {
-      ;
+      delay(1);
     }
-    float lux = BH1750_readLightLevel();
+    float lux = BH1750_readLightLevelRearm();
     printf("Light: %f lx\r\n", lux);
-    BH1750_configure(BH1750_ONE_TIME_HIGH_RES_MODE);
 
-    delay(1000); // delay for next measurement
+    delay(1000); // the next measurement runs meanwhile
   }
 
   return 0;
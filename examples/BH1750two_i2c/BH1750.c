@@ -14,7 +14,9 @@
 
 */
 #include <stdbool.h>
+#if defined(BH1750_DEBUG) || defined(USE_ONE_BH1750)
 #include <stdio.h>
+#endif
 #include <string.h>
 #include <inttypes.h>
 #include <metal/machine.h>
@@ -22,8 +24,6 @@
 #include "BH1750.h"
 
 //#define BH1750_DEBUG
-extern unsigned long millis(void);
-extern void delay(uint32_t miliseconds);
 #define _delay_ms(ms) delay(ms)
 #ifdef USE_ONE_BH1750
 unsigned int BH1750_I2CADDR = 0x23;  // default is 0x23
@@ -265,290 +265,1584 @@ float BH1750_readLightLevel() {
   return level;
 }
 #endif
-static struct BH1750_sensor _device[2] = {
-	    {
-	        .i2c = NULL,
-	        .BH1750_I2CADDR = 0x23,
-	        .BH1750_MTreg = BH1750_DEFAULT_MTREG,
-	        .BH1750_CONV_FACTOR = 1.2,
-	        .BH1750_MODE = BH1750_UNCONFIGURED,
-	        .lastReadTimestamp = 0,
-	    },
-	    {
-	        .i2c = NULL,
-	        .BH1750_I2CADDR = 0x5C,
-	        .BH1750_MTreg = BH1750_DEFAULT_MTREG,
-	        .BH1750_CONV_FACTOR = 1.2,
-	        .BH1750_MODE = BH1750_UNCONFIGURED,
-	        .lastReadTimestamp = 0,
-	    }
+static int BH1750_read(struct BH1750_sensor *device, unsigned char *buf, unsigned int len);
+
+// Storage of the registry BH1750_begin() uses
+static struct BH1750_sensor _device[BH1750_DEFAULT_SENSORS];
+static struct BH1750_registry _registry = {
+	.sensors = _device,
+	.capacity = BH1750_DEFAULT_SENSORS,
+	.count = 0,
 };
 
+#ifndef BH1750_NO_LOG
+static BH1750_logSink_t _logSink = NULL;
+
 /**
- * Create and return a device structure with
- * Configure sensor and set default MTreg
- * @param mode Measurement mode
- * @param addr Address of the sensor (0x23 or 0x5C, see datasheet)
- * @param i2c Object pointer connected to I2C bus
- * return 1 (true) or 0 (false)
+ * Install the function that receives the errors of the library
+ * No sink is installed by default, and the library prints nothing. Define
+ * BH1750_NO_LOG to leave the sink and the messages out of the build.
+ * @param sink Called on every error, NULL to drop them
  */
-struct BH1750_sensor *BH1750_begin(BH1750_Mode mode, unsigned char addr, struct metal_i2c *i2c, unsigned char MTreg) {
-
-  struct BH1750_sensor *device;
-  int index = ADDR_0x23;
-
-  int ret;
+void BH1750_setLogSink(BH1750_logSink_t sink) {
+  _logSink = sink;
+}
 
-  if(addr == 0x23) {
-    device = &_device[ADDR_0x23];
-  }
-  else if(addr == 0x5C) {
-    device = &_device[ADDR_0x5C];
-  } else {
-    printf("[BH1750] ERROR: wrong address\r\n");
-    return NULL;
-  }
-  // I2C is expected to be initialized outside this library
-  // But, allows a different address and Metal I2C struct pointer to be used
-  if(i2c) {
-    device->i2c = i2c;
-  } else {
-    printf("[BH1750] ERROR: I2C was not created\r\n");
-    return NULL;
+/**
+ * Pass an error to the log sink, see BH1750_setLogSink()
+ * @param device structure, NULL for errors of a bus, mux or registry
+ * @param error What went wrong
+ * @param message Short constant description
+ */
+void BH1750_log(const struct BH1750_sensor *device, BH1750_Error error, const char *message) {
+  if(_logSink) {
+    _logSink(device, error, message);
   }
+}
+#endif
 
-  if(mode == BH1750_UNCONFIGURED) {
-    mode = BH1750_CONTINUOUS_HIGH_RES_MODE; // try set to default mode
-  }
-  if(BH1750_configure(device, mode) != true) {
-    return NULL;
-  }
+// Depth of BH1750_interruptEnter() calls: errors are counted, not logged,
+// while it is not 0
+static volatile unsigned char _interruptDepth = 0;
 
-  if(MTreg == 0) {
-	  MTreg = BH1750_DEFAULT_MTREG; // try set to default MTreg
-  }
-  if(BH1750_setMTreg(device, MTreg) != true)
-  {
-    return NULL;
-  }
+/**
+ * Mark the start of driver calls from an interrupt handler
+ * Until the matching BH1750_interruptExit(), failures are counted in the
+ * sensor stats but not passed to the log sink, and a bus that fails too
+ * often in fast mode falls back only at its next transaction outside the
+ * interrupt. The sink may block, on a UART for one.
+ */
+void BH1750_interruptEnter(void) {
+  _interruptDepth++;
+}
 
-  return device;
+/**
+ * Mark the end of driver calls from an interrupt handler
+ */
+void BH1750_interruptExit(void) {
+  _interruptDepth--;
 }
 
+// Buses owned by another driver, see BH1750_setTransport()
+static struct {
+  struct metal_i2c *i2c;
+  BH1750_transfer_t transfer;
+  void *owner;
+} _transports[BH1750_TRANSPORTS];
 
 /**
- * Configure BH1750 with specified mode
- * @param device structure
- * @param mode Measurement mode
- * retrun true (1) if success, otherwise flase (0)
+ * Hand the transfers of the library on a bus to the driver that owns it
+ * Commands, reads, mux selections and probes on the bus go through transfer
+ * instead of the Metal I2C calls, and the bus clock is left to the owner.
+ * A one-time read and its re-trigger become two transfers.
+ * @param i2c Object pointer of the bus
+ * @param transfer Called for every transfer, NULL to give the bus back
+ * @param owner Passed to transfer
+ * @return true (1) if success, false (0) if BH1750_TRANSPORTS buses are owned already
  */
-int BH1750_configure(struct BH1750_sensor *device, BH1750_Mode mode) {
-  unsigned char cmd[1];
-  // default transmission result to a value out of normal range
-  unsigned char ack = 5;
-
-  if(!device) {
-	  return false;
+int BH1750_setTransport(struct metal_i2c *i2c, BH1750_transfer_t transfer, void *owner) {
+  int slot = -1;
+  for(int i = 0; i < BH1750_TRANSPORTS; i++) {
+    if(_transports[i].i2c == i2c) {
+      slot = i;
+      break;
+    }
+    if(slot < 0 && !_transports[i].i2c) {
+      slot = i;
+    }
+  }
+  if(slot < 0) {
+    return false;
   }
+  _transports[slot].i2c = transfer ? i2c : NULL;
+  _transports[slot].transfer = transfer;
+  _transports[slot].owner = owner;
+  return true;
+}
 
-  // Check measurement mode is valid
-  switch (mode) {
-    case BH1750_CONTINUOUS_HIGH_RES_MODE:
-    case BH1750_CONTINUOUS_HIGH_RES_MODE_2:
-    case BH1750_CONTINUOUS_LOW_RES_MODE:
-    case BH1750_ONE_TIME_HIGH_RES_MODE:
-    case BH1750_ONE_TIME_HIGH_RES_MODE_2:
-    case BH1750_ONE_TIME_LOW_RES_MODE:
-      // Send mode to sensor
-      metal_i2c_transfer(device->i2c, device->BH1750_I2CADDR, (unsigned char*)&mode, 1, &ack, 1);
+// Find the transport of a bus, false if the library drives it
+static int BH1750_owned(struct metal_i2c *i2c, unsigned int *index) {
+  for(unsigned int i = 0; i < BH1750_TRANSPORTS; i++) {
+    if(_transports[i].i2c && _transports[i].i2c == i2c) {
+      *index = i;
+      return true;
+    }
+  }
+  return false;
+}
 
-      // Wait a few moments to wake up
-      _delay_ms(10);
-      break;
+static int BH1750_i2cWrite(struct metal_i2c *i2c, unsigned char addr, unsigned int len, unsigned char *buf) {
+  unsigned int i;
+  if(BH1750_owned(i2c, &i)) {
+    return _transports[i].transfer(_transports[i].owner, addr, buf, len, NULL, 0);
+  }
+  return metal_i2c_write(i2c, addr, len, buf, METAL_I2C_STOP_ENABLE);
+}
 
-    default:
-      // Invalid measurement mode
-      printf("[BH1750] ERROR: Invalid mode\r\n");
-      break;
+// An owned bus always ends the read with a stop
+static int BH1750_i2cRead(struct metal_i2c *i2c, unsigned char addr, unsigned int len, unsigned char *buf,
+                          metal_i2c_stop_bit_t stop) {
+  unsigned int i;
+  if(BH1750_owned(i2c, &i)) {
+    return _transports[i].transfer(_transports[i].owner, addr, NULL, 0, buf, len);
+  }
+  return metal_i2c_read(i2c, addr, len, buf, stop);
+}
 
+static void BH1750_i2cBaud(struct metal_i2c *i2c, unsigned int hz) {
+  unsigned int i;
+  if(!BH1750_owned(i2c, &i)) {
+    metal_i2c_set_baud_rate(i2c, hz);
   }
+}
 
-  // Check result code
-  switch (ack) {
-    case 0:
-      device->BH1750_MODE = mode;
-      device->lastReadTimestamp = millis();
-      return true;
-    case 1: // too long for transmit buffer
-      printf("[BH1750] ERROR: too long for transmit buffer\r\n");
+// Count an error in the counters of a sensor
+static void BH1750_count(struct BH1750_sensor *device, BH1750_Error error) {
+  device->lastError = error;
+  switch (error) {
+    case BH1750_ERR_NACK:
+      device->stats.nacks++;
       break;
-    case 2: // received NACK on transmit of address
-      printf("[BH1750] ERROR: received NACK on transmit of address\r\n");
+    case BH1750_ERR_TIMEOUT:
+      device->stats.timeouts++;
       break;
-    case 3: // received NACK on transmit of data
-      printf("[BH1750] ERROR: received NACK on transmit of data\r\n");
+    case BH1750_ERR_INVALID_MODE:
+    case BH1750_ERR_NOT_CONFIGURED:
+      device->stats.invalidMode++;
       break;
-    case 4: // other error
-      printf("[BH1750] ERROR: other error\r\n");
+    case BH1750_ERR_OUT_OF_RANGE:
+      device->stats.outOfRange++;
       break;
     default:
-      printf("[BH1750] ERROR: undefined error\r\n");
       break;
   }
-
-  return false;
-
 }
 
-/**
- * Configure BH1750 MTreg value
- * MT reg = Measurement Time register
- * @param MTreg a value between 32 and 254. Default: 69
- * @return bool true if MTReg successful set
- * 		false if MTreg not changed or parameter out of range
- */
-int BH1750_setMTreg(struct BH1750_sensor *device, unsigned char MTreg) {
-  //Bug: lowest value seems to be 32!
-  if (MTreg <= 31 || MTreg > 254) {
-    printf("[BH1750] ERROR: MTreg out of range\r\n");
-    return false;
+// Record a failed call of a sensor and log it, outside interrupt context
+#define BH1750_fail(device, error, message) \
+  do { \
+    BH1750_count(device, error); \
+    if(!_interruptDepth) { \
+      BH1750_LOG(device, error, message); \
+    } \
+  } while(0)
+
+// Record a failed transfer of a sensor as a NACK or a timeout
+static void BH1750_transferFailed(struct BH1750_sensor *device, int ret) {
+  if(ret == BH1750_I2C_NACK) {
+    BH1750_fail(device, BH1750_ERR_NACK, "transfer not acknowledged");
+  } else {
+    BH1750_fail(device, BH1750_ERR_TIMEOUT, "transfer timed out");
   }
+}
+
+#ifdef BH1750_PROFILE
+// Cycle counter of the profile: rdcycle on the board, the delay service's
+// clock on other targets
+static inline uint32_t BH1750_cycles(void) {
+#if defined(__riscv)
+  uint32_t cycles;
+  __asm__ volatile ("rdcycle %0" : "=r"(cycles));
+  return cycles;
+#else
+  return ticks32();
+#endif
+}
 
+// Add the cycles a call took to the histogram of its operation
+static void BH1750_profileRecord(struct BH1750_sensor *device, BH1750_ProfileOp op, uint32_t cycles) {
   if(!device) {
-	  return false;
+    return;
+  }
+  struct BH1750_histogram *histogram = &device->profile[op];
+  unsigned int bucket = cycles ? 31 - __builtin_clz(cycles) : 0;
+  if(bucket >= BH1750_PROFILE_BUCKETS) {
+    bucket = BH1750_PROFILE_BUCKETS - 1;
+  }
+  if(histogram->buckets[bucket] != UINT16_MAX) {
+    histogram->buckets[bucket]++;
+  }
+  if(cycles > histogram->max) {
+    histogram->max = cycles;
   }
+}
 
-  unsigned char byte;
-  unsigned char ack = 5;
-  // Send MTreg and the current mode to the sensor
-  //   High bit: 01000_MT[7,6,5]
-  //    Low bit: 011_MT[4,3,2,1,0]
-  byte = (0b01000 << 3) | (MTreg >> 5);
-  metal_i2c_transfer(device->i2c, device->BH1750_I2CADDR, &byte, 1, &ack, 1);
+#define BH1750_PROFILE_BEGIN(start) uint32_t start = BH1750_cycles()
+#define BH1750_PROFILE_END(device, op, start) BH1750_profileRecord(device, op, BH1750_cycles() - (start))
+#else
+// Nothing left of the profile points: not a cycle spent
+#define BH1750_PROFILE_BEGIN(start)
+#define BH1750_PROFILE_END(device, op, start)
+#endif
 
-  byte = (0b011 << 5 )  | (MTreg & 0b11111);
-  metal_i2c_transfer(device->i2c, device->BH1750_I2CADDR, &byte, 1, &ack, 1);
+// Record a failed registration
+static void BH1750_registryFail(struct BH1750_registry *registry, BH1750_Error error, const char *message) {
+  registry->lastError = error;
+  BH1750_LOG(NULL, error, message);
+  (void)message;
+}
 
-  byte = device->BH1750_MODE;
-  metal_i2c_transfer(device->i2c, device->BH1750_I2CADDR, &byte, 1, &ack, 1);
+/**
+ * Initialize a TCA9548A-style I2C multiplexer
+ * The channel selection is unknown until the first BH1750_muxSelect().
+ * @param mux structure
+ * @param i2c Object pointer of the bus the mux sits on
+ * @param addr Address of the mux (0x70 ~ 0x77)
+ */
+void BH1750_muxInit(struct BH1750_mux *mux, struct metal_i2c *i2c, unsigned char addr) {
+  mux->i2c = i2c;
+  mux->addr = addr;
+  mux->channel = BH1750_MUX_NO_CHANNEL;
+  mux->sibling = mux;
+}
 
-  // Wait a few moments to wake up
-  _delay_ms(10);
+/**
+ * Declare another mux on the same bus
+ * Linked muxes close their channels when one of the others selects a
+ * channel, so sensors at the same address behind different muxes do not
+ * answer together, reads queued with BH1750_submitRead() included.
+ * @param mux structure
+ * @param other Mux to add to the muxes linked with mux
+ */
+void BH1750_muxLink(struct BH1750_mux *mux, struct BH1750_mux *other) {
+  struct BH1750_mux *next = other->sibling;
+  other->sibling = mux->sibling;
+  mux->sibling = next;
+}
 
-  // Check result code
-  switch (ack) {
-    case 0:
-    	device->BH1750_MTreg = MTreg;
-      return true;
-    case 1: // too long for transmit buffer
-      printf("[BH1750] ERROR: too long for transmit buffer\r\n");
-      break;
-    case 2: // received NACK on transmit of address
-      printf("[BH1750] ERROR: received NACK on transmit of address\r\n");
-      break;
-    case 3: // received NACK on transmit of data
-      printf("[BH1750] ERROR: received NACK on transmit of data\r\n");
-      break;
-    case 4: // other error
-      printf("[BH1750] ERROR: other error\r\n");
-      break;
-    default:
-      printf("[BH1750] ERROR: undefined error\r\n");
-      break;
+// Disconnect every channel of a mux
+static int BH1750_muxClose(struct BH1750_mux *mux) {
+  unsigned char control = 0;
+  if(BH1750_i2cWrite(mux->i2c, mux->addr, 1, &control) != 0) {
+    mux->channel = BH1750_MUX_NO_CHANNEL;
+    return false;
   }
-
-  return false;
+  mux->channel = BH1750_MUX_CLOSED;
+  return true;
 }
 
 /**
- * Checks whether enough time has gone to read a new value
- * @param maxWait a boolean if to wait for typical or maximum delay
- *                1 (true), 0 (false), default value is 0
- * @return a boolean if a new measurement is possible
- *
+ * Connect a mux channel to the bus
+ * The selected channel is cached, so selecting it again costs no bus
+ * transaction. Muxes linked with BH1750_muxLink() are closed first.
+ * @param mux structure, NULL for sensors wired to the bus directly
+ * @param channel Channel to select (0 ~ 7)
+ * @return true (1) if success, false (0) on a bus error or a channel above 7
  */
-int BH1750_measurementReady(struct BH1750_sensor *device, int maxWait) {
-  unsigned long delaytime = 0;
-  switch (device->BH1750_MODE) {
-    case BH1750_CONTINUOUS_HIGH_RES_MODE:
-    case BH1750_CONTINUOUS_HIGH_RES_MODE_2:
-    case BH1750_ONE_TIME_HIGH_RES_MODE:
-    case BH1750_ONE_TIME_HIGH_RES_MODE_2:
-      delaytime = maxWait ? (180 * device->BH1750_MTreg/(unsigned char)BH1750_DEFAULT_MTREG) : (120 * device->BH1750_MTreg/(unsigned char)BH1750_DEFAULT_MTREG);
-      break;
-    case BH1750_CONTINUOUS_LOW_RES_MODE:
-    case BH1750_ONE_TIME_LOW_RES_MODE:
-      // Send mode to sensor
-      delaytime = maxWait ? (24 * device->BH1750_MTreg/(unsigned char)BH1750_DEFAULT_MTREG) : (16 * device->BH1750_MTreg/(unsigned char)BH1750_DEFAULT_MTREG);
-      break;
-    default:
-      break;
+int BH1750_muxSelect(struct BH1750_mux *mux, unsigned char channel) {
+  if(!mux || mux->channel == channel) {
+    return true;
   }
-  // Wait for new measurement to be possible.
-  // Measurements have a maximum measurement time and a typical measurement
-  // time. The maxWait argument determines which measurement wait time is
-  // used when a one-time mode is being used. The typical (shorter)
-  // measurement time is used by default and if maxWait is set to True then
-  // the maximum measurement time will be used. See data sheet pages 2, 5
-  // and 7 for more details.
-  unsigned long long currentTimestamp = millis();
-    if (currentTimestamp - device->lastReadTimestamp >= delaytime) {
-      return true;
-    }
-    else
+  if(channel > 7) {
+    BH1750_LOG(NULL, BH1750_ERR_OUT_OF_RANGE, "no such mux channel");
+    return false;
+  }
+  for(struct BH1750_mux *other = mux->sibling; other != mux; other = other->sibling) {
+    if(other->channel != BH1750_MUX_CLOSED && !BH1750_muxClose(other)) {
       return false;
+    }
+  }
+  unsigned char control = 1 << channel;
+  if(BH1750_i2cWrite(mux->i2c, mux->addr, 1, &control) != 0) {
+    // Selection is unknown after a failed write
+    mux->channel = BH1750_MUX_NO_CHANNEL;
+    return false;
+  }
+  mux->channel = channel;
+  return true;
 }
 
 /**
- * Read light level from sensor
- * The return value range differs if the MTreg value is changed. The global
- * maximum value is noted in the square brackets.
- * @return Light level in lux (0.0 ~ 54612,5 [117758,203])
- * 	   -1 : no valid return value
- * 	   -2 : sensor not configured
+ * Initialize a sensor registry over caller-provided storage
+ * @param registry structure
+ * @param storage Array of sensor structures, owned by the caller
+ * @param capacity Number of elements in storage
  */
-float BH1750_readLightLevel(struct BH1750_sensor *device) {
+void BH1750_registryInit(struct BH1750_registry *registry, struct BH1750_sensor *storage, unsigned int capacity) {
+  registry->sensors = storage;
+  registry->capacity = capacity;
+  registry->count = 0;
+  registry->lastError = BH1750_OK;
+}
 
-  if (device->BH1750_MODE == BH1750_UNCONFIGURED) {
-    printf("[BH1750] Device is not configured!\r\n");
-    return -2.0;
+/**
+ * Look up a sensor by bus, mux channel and address
+ * @param registry structure
+ * @param i2c Object pointer connected to I2C bus
+ * @param mux Mux the sensor sits behind, NULL if none
+ * @param channel Mux channel, ignored if mux is NULL
+ * @param addr Address of the sensor
+ * @return the device structure, NULL if not registered
+ */
+struct BH1750_sensor *BH1750_registryFind(struct BH1750_registry *registry, struct metal_i2c *i2c,
+                                          struct BH1750_mux *mux, unsigned char channel, unsigned char addr) {
+  if(!mux) {
+    channel = 0;
   }
+  for(unsigned int i = 0; i < registry->count; i++) {
+    struct BH1750_sensor *device = &registry->sensors[i];
+    if(device->i2c == i2c && device->mux == mux && device->muxChannel == channel && device->BH1750_I2CADDR == addr) {
+      return device;
+    }
+  }
+  return NULL;
+}
 
-  // Measurement result will be stored here
-  float level = -1.0;
-
-  // Read two bytes from the sensor, which are low and high parts of the sensor
-  // value
-  unsigned char tmp[2] = {0, 0};
-  metal_i2c_read(device->i2c, device->BH1750_I2CADDR, 2, tmp, METAL_I2C_STOP_ENABLE);
-  level = (float)((tmp[0] << 8) | tmp[1]);
-
-  device->lastReadTimestamp = millis();
+// Find the slot of a sensor, taking a free one for a new sensor
+static struct BH1750_sensor *BH1750_registryAdd(struct BH1750_registry *registry, struct metal_i2c *i2c,
+                                                struct BH1750_mux *mux, unsigned char channel, unsigned char addr) {
+  struct BH1750_sensor *device = BH1750_registryFind(registry, i2c, mux, channel, addr);
+  if(device) {
+    return device;
+  }
+  if(registry->count >= registry->capacity) {
+    BH1750_registryFail(registry, BH1750_ERR_REGISTRY_FULL, "registry is full");
+    return NULL;
+  }
+  device = &registry->sensors[registry->count++];
+  memset(device, 0, sizeof(*device));
+  device->i2c = i2c;
+  device->mux = mux;
+  device->muxChannel = mux ? channel : 0;
+  device->BH1750_I2CADDR = addr;
+  device->BH1750_MTreg = BH1750_DEFAULT_MTREG;
+  device->BH1750_CONV_FACTOR = 1.2;
+  device->BH1750_MODE = BH1750_UNCONFIGURED;
+  BH1750_updateLuxScale(device);
+  return device;
+}
 
-  if (level != -1.0) {
-    // Print raw value if debug enabled
-    #ifdef BH1750_DEBUG
-    printf("[BH1750] Raw value: %f\r\n", level);
-    #endif
+// Check the arguments of a sensor and take its registry slot, forgetting
+// what the sensor held: it may have been power cycled since
+static struct BH1750_sensor *BH1750_prepare(struct BH1750_registry *registry, unsigned char addr,
+                                            struct metal_i2c *i2c, struct BH1750_mux *mux, unsigned char channel) {
 
-    if (device->BH1750_MTreg != BH1750_DEFAULT_MTREG) {
-      level *= (float)((unsigned char)BH1750_DEFAULT_MTREG/(float)device->BH1750_MTreg);
-      // Print MTreg factor if debug enabled
-      #ifdef BH1750_DEBUG
-      printf("[BH1750] MTreg factor: %f\r\n", (float)((unsigned char)BH1750_DEFAULT_MTREG/(float)device->BH1750_MTreg));
-      #endif
-    }
-    if (device->BH1750_MODE == BH1750_ONE_TIME_HIGH_RES_MODE_2 || device->BH1750_MODE == BH1750_CONTINUOUS_HIGH_RES_MODE_2) {
-      level /= 2;
-    }
-    // Convert raw value to lux
-    level /= device->BH1750_CONV_FACTOR;
+  struct BH1750_sensor *device;
 
-    // Print converted value if debug enabled
-    #ifdef BH1750_DEBUG
-    printf("[BH1750] Converted float value: %f\r\n", level);
-    #endif
+  if(addr != 0x23 && addr != 0x5C) {
+    BH1750_registryFail(registry, BH1750_ERR_BAD_ADDRESS, "wrong address");
+    return NULL;
+  }
+  // I2C is expected to be initialized outside this library
+  if(!i2c) {
+    BH1750_registryFail(registry, BH1750_ERR_NO_BUS, "I2C was not created");
+    return NULL;
   }
 
-  return level;
+  device = BH1750_registryAdd(registry, i2c, mux, channel, addr);
+  if(!device) {
+    return NULL;
+  }
+  device->op = BH1750_OP_NONE;
+  device->shadowMode = 0;
+  device->shadowMTreg = 0;
+  return device;
 }
+
+/**
+ * Register a sensor, configure it and set MTreg
+ * Calling it again for the same bus, mux channel and address reconfigures
+ * the registered sensor. Waits for the sensor to settle twice; see
+ * BH1750_beginAll() to start several sensors with one wait.
+ * @param registry structure
+ * @param mode Measurement mode
+ * @param addr Address of the sensor (0x23 or 0x5C, see datasheet)
+ * @param i2c Object pointer connected to I2C bus
+ * @param mux Mux the sensor sits behind, NULL if none
+ * @param channel Mux channel, ignored if mux is NULL
+ * @param MTreg MTreg value, 0 for default
+ * @return the device structure, NULL on failure
+ */
+struct BH1750_sensor *BH1750_beginAt(struct BH1750_registry *registry, BH1750_Mode mode, unsigned char addr,
+                                     struct metal_i2c *i2c, struct BH1750_mux *mux, unsigned char channel,
+                                     unsigned char MTreg) {
+
+  struct BH1750_sensor *device = BH1750_prepare(registry, addr, i2c, mux, channel);
+  if(!device) {
+    return NULL;
+  }
+
+  if(mode == BH1750_UNCONFIGURED) {
+    mode = BH1750_CONTINUOUS_HIGH_RES_MODE; // try set to default mode
+  }
+  if(!BH1750_configure(device, mode)) {
+    return NULL;
+  }
+
+  if(MTreg == 0) {
+	  MTreg = BH1750_DEFAULT_MTREG; // try set to default MTreg
+  }
+  if(!BH1750_setMTreg(device, MTreg))
+  {
+    return NULL;
+  }
+
+  return device;
+}
+
+/**
+ * Register and start several sensors, waiting for them to settle once
+ * The MTreg and mode commands go out to every sensor first, then the
+ * sensors settle together and each one is checked with a read of its data
+ * register, so startup takes one settle time instead of two per sensor.
+ * @param registry structure
+ * @param setups Sensors to start, as for BH1750_beginAt()
+ * @param count Number of setups
+ * @param devices Filled with the device structure of each setup, NULL for
+ *        the ones that failed
+ * @return number of sensors started
+ */
+unsigned int BH1750_beginAll(struct BH1750_registry *registry, const struct BH1750_setup *setups, unsigned int count,
+                             struct BH1750_sensor **devices) {
+  deadline_t settled = 0;
+  int waiting = false;
+  unsigned int started = 0;
+
+  for(unsigned int i = 0; i < count; i++) {
+    const struct BH1750_setup *setup = &setups[i];
+    struct BH1750_sensor *device = BH1750_prepare(registry, setup->addr, setup->i2c, setup->mux, setup->channel);
+    devices[i] = NULL;
+    if(!device) {
+      continue;
+    }
+    BH1750_Mode mode = setup->mode == BH1750_UNCONFIGURED ? BH1750_CONTINUOUS_HIGH_RES_MODE : setup->mode;
+    unsigned char MTreg = setup->MTreg == 0 ? BH1750_DEFAULT_MTREG : setup->MTreg;
+    // MTreg and mode together, the mode command also powers the sensor on
+    BH1750_Status status = BH1750_startSetRange(device, mode, MTreg);
+    if(status == BH1750_ERROR) {
+      continue;
+    }
+    if(status == BH1750_IN_PROGRESS && (!waiting || (int32_t)(device->opDeadline - settled) > 0)) {
+      settled = device->opDeadline;
+      waiting = true;
+    }
+    devices[i] = device;
+  }
+
+  // One wait, for the sensor that settles last
+  if(waiting) {
+    delayUntil(settled);
+  }
+
+  for(unsigned int i = 0; i < count; i++) {
+    unsigned char buf[2];
+    if(!devices[i]) {
+      continue;
+    }
+    BH1750_poll(devices[i]);
+    if(BH1750_read(devices[i], buf, 2) != 0) {
+      devices[i] = NULL;
+      continue;
+    }
+    started++;
+  }
+  return started;
+}
+
+/**
+ * Create and return a device structure with
+ * Configure sensor and set default MTreg
+ * Sensors are kept in a registry of BH1750_DEFAULT_SENSORS entries, keyed
+ * by bus and address; use BH1750_beginAt() for more sensors or sensors
+ * behind a mux.
+ * @param mode Measurement mode
+ * @param addr Address of the sensor (0x23 or 0x5C, see datasheet)
+ * @param i2c Object pointer connected to I2C bus
+ * @param MTreg MTreg value, 0 for default
+ * @return the device structure, NULL on failure
+ */
+struct BH1750_sensor *BH1750_begin(BH1750_Mode mode, unsigned char addr, struct metal_i2c *i2c, unsigned char MTreg) {
+  return BH1750_beginAt(&_registry, mode, addr, i2c, NULL, 0, MTreg);
+}
+
+// Address-phase probe: a one byte read, harmless to the devices scanned for
+static int BH1750_probe(struct metal_i2c *i2c, unsigned char addr, struct BH1750_scanResult *result) {
+  unsigned char byte;
+  result->probes++;
+  return BH1750_i2cRead(i2c, addr, 1, &byte, METAL_I2C_STOP_ENABLE) == 0;
+}
+
+// Probes of BH1750_scan() on a bus that exists
+static int BH1750_scanBus(struct BH1750_registry *registry, struct metal_i2c *i2c, struct BH1750_mux *muxes,
+                          unsigned int maxMuxes, struct BH1750_scanResult *result) {
+  static const unsigned char addrs[2] = { 0x23, 0x5C };
+  unsigned char direct = 0;
+
+  for(unsigned char addr = BH1750_MUX_FIRST_ADDR; addr <= BH1750_MUX_LAST_ADDR; addr++) {
+    if(!BH1750_probe(i2c, addr, result)) {
+      continue;
+    }
+    if(result->muxes == maxMuxes) {
+      // Untracked, so closed now: an open channel would put its sensors on
+      // the bus next to the ones probed below
+      unsigned char control = 0;
+      BH1750_LOG(NULL, BH1750_ERR_OUT_OF_RANGE, "no room for a mux");
+      if(BH1750_i2cWrite(i2c, addr, 1, &control) != 0) {
+        BH1750_LOG(NULL, BH1750_ERR_NACK, "mux write failed");
+        return false;
+      }
+      continue;
+    }
+    struct BH1750_mux *mux = &muxes[result->muxes++];
+    BH1750_muxInit(mux, i2c, addr);
+    if(mux != muxes) {
+      BH1750_muxLink(muxes, mux);
+    }
+    if(!BH1750_muxClose(mux)) {
+      BH1750_LOG(NULL, BH1750_ERR_NACK, "mux write failed");
+      return false;
+    }
+  }
+
+  for(unsigned int a = 0; a < 2; a++) {
+    if(BH1750_probe(i2c, addrs[a], result)) {
+      if(!BH1750_registryAdd(registry, i2c, NULL, 0, addrs[a])) {
+        return false;
+      }
+      direct |= 1 << a;
+      result->sensors++;
+    }
+  }
+
+  for(unsigned int m = 0; m < result->muxes; m++) {
+    for(unsigned char channel = 0; channel < 8; channel++) {
+      if(!BH1750_muxSelect(&muxes[m], channel)) {
+        BH1750_LOG(NULL, BH1750_ERR_NACK, "mux write failed");
+        return false;
+      }
+      for(unsigned int a = 0; a < 2; a++) {
+        if(!(direct & (1 << a)) && BH1750_probe(i2c, addrs[a], result)) {
+          if(!BH1750_registryAdd(registry, i2c, &muxes[m], channel, addrs[a])) {
+            return false;
+          }
+          result->sensors++;
+        }
+      }
+    }
+    // Leave it closed so the sensors on the bus itself answer alone
+    if(!BH1750_muxClose(&muxes[m])) {
+      BH1750_LOG(NULL, BH1750_ERR_NACK, "mux write failed");
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/**
+ * Find the BH1750s of a bus and register them, unconfigured
+ * Probes BH1750_MUX_FIRST_ADDR ~ BH1750_MUX_LAST_ADDR for TCA9548A-style
+ * muxes, links and closes the ones found, probes both sensor
+ * addresses on the bus itself, then on each mux channel in turn. An
+ * address that answers on the bus itself is not probed behind the muxes,
+ * where it would answer on every channel. Probes are one byte reads with
+ * no settle wait; start the sensors found with BH1750_beginAll(). Muxes
+ * past maxMuxes are closed and left out.
+ * @param registry structure
+ * @param i2c Object pointer connected to I2C bus
+ * @param muxes Storage for the muxes found, initialized by the scan
+ * @param maxMuxes Number of entries of muxes
+ * @param result Filled with what the scan found and how long it took
+ * @return true (1) if the scan completed, false (0) on a bus error or a
+ *         full registry
+ */
+int BH1750_scan(struct BH1750_registry *registry, struct metal_i2c *i2c, struct BH1750_mux *muxes,
+                unsigned int maxMuxes, struct BH1750_scanResult *result) {
+  uint32_t start = micros();
+  int ok = false;
+
+  memset(result, 0, sizeof(*result));
+  if(!i2c) {
+    BH1750_registryFail(registry, BH1750_ERR_NO_BUS, "I2C was not created");
+  } else {
+    ok = BH1750_scanBus(registry, i2c, muxes, maxMuxes, result);
+  }
+  // Set on every exit, failed scans took bus time too
+  result->micros = micros() - start;
+  return ok;
+}
+
+static const unsigned int BH1750_busHz[BH1750_BUS_SPEEDS] = { BH1750_BUS_FAST_HZ, BH1750_BUS_STANDARD_HZ };
+
+// Account one transaction of bytes payload bytes, falling back to standard
+// mode when fast mode fails too often; in interrupt context the window is
+// kept and the fallback left to the next transaction outside it
+static void BH1750_busAccount(struct BH1750_bus *bus, unsigned int bytes, int ret) {
+  if(!bus) {
+    return;
+  }
+  // START, address, payload, STOP
+  bus->bits[bus->speed] += 1 + 9 * (bytes + 1) + 1;
+  bus->transactions[bus->speed]++;
+  bus->windowTransactions++;
+  if(ret != 0) {
+    bus->errors[bus->speed]++;
+    bus->windowErrors++;
+  }
+  if(bus->speed == BH1750_BUS_FAST && bus->windowErrors > BH1750_BUS_MAX_ERRORS) {
+    if(_interruptDepth) {
+      return;
+    }
+    BH1750_LOG(NULL, BH1750_ERR_NACK, "too many errors in fast mode, bus falls back to standard mode");
+    BH1750_i2cBaud(bus->i2c, BH1750_BUS_STANDARD_HZ);
+    bus->speed = BH1750_BUS_STANDARD;
+    bus->fallbacks++;
+    bus->windowTransactions = 0;
+    bus->windowErrors = 0;
+  } else if(bus->windowTransactions >= BH1750_BUS_WINDOW) {
+    bus->windowTransactions = 0;
+    bus->windowErrors = 0;
+  }
+}
+
+// Select the mux channel of a sensor, accounting the control write if any
+static int BH1750_select(struct BH1750_sensor *device) {
+  struct BH1750_mux *mux = device->mux;
+  if(!mux || mux->channel == device->muxChannel) {
+    return true;
+  }
+  BH1750_PROFILE_BEGIN(start);
+  int ok = BH1750_muxSelect(mux, device->muxChannel);
+  BH1750_PROFILE_END(device, BH1750_PROF_I2C_WRITE, start);
+  BH1750_busAccount(device->bus, 1, ok ? 0 : -1);
+  return ok;
+}
+
+// Send a one byte command to a sensor, selecting its mux channel first
+static int BH1750_write(struct BH1750_sensor *device, unsigned char byte) {
+  int ret = BH1750_I2C_NACK;
+  device->stats.transfers++;
+  if(BH1750_select(device)) {
+    BH1750_PROFILE_BEGIN(start);
+    ret = BH1750_i2cWrite(device->i2c, device->BH1750_I2CADDR, 1, &byte);
+    BH1750_PROFILE_END(device, BH1750_PROF_I2C_WRITE, start);
+    BH1750_busAccount(device->bus, 1, ret);
+  }
+  if(ret != 0) {
+    // The sensor may or may not have taken the command
+    device->shadowMode = 0;
+    device->shadowMTreg = 0;
+    BH1750_transferFailed(device, ret);
+  }
+  return ret;
+}
+
+// Read the data register of a sensor, selecting its mux channel first
+static int BH1750_read(struct BH1750_sensor *device, unsigned char *buf, unsigned int len) {
+  int ret = BH1750_I2C_NACK;
+  device->stats.transfers++;
+  if(BH1750_select(device)) {
+    BH1750_PROFILE_BEGIN(start);
+    ret = BH1750_i2cRead(device->i2c, device->BH1750_I2CADDR, len, buf, METAL_I2C_STOP_ENABLE);
+    BH1750_PROFILE_END(device, BH1750_PROF_I2C_READ, start);
+    BH1750_busAccount(device->bus, len, ret);
+  }
+  if(ret != 0) {
+    BH1750_transferFailed(device, ret);
+  }
+  return ret;
+}
+
+// Probe read of every registered sensor on the bus
+static void BH1750_busProbe(struct BH1750_bus *bus, struct BH1750_registry *registry) {
+  unsigned char buf[2];
+  for(unsigned int probe = 0; probe < BH1750_BUS_PROBES; probe++) {
+    for(unsigned int i = 0; i < registry->count; i++) {
+      if(registry->sensors[i].i2c == bus->i2c) {
+        BH1750_read(&registry->sensors[i], buf, 2);
+      }
+    }
+  }
+}
+
+/**
+ * Bring up a bus at 400 kHz if its sensors work at that speed, else 100 kHz
+ * Fast mode is verified with BH1750_BUS_PROBES reads of every registered
+ * sensor on the bus. The bus falls back to standard mode when more than
+ * BH1750_BUS_MAX_ERRORS of them fail, and later when as many transactions
+ * fail within BH1750_BUS_WINDOW. Register the sensors first; they are
+ * linked to the bus for accounting.
+ * @param bus structure
+ * @param registry Registry of the sensors, NULL for the one of BH1750_begin()
+ * @param i2c Object pointer connected to I2C bus
+ * @return true (1) if the sensors answer at one of the speeds, otherwise false (0)
+ */
+int BH1750_busBringUp(struct BH1750_bus *bus, struct BH1750_registry *registry, struct metal_i2c *i2c) {
+  if(!registry) {
+    registry = &_registry;
+  }
+  if(!i2c) {
+    BH1750_LOG(NULL, BH1750_ERR_NO_BUS, "I2C was not created");
+    return false;
+  }
+  memset(bus, 0, sizeof(*bus));
+  bus->i2c = i2c;
+  for(unsigned int i = 0; i < registry->count; i++) {
+    if(registry->sensors[i].i2c == i2c) {
+      registry->sensors[i].bus = bus;
+    }
+  }
+
+  BH1750_i2cBaud(i2c, BH1750_BUS_FAST_HZ);
+  BH1750_busProbe(bus, registry);
+  if(bus->speed == BH1750_BUS_FAST) {
+    bus->windowTransactions = 0;
+    bus->windowErrors = 0;
+    return true;
+  }
+  // Fell back while probing, check standard mode from scratch
+  bus->windowTransactions = 0;
+  bus->windowErrors = 0;
+  uint32_t errors = bus->errors[BH1750_BUS_STANDARD];
+  BH1750_busProbe(bus, registry);
+  if(bus->errors[BH1750_BUS_STANDARD] - errors > BH1750_BUS_MAX_ERRORS) {
+    BH1750_LOG(NULL, BH1750_ERR_NACK, "sensors do not answer in standard mode");
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Average bus time of the transactions made at a speed
+ * @param bus structure
+ * @param speed BH1750_BUS_FAST or BH1750_BUS_STANDARD
+ * @return nanoseconds per transaction, 0 if none was made at that speed
+ */
+uint32_t BH1750_busTimeNs(const struct BH1750_bus *bus, BH1750_BusSpeed speed) {
+  if(speed >= BH1750_BUS_SPEEDS || bus->transactions[speed] == 0) {
+    return 0;
+  }
+  return (uint32_t)(bus->bits[speed] * 1000000000ULL / BH1750_busHz[speed] / bus->transactions[speed]);
+}
+
+// One-time modes start a new measurement every time they are sent
+static int BH1750_isContinuous(BH1750_Mode mode) {
+  switch (mode) {
+    case BH1750_CONTINUOUS_HIGH_RES_MODE:
+    case BH1750_CONTINUOUS_HIGH_RES_MODE_2:
+    case BH1750_CONTINUOUS_LOW_RES_MODE:
+      return true;
+    default:
+      return false;
+  }
+}
+
+/**
+ * Start configuring BH1750 with specified mode
+ * The mode command is sent right away; the sensor then needs
+ * BH1750_SETTLE_MS to wake up, which BH1750_poll() waits out.
+ * @param device structure
+ * @param mode Measurement mode
+ * @return BH1750_IN_PROGRESS if the command was sent,
+ *         BH1750_DONE if the sensor already measures continuously in mode,
+ *         BH1750_ERROR on an invalid mode, a bus error or while another
+ *         operation is still in progress
+ */
+BH1750_Status BH1750_startConfigure(struct BH1750_sensor *device, BH1750_Mode mode) {
+  if(!device) {
+    return BH1750_ERROR;
+  }
+  if(device->op != BH1750_OP_NONE) {
+    BH1750_fail(device, BH1750_ERR_BUSY, "operation in progress");
+    return BH1750_ERROR;
+  }
+
+  // Check measurement mode is valid
+  switch (mode) {
+    case BH1750_CONTINUOUS_HIGH_RES_MODE:
+    case BH1750_CONTINUOUS_HIGH_RES_MODE_2:
+    case BH1750_CONTINUOUS_LOW_RES_MODE:
+    case BH1750_ONE_TIME_HIGH_RES_MODE:
+    case BH1750_ONE_TIME_HIGH_RES_MODE_2:
+    case BH1750_ONE_TIME_LOW_RES_MODE:
+      break;
+
+    default:
+      // Invalid measurement mode
+      BH1750_fail(device, BH1750_ERR_INVALID_MODE, "invalid mode");
+      return BH1750_ERROR;
+  }
+
+  // Nothing to do if the sensor is already measuring continuously in
+  // this mode; one-time modes are sent again to start a new measurement
+  if(device->shadowMode == mode && device->BH1750_MODE == mode && BH1750_isContinuous(mode)) {
+    device->txElided++;
+    return BH1750_DONE;
+  }
+
+  // Send mode to sensor
+  if(BH1750_write(device, mode) != 0) {
+    return BH1750_ERROR;
+  }
+  device->shadowMode = mode;
+
+  // Wait a few moments to wake up
+  device->op = BH1750_OP_CONFIGURE;
+  device->pendingMode = mode;
+  device->opDeadline = deadlineAfter(BH1750_SETTLE_MS);
+  return BH1750_IN_PROGRESS;
+}
+
+// Send MTreg followed by a mode command, which applies it
+static BH1750_Status BH1750_startMTregMode(struct BH1750_sensor *device, BH1750_Mode mode, unsigned char MTreg) {
+  //Bug: lowest value seems to be 32!
+  if (MTreg <= 31 || MTreg > 254) {
+    BH1750_fail(device, BH1750_ERR_OUT_OF_RANGE, "MTreg out of range");
+    return BH1750_ERROR;
+  }
+
+  if(device->op != BH1750_OP_NONE) {
+    BH1750_fail(device, BH1750_ERR_BUSY, "operation in progress");
+    return BH1750_ERROR;
+  }
+
+  // In one-time modes the trailing mode command also starts the next
+  // measurement, so only continuous (or unconfigured) sensors skip it
+  if(device->shadowMTreg == MTreg && device->BH1750_MTreg == MTreg && device->BH1750_MODE == mode &&
+     (mode == BH1750_UNCONFIGURED || BH1750_isContinuous(mode))) {
+    device->txElided += 3;
+    return BH1750_DONE;
+  }
+
+  unsigned char byte;
+  int ret = 0;
+  // Send MTreg and the mode to the sensor, skipping the half of MTreg the
+  // sensor already holds
+  //   High bit: 01000_MT[7,6,5]
+  //    Low bit: 011_MT[4,3,2,1,0]
+  if(device->shadowMTreg == 0 || (device->shadowMTreg >> 5) != (MTreg >> 5)) {
+    byte = (0b01000 << 3) | (MTreg >> 5);
+    ret = BH1750_write(device, byte);
+  } else {
+    device->txElided++;
+  }
+  if(ret == 0 && (device->shadowMTreg == 0 || (device->shadowMTreg & 0b11111) != (MTreg & 0b11111))) {
+    byte = (0b011 << 5 )  | (MTreg & 0b11111);
+    ret = BH1750_write(device, byte);
+  } else if(ret == 0) {
+    device->txElided++;
+  }
+  if(ret == 0 && mode == BH1750_UNCONFIGURED) {
+    // No mode to send: 0x00 is POWER_DOWN. The sensor keeps MTreg for the
+    // mode command of BH1750_configure(), and nothing is converting.
+    device->shadowMTreg = MTreg;
+    device->BH1750_MTreg = MTreg;
+    BH1750_updateLuxScale(device);
+    return BH1750_DONE;
+  }
+  // The mode command applies the new MTreg
+  if(ret == 0) {
+    ret = BH1750_write(device, mode);
+  }
+  if(ret != 0) {
+    return BH1750_ERROR;
+  }
+  device->shadowMTreg = MTreg;
+  device->shadowMode = mode;
+
+  // Wait a few moments to wake up
+  device->op = BH1750_OP_SET_MTREG;
+  device->pendingMode = mode;
+  device->pendingMTreg = MTreg;
+  device->opDeadline = deadlineAfter(BH1750_SETTLE_MS);
+  return BH1750_IN_PROGRESS;
+}
+
+/**
+ * Start setting BH1750 MTreg value
+ * MT reg = Measurement Time register
+ * The MTreg and the current mode are sent right away; BH1750_poll() then
+ * waits out BH1750_SETTLE_MS. An unconfigured sensor gets the MTreg alone.
+ * @param device structure
+ * @param MTreg a value between 32 and 254. Default: 69
+ * @return BH1750_IN_PROGRESS if the commands were sent,
+ *         BH1750_DONE if the sensor already holds MTreg or is unconfigured,
+ *         BH1750_ERROR if MTreg is out of range, on a bus error or while
+ *         another operation is still in progress
+ */
+BH1750_Status BH1750_startSetMTreg(struct BH1750_sensor *device, unsigned char MTreg) {
+  if(!device) {
+    return BH1750_ERROR;
+  }
+  return BH1750_startMTregMode(device, device->BH1750_MODE, MTreg);
+}
+
+/**
+ * Start changing mode and MTreg together, with a single settle time
+ * @param device structure
+ * @param mode Measurement mode
+ * @param MTreg a value between 32 and 254
+ * @return same as BH1750_startSetMTreg(), BH1750_ERROR on an invalid mode
+ */
+BH1750_Status BH1750_startSetRange(struct BH1750_sensor *device, BH1750_Mode mode, unsigned char MTreg) {
+  if(!device) {
+    return BH1750_ERROR;
+  }
+  switch (mode) {
+    case BH1750_CONTINUOUS_HIGH_RES_MODE:
+    case BH1750_CONTINUOUS_HIGH_RES_MODE_2:
+    case BH1750_CONTINUOUS_LOW_RES_MODE:
+    case BH1750_ONE_TIME_HIGH_RES_MODE:
+    case BH1750_ONE_TIME_HIGH_RES_MODE_2:
+    case BH1750_ONE_TIME_LOW_RES_MODE:
+      return BH1750_startMTregMode(device, mode, MTreg);
+    default:
+      BH1750_fail(device, BH1750_ERR_INVALID_MODE, "invalid mode");
+      return BH1750_ERROR;
+  }
+}
+
+/**
+ * Advance the operation started by BH1750_startConfigure(),
+ * BH1750_startSetMTreg() or BH1750_startSetRange(). Never blocks; call it
+ * from the main loop until it stops returning BH1750_IN_PROGRESS.
+ * @param device structure
+ * @return BH1750_DONE once the sensor has settled (or if nothing was
+ *         started), BH1750_IN_PROGRESS while waiting,
+ *         BH1750_ERROR if device is NULL
+ */
+BH1750_Status BH1750_poll(struct BH1750_sensor *device) {
+  if(!device) {
+    return BH1750_ERROR;
+  }
+  if(device->op == BH1750_OP_NONE) {
+    return BH1750_DONE;
+  }
+
+  if(!deadlineReached(device->opDeadline)) {
+    return BH1750_IN_PROGRESS;
+  }
+  uint32_t currentTimestamp = ticks32();
+
+  switch (device->op) {
+    case BH1750_OP_CONFIGURE:
+      device->BH1750_MODE = device->pendingMode;
+      device->lastReadTimestamp = currentTimestamp;
+      BH1750_updateLuxScale(device);
+      break;
+    case BH1750_OP_SET_MTREG:
+      // The mode command sent with MTreg restarted the conversion
+      device->BH1750_MODE = device->pendingMode;
+      device->BH1750_MTreg = device->pendingMTreg;
+      device->lastReadTimestamp = currentTimestamp;
+      BH1750_updateLuxScale(device);
+      break;
+    default:
+      break;
+  }
+  device->op = BH1750_OP_NONE;
+  return BH1750_DONE;
+}
+
+// Blocking wrappers use this to wait for the started operation to settle
+static int BH1750_wait(struct BH1750_sensor *device, BH1750_Status status) {
+  if(!device) {
+    return false;
+  }
+  while(status == BH1750_IN_PROGRESS) {
+    // Sleeps in wfi until the sensor has settled
+    delayUntil(device->opDeadline);
+    status = BH1750_poll(device);
+  }
+  return status == BH1750_DONE;
+}
+
+/**
+ * Configure BH1750 with specified mode
+ * Blocks until the sensor has settled, see BH1750_startConfigure()
+ * @param device structure
+ * @param mode Measurement mode
+ * @return true (1) if success, otherwise false (0); the reason is left in
+ *         BH1750_lastError()
+ */
+int BH1750_configure(struct BH1750_sensor *device, BH1750_Mode mode) {
+  BH1750_PROFILE_BEGIN(start);
+  int ok = BH1750_wait(device, BH1750_startConfigure(device, mode));
+  BH1750_PROFILE_END(device, BH1750_PROF_CONFIGURE, start);
+  return ok;
+}
+
+/**
+ * Configure BH1750 MTreg value
+ * Blocks until the sensor has settled, see BH1750_startSetMTreg()
+ * MT reg = Measurement Time register
+ * @param MTreg a value between 32 and 254. Default: 69
+ * @return true (1) if MTreg is set, otherwise false (0); BH1750_lastError()
+ *         is BH1750_ERR_OUT_OF_RANGE if the parameter is out of range
+ */
+int BH1750_setMTreg(struct BH1750_sensor *device, unsigned char MTreg) {
+  BH1750_PROFILE_BEGIN(start);
+  int ok = BH1750_wait(device, BH1750_startSetMTreg(device, MTreg));
+  BH1750_PROFILE_END(device, BH1750_PROF_SET_MTREG, start);
+  return ok;
+}
+
+/**
+ * Conversion time of the configured mode and MTreg
+ * Measurements have a maximum measurement time and a typical measurement
+ * time. The maxWait argument determines which one is returned. See data
+ * sheet pages 2, 5 and 7 for more details.
+ * @param device structure
+ * @param maxWait a boolean if to use typical or maximum delay
+ * @return milliseconds, 0 if the sensor is not configured
+ */
+unsigned long BH1750_conversionTime(struct BH1750_sensor *device, int maxWait) {
+  unsigned long delaytime = 0;
+  switch (device->BH1750_MODE) {
+    case BH1750_CONTINUOUS_HIGH_RES_MODE:
+    case BH1750_CONTINUOUS_HIGH_RES_MODE_2:
+    case BH1750_ONE_TIME_HIGH_RES_MODE:
+    case BH1750_ONE_TIME_HIGH_RES_MODE_2:
+      delaytime = maxWait ? (180 * device->BH1750_MTreg/(unsigned char)BH1750_DEFAULT_MTREG) : (120 * device->BH1750_MTreg/(unsigned char)BH1750_DEFAULT_MTREG);
+      break;
+    case BH1750_CONTINUOUS_LOW_RES_MODE:
+    case BH1750_ONE_TIME_LOW_RES_MODE:
+      delaytime = maxWait ? (24 * device->BH1750_MTreg/(unsigned char)BH1750_DEFAULT_MTREG) : (16 * device->BH1750_MTreg/(unsigned char)BH1750_DEFAULT_MTREG);
+      break;
+    default:
+      break;
+  }
+  return delaytime;
+}
+
+/**
+ * Checks whether enough time has gone to read a new value
+ * @param maxWait a boolean if to wait for typical or maximum delay
+ *                1 (true), 0 (false), default value is 0
+ * @return a boolean if a new measurement is possible
+ *
+ */
+int BH1750_measurementReady(struct BH1750_sensor *device, int maxWait) {
+  // Wait for new measurement to be possible.
+  // The maxWait argument determines which measurement wait time is
+  // used when a one-time mode is being used. The typical (shorter)
+  // measurement time is used by default and if maxWait is set to True then
+  // the maximum measurement time will be used.
+  unsigned long delaytime = BH1750_conversionTime(device, maxWait);
+  // Unsigned difference stays correct across the tick wraparound
+    if (ticks32() - device->lastReadTimestamp >= msToTicks(delaytime)) {
+      return true;
+    }
+    else
+      return false;
+}
+
+/**
+ * Read the raw data register of the sensor, without converting it
+ * The sample records the mode, MTreg and time of the read, so it can be
+ * converted later, in batch or on another machine.
+ * @param device structure
+ * @param sample Filled with the count, mode, MTreg, timestamp and status
+ * @return sample status, BH1750_SAMPLE_OK if the count is valid
+ */
+BH1750_SampleStatus BH1750_readRaw(struct BH1750_sensor *device, struct BH1750_sample *sample) {
+  BH1750_PROFILE_BEGIN(start);
+  sample->raw = 0;
+  sample->mode = device->BH1750_MODE;
+  sample->MTreg = device->BH1750_MTreg;
+  sample->timestamp = 0;
+
+  if (device->BH1750_MODE == BH1750_UNCONFIGURED) {
+    BH1750_fail(device, BH1750_ERR_NOT_CONFIGURED, "device is not configured");
+    sample->status = BH1750_SAMPLE_NOT_CONFIGURED;
+    BH1750_PROFILE_END(device, BH1750_PROF_READ_RAW, start);
+    return sample->status;
+  }
+
+  // Read two bytes from the sensor, which are high and low parts of the sensor
+  // value
+  unsigned char tmp[2] = {0, 0};
+  int ret = BH1750_read(device, tmp, 2);
+  device->lastReadTimestamp = ticks32();
+  sample->timestamp = millis();
+  if (ret != 0) {
+    sample->status = BH1750_SAMPLE_READ_FAILED;
+    BH1750_PROFILE_END(device, BH1750_PROF_READ_RAW, start);
+    return sample->status;
+  }
+
+  sample->raw = (uint16_t)((tmp[0] << 8) | tmp[1]);
+  sample->status = BH1750_SAMPLE_OK;
+  BH1750_PROFILE_END(device, BH1750_PROF_READ_RAW, start);
+  return sample->status;
+}
+
+/**
+ * Power the sensor down
+ * A continuous measurement stops; the configured mode and MTreg are kept
+ * and the next mode command (BH1750_configure(), BH1750_trigger())
+ * powers the sensor on again.
+ * @param device structure
+ * @return true (1) if success, otherwise false (0)
+ */
+int BH1750_powerDown(struct BH1750_sensor *device) {
+  if(device->op != BH1750_OP_NONE) {
+    BH1750_fail(device, BH1750_ERR_BUSY, "operation in progress");
+    return false;
+  }
+  if(BH1750_write(device, BH1750_POWER_DOWN) != 0) {
+    return false;
+  }
+  device->shadowMode = 0;
+  return true;
+}
+
+/**
+ * Power the sensor on, waiting for a measurement command
+ * @param device structure
+ * @return true (1) if success, otherwise false (0)
+ */
+int BH1750_powerOn(struct BH1750_sensor *device) {
+  if(device->op != BH1750_OP_NONE) {
+    BH1750_fail(device, BH1750_ERR_BUSY, "operation in progress");
+    return false;
+  }
+  if(BH1750_write(device, BH1750_POWER_ON) != 0) {
+    return false;
+  }
+  device->shadowMode = 0;
+  return true;
+}
+
+/**
+ * Clear the data register
+ * Not accepted while the sensor is powered down, see BH1750_powerOn().
+ * @param device structure
+ * @return true (1) if success, otherwise false (0)
+ */
+int BH1750_reset(struct BH1750_sensor *device) {
+  if(device->op != BH1750_OP_NONE) {
+    BH1750_fail(device, BH1750_ERR_BUSY, "operation in progress");
+    return false;
+  }
+  if(BH1750_write(device, BH1750_RESET) != 0) {
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Sleep in wfi until a measurement is possible, see BH1750_measurementReady()
+ * @param device structure
+ * @param maxWait a boolean if to wait for typical or maximum delay
+ */
+void BH1750_sleepUntilReady(struct BH1750_sensor *device, int maxWait) {
+  delayUntil(device->lastReadTimestamp + msToTicks(BH1750_conversionTime(device, maxWait)));
+}
+
+/**
+ * Take one sample with the sensor powered only for its conversion
+ * Sends the one-time mode of the configured resolution, sleeps in wfi for
+ * the maximum conversion time and reads the result; the sensor powers
+ * down by itself after the conversion. A sensor configured in a
+ * continuous mode is left powered down: BH1750_configure() resumes it.
+ * @param device structure
+ * @param sample Filled as by BH1750_readRaw()
+ * @return sample status, BH1750_SAMPLE_OK if the count is valid
+ */
+BH1750_SampleStatus BH1750_readDutyCycled(struct BH1750_sensor *device, struct BH1750_sample *sample) {
+  // 0x1X continuous opcodes map to the 0x2X one-time opcodes
+  unsigned char mode = (unsigned char)((device->BH1750_MODE & 0x0F) | BH1750_ONE_TIME_HIGH_RES_MODE);
+
+  if(device->BH1750_MODE == BH1750_UNCONFIGURED || device->op != BH1750_OP_NONE) {
+    BH1750_readRaw(device, sample);
+    return sample->status;
+  }
+  if(BH1750_write(device, mode) != 0) {
+    device->shadowMode = 0;
+    sample->raw = 0;
+    sample->mode = device->BH1750_MODE;
+    sample->MTreg = device->BH1750_MTreg;
+    sample->timestamp = millis();
+    sample->status = BH1750_SAMPLE_READ_FAILED;
+    return sample->status;
+  }
+  device->shadowMode = mode;
+  device->lastReadTimestamp = ticks32();
+  BH1750_sleepUntilReady(device, 1);
+  BH1750_readRaw(device, sample);
+  // Powered down after the conversion, continuous or not
+  device->shadowMode = 0;
+  return sample->status;
+}
+
+/**
+ * Start a one-time conversion right away
+ * Unlike BH1750_startConfigure(), there is no settle wait: the conversion
+ * time counts from the command, and the sensor powers down by itself
+ * once the conversion is done.
+ * @param device structure, configured in a one-time mode
+ * @return true (1) if the conversion was started, otherwise false (0)
+ */
+int BH1750_trigger(struct BH1750_sensor *device) {
+  if(device->BH1750_MODE == BH1750_UNCONFIGURED) {
+    BH1750_fail(device, BH1750_ERR_NOT_CONFIGURED, "device is not configured");
+    return false;
+  }
+  if(BH1750_isContinuous(device->BH1750_MODE)) {
+    BH1750_fail(device, BH1750_ERR_INVALID_MODE, "trigger needs a one-time mode");
+    return false;
+  }
+  if(device->op != BH1750_OP_NONE) {
+    BH1750_fail(device, BH1750_ERR_BUSY, "operation in progress");
+    return false;
+  }
+  if(BH1750_write(device, device->BH1750_MODE) != 0) {
+    return false;
+  }
+  device->shadowMode = device->BH1750_MODE;
+  device->lastReadTimestamp = ticks32();
+  return true;
+}
+
+/**
+ * Read a finished one-time conversion and start the next one
+ * The one-time mode command follows the read after a repeated START, so
+ * both share one bus session and the next conversion starts as soon as
+ * the result is out. In a continuous mode this is BH1750_readRaw().
+ * @param device structure
+ * @param sample Filled as by BH1750_readRaw()
+ * @return true (1) if the next conversion was started, otherwise false (0)
+ */
+int BH1750_readRawRearm(struct BH1750_sensor *device, struct BH1750_sample *sample) {
+  unsigned char mode = (unsigned char)device->BH1750_MODE;
+  unsigned char tmp[2] = {0, 0};
+  int ret = -1;
+
+  if(BH1750_isContinuous(device->BH1750_MODE) || device->BH1750_MODE == BH1750_UNCONFIGURED ||
+     device->op != BH1750_OP_NONE) {
+    BH1750_readRaw(device, sample);
+    return false;
+  }
+  sample->mode = mode;
+  sample->MTreg = device->BH1750_MTreg;
+
+  device->stats.transfers++;
+  if(BH1750_select(device)) {
+    BH1750_PROFILE_BEGIN(start);
+    ret = BH1750_i2cRead(device->i2c, device->BH1750_I2CADDR, 2, tmp, METAL_I2C_STOP_DISABLE);
+    BH1750_PROFILE_END(device, BH1750_PROF_I2C_READ, start);
+    BH1750_busAccount(device->bus, 2, ret);
+  }
+  device->lastReadTimestamp = ticks32();
+  sample->timestamp = millis();
+  if(ret != 0) {
+    BH1750_transferFailed(device, ret);
+    sample->raw = 0;
+    sample->status = BH1750_SAMPLE_READ_FAILED;
+    return false;
+  }
+  sample->raw = (uint16_t)((tmp[0] << 8) | tmp[1]);
+  sample->status = BH1750_SAMPLE_OK;
+
+  device->stats.transfers++;
+  BH1750_PROFILE_BEGIN(start);
+  ret = BH1750_i2cWrite(device->i2c, device->BH1750_I2CADDR, 1, &mode);
+  BH1750_PROFILE_END(device, BH1750_PROF_I2C_WRITE, start);
+  BH1750_busAccount(device->bus, 1, ret);
+  if(ret != 0) {
+    device->shadowMode = 0;
+    BH1750_transferFailed(device, ret);
+    return false;
+  }
+  device->shadowMode = mode;
+  return true;
+}
+
+/**
+ * Convert a raw sample to lux
+ * @param sample Read with BH1750_readRaw()
+ * @param convFactor Correction factor of the sensor, typically 1.2
+ * @return Light level in lux (0.0 ~ 54612,5 [117758,203])
+ * 	   -1 : no valid return value
+ * 	   -2 : sensor not configured
+ */
+float BH1750_convertSample(const struct BH1750_sample *sample, float convFactor) {
+  if (sample->status == BH1750_SAMPLE_NOT_CONFIGURED) {
+    return -2.0;
+  }
+  if (sample->status != BH1750_SAMPLE_OK) {
+    return -1.0;
+  }
+
+  float level = (float)sample->raw;
+
+  // Print raw value if debug enabled
+  #ifdef BH1750_DEBUG
+  printf("[BH1750] Raw value: %f\r\n", level);
+  #endif
+
+  if (sample->MTreg != BH1750_DEFAULT_MTREG) {
+    level *= (float)((unsigned char)BH1750_DEFAULT_MTREG/(float)sample->MTreg);
+    // Print MTreg factor if debug enabled
+    #ifdef BH1750_DEBUG
+    printf("[BH1750] MTreg factor: %f\r\n", (float)((unsigned char)BH1750_DEFAULT_MTREG/(float)sample->MTreg));
+    #endif
+  }
+  if (sample->mode == BH1750_ONE_TIME_HIGH_RES_MODE_2 || sample->mode == BH1750_CONTINUOUS_HIGH_RES_MODE_2) {
+    level /= 2;
+  }
+  // Convert raw value to lux
+  level /= convFactor;
+
+  // Print converted value if debug enabled
+  #ifdef BH1750_DEBUG
+  printf("[BH1750] Converted float value: %f\r\n", level);
+  #endif
+
+  return level;
+}
+
+/**
+ * Convert a batch of raw samples to lux
+ * @param samples Read with BH1750_readRaw()
+ * @param lux Output, one value per sample, see BH1750_convertSample()
+ * @param count Number of samples
+ * @param convFactor Correction factor of the sensor, typically 1.2
+ */
+void BH1750_convertSamples(const struct BH1750_sample *samples, float *lux, unsigned int count, float convFactor) {
+  for (unsigned int i = 0; i < count; i++) {
+    lux[i] = BH1750_convertSample(&samples[i], convFactor);
+  }
+}
+
+/**
+ * Convert a batch of raw samples to millilux, without floating point
+ * The fixed-point scale is only recomputed when mode or MTreg change from
+ * one sample to the next.
+ * @param samples Read with BH1750_readRaw()
+ * @param millilux Output, one value per sample, 0 for invalid samples
+ * @param count Number of samples
+ * @param convFactor Correction factor of the sensor, typically 1.2
+ */
+void BH1750_convertSamplesMilliLux(const struct BH1750_sample *samples, uint32_t *millilux, unsigned int count, float convFactor) {
+  struct BH1750_sensor scale = { .BH1750_CONV_FACTOR = convFactor };
+  for (unsigned int i = 0; i < count; i++) {
+    if (samples[i].status != BH1750_SAMPLE_OK) {
+      millilux[i] = 0;
+      continue;
+    }
+    if (scale.luxMul == 0 || scale.BH1750_MODE != samples[i].mode || scale.BH1750_MTreg != samples[i].MTreg) {
+      scale.BH1750_MODE = samples[i].mode;
+      scale.BH1750_MTreg = samples[i].MTreg;
+      BH1750_updateLuxScale(&scale);
+    }
+    millilux[i] = BH1750_rawToMilliLux(&scale, samples[i].raw);
+  }
+}
+
+/**
+ * Read light level from sensor
+ * The return value range differs if the MTreg value is changed. The global
+ * maximum value is noted in the square brackets.
+ * @return Light level in lux (0.0 ~ 54612,5 [117758,203])
+ * 	   -1 : no valid return value
+ * 	   -2 : sensor not configured
+ */
+float BH1750_readLightLevel(struct BH1750_sensor *device) {
+  struct BH1750_sample sample;
+  BH1750_PROFILE_BEGIN(start);
+
+  // An unconfigured sensor is counted and logged by BH1750_readRaw()
+  BH1750_readRaw(device, &sample);
+  float level = BH1750_convertSample(&sample, device->BH1750_CONV_FACTOR);
+  BH1750_PROFILE_END(device, BH1750_PROF_READ_LIGHT_LEVEL, start);
+  return level;
+}
+
+/**
+ * Recompute the fixed-point lux scale of a sensor
+ * MTreg, mode and conversion factor are folded into one multiplier and
+ * shift, so BH1750_rawToMilliLux() needs no division and no float. Called
+ * whenever the mode or MTreg changes; call it after changing
+ * BH1750_CONV_FACTOR.
+ * @param device structure
+ */
+void BH1750_updateLuxScale(struct BH1750_sensor *device) {
+  // millilux = raw * 1000 * DEFAULT_MTREG / (CONV_FACTOR * MTreg [* 2])
+  uint64_t num = 1000ULL * BH1750_DEFAULT_MTREG * 1000000;
+  uint64_t den = (uint64_t)(device->BH1750_CONV_FACTOR * 1000000.0f + 0.5f) * device->BH1750_MTreg;
+  if (device->BH1750_MODE == BH1750_ONE_TIME_HIGH_RES_MODE_2 || device->BH1750_MODE == BH1750_CONTINUOUS_HIGH_RES_MODE_2) {
+    den *= 2;
+  }
+  if (den == 0) {
+    den = 1;
+  }
+  // Largest shift that keeps the multiplier in 32 bits; a conversion
+  // factor too small for that even at shift 0 saturates the multiplier
+  unsigned char shift = BH1750_LUX_SHIFT_MAX;
+  uint64_t mul = ((num << shift) + den / 2) / den;
+  while (mul > UINT32_MAX && shift > 0) {
+    shift--;
+    mul = ((num << shift) + den / 2) / den;
+  }
+  if (mul > UINT32_MAX) {
+    mul = UINT32_MAX;
+  }
+  device->luxMul = (uint32_t)mul;
+  device->luxShift = shift;
+}
+
+/**
+ * Convert a raw sensor count to millilux with the sensor's current scale
+ * Within one millilux of the exact value for every count and MTreg.
+ * @param device structure
+ * @param raw Data register value
+ * @return Light level in millilux (0 ~ 117758203)
+ */
+uint32_t BH1750_rawToMilliLux(const struct BH1750_sensor *device, uint16_t raw) {
+  // Round to nearest, no rounding term to add at shift 0
+  uint64_t half = device->luxShift ? 1ULL << (device->luxShift - 1) : 0;
+  return (uint32_t)(((uint64_t)raw * device->luxMul + half) >> device->luxShift);
+}
+
+/**
+ * Read light level from sensor in millilux, without floating point
+ * @param device structure
+ * @param millilux Light level in millilux (0 ~ 117758203)
+ * @return true (1) if success, false (0) if the sensor is not configured or
+ *         the read failed
+ */
+int BH1750_readMilliLux(struct BH1750_sensor *device, uint32_t *millilux) {
+  struct BH1750_sample sample;
+
+  if (BH1750_readRaw(device, &sample) != BH1750_SAMPLE_OK) {
+    return false;
+  }
+  *millilux = BH1750_rawToMilliLux(device, sample.raw);
+  return true;
+}
+
+/**
+ * Bus transactions of a sensor since it was registered
+ * @param device structure
+ * @param issued Transactions sent to the sensor, reads included
+ * @param elided Commands skipped because the sensor already held the value
+ */
+void BH1750_transactionCounts(const struct BH1750_sensor *device, uint32_t *issued, uint32_t *elided) {
+  *issued = device->stats.transfers;
+  *elided = device->txElided;
+}
+
+/**
+ * Error of the last failed call on a sensor
+ * Calls that succeed leave it as it is.
+ * @param device structure
+ * @return BH1750_OK (0) if no call has failed since the sensor was
+ *         registered or its counters were cleared
+ */
+BH1750_Error BH1750_lastError(const struct BH1750_sensor *device) {
+  return (BH1750_Error)device->lastError;
+}
+
+/**
+ * Counters of a sensor since it was registered or they were cleared
+ * Counted whether or not a log sink is installed; reads queued with
+ * BH1750_submitRead() count their transfers and errors too.
+ * @param device structure
+ * @param stats Filled with the counters
+ */
+void BH1750_getStats(const struct BH1750_sensor *device, struct BH1750_stats *stats) {
+  *stats = device->stats;
+}
+
+/**
+ * Clear the counters and the last error of a sensor
+ * @param device structure
+ */
+void BH1750_clearStats(struct BH1750_sensor *device) {
+  memset(&device->stats, 0, sizeof(device->stats));
+  device->txElided = 0;
+  device->lastError = BH1750_OK;
+}
+
+/**
+ * Name of an error, for log sinks
+ * @param error BH1750_Error
+ * @return constant string, "unknown" if error is out of range
+ */
+const char *BH1750_errorName(BH1750_Error error) {
+  static const char *const names[BH1750_ERRORS] = {
+    "ok", "nack", "timeout", "invalid mode", "out of range", "busy",
+    "not configured", "bad address", "no bus", "no device", "registry full",
+  };
+  if((unsigned int)error >= BH1750_ERRORS) {
+    return "unknown";
+  }
+  return names[error];
+}
+
+#ifdef BH1750_PROFILE
+/**
+ * Clear the cycle histograms of a sensor
+ * @param device structure
+ */
+void BH1750_profileClear(struct BH1750_sensor *device) {
+  memset(device->profile, 0, sizeof(device->profile));
+}
+
+// Append text, keeping room for the terminating NUL
+static unsigned int BH1750_append(char *buf, unsigned int size, unsigned int len, const char *text) {
+  while(*text && len + 1 < size) {
+    buf[len++] = *text++;
+  }
+  return len;
+}
+
+static unsigned int BH1750_appendNumber(char *buf, unsigned int size, unsigned int len, uint32_t value) {
+  char digits[11];
+  unsigned int n = sizeof(digits) - 1;
+  digits[n] = 0;
+  do {
+    digits[--n] = (char)('0' + value % 10);
+    value /= 10;
+  } while(value);
+  return BH1750_append(buf, size, len, &digits[n]);
+}
+
+/**
+ * Write the cycle histograms of a sensor as text, without stdio
+ * One line per operation that was called: its name, the number of calls,
+ * the longest call, then bucket:calls for each bucket that is not empty,
+ * e.g. "i2c_read n=100 max=5120 12:100". Bucket n holds the calls that took
+ * 2^n ~ 2^(n+1)-1 cycles.
+ * @param device structure
+ * @param buf Output, NUL-terminated, truncated to size
+ * @param size Size of buf
+ * @return length of the text
+ */
+unsigned int BH1750_profileDump(const struct BH1750_sensor *device, char *buf, unsigned int size) {
+  static const char *const names[BH1750_PROF_OPS] = {
+    "readLightLevel", "readRaw", "configure", "setMTreg", "i2c_write", "i2c_read",
+  };
+  unsigned int len = 0;
+  for(unsigned int op = 0; op < BH1750_PROF_OPS; op++) {
+    const struct BH1750_histogram *histogram = &device->profile[op];
+    uint32_t calls = 0;
+    for(unsigned int b = 0; b < BH1750_PROFILE_BUCKETS; b++) {
+      calls += histogram->buckets[b];
+    }
+    if(calls == 0) {
+      continue;
+    }
+    len = BH1750_append(buf, size, len, names[op]);
+    len = BH1750_append(buf, size, len, " n=");
+    len = BH1750_appendNumber(buf, size, len, calls);
+    len = BH1750_append(buf, size, len, " max=");
+    len = BH1750_appendNumber(buf, size, len, histogram->max);
+    for(unsigned int b = 0; b < BH1750_PROFILE_BUCKETS; b++) {
+      if(histogram->buckets[b]) {
+        len = BH1750_append(buf, size, len, " ");
+        len = BH1750_appendNumber(buf, size, len, b);
+        len = BH1750_append(buf, size, len, ":");
+        len = BH1750_appendNumber(buf, size, len, histogram->buckets[b]);
+      }
+    }
+    len = BH1750_append(buf, size, len, "\n");
+  }
+  if(size) {
+    buf[len] = 0;
+  }
+  return len;
+}
+#endif
@@ -17,11 +17,21 @@
 #ifndef BH1750_H
 #define BH1750_H
 
+#include <stdint.h>
 #include <metal/i2c.h>
+#include "delay.h"
 
 // Uncomment, to enable debug messages
 // #define BH1750_DEBUG
 
+// Uncomment, to leave the log sink and its messages out of the library,
+// see BH1750_setLogSink()
+// #define BH1750_NO_LOG
+
+// Uncomment, to record cycle histograms of the driver operations, see
+// BH1750_profileDump(); every file using BH1750.h must see the same setting
+// #define BH1750_PROFILE
+
 // No active state
 #define BH1750_POWER_DOWN 0x00
 
@@ -34,6 +44,60 @@
 // Default MTreg value
 #define BH1750_DEFAULT_MTREG 69
 
+// Time the sensor needs to settle after a mode or MTreg command
+#define BH1750_SETTLE_MS 10
+
+// Number of sensors BH1750_begin() can register, see BH1750_beginAt()
+// for more sensors with caller-provided storage
+#ifndef BH1750_DEFAULT_SENSORS
+#define BH1750_DEFAULT_SENSORS 4
+#endif
+
+// Upper bound of the fixed-point lux scale shift
+#define BH1750_LUX_SHIFT_MAX 24
+
+// Mux channel value when the selection is unknown
+#define BH1750_MUX_NO_CHANNEL 0xFF
+
+// Mux channel value when every channel is disconnected
+#define BH1750_MUX_CLOSED 0xFE
+
+// Addresses BH1750_scan() probes for TCA9548A-style muxes
+#define BH1750_MUX_FIRST_ADDR 0x70
+#define BH1750_MUX_LAST_ADDR 0x77
+
+// Bus speeds of BH1750_busBringUp(), fast mode first
+#define BH1750_BUS_FAST_HZ 400000
+#define BH1750_BUS_STANDARD_HZ 100000
+
+// Probe reads per sensor when a bus is brought up
+#ifndef BH1750_BUS_PROBES
+#define BH1750_BUS_PROBES 4
+#endif
+
+// A bus in fast mode falls back to standard mode when more transactions
+// than this fail within a window of BH1750_BUS_WINDOW transactions
+#ifndef BH1750_BUS_MAX_ERRORS
+#define BH1750_BUS_MAX_ERRORS 2
+#endif
+#ifndef BH1750_BUS_WINDOW
+#define BH1750_BUS_WINDOW 64
+#endif
+
+// Buckets of the cycle histograms, the last one takes everything longer
+#ifndef BH1750_PROFILE_BUCKETS
+#define BH1750_PROFILE_BUCKETS 24
+#endif
+
+// Return code of the Metal I2C calls for a NACK; other failures of a
+// transfer count as timeouts
+#define BH1750_I2C_NACK -1
+
+// Buses whose transfers can be handed to an owner, see BH1750_setTransport()
+#ifndef BH1750_TRANSPORTS
+#define BH1750_TRANSPORTS 2
+#endif
+
 // BH1750 sensor has two addresses which are 0x23 when ADDR pin connect to GND or not connect
 // and 0x5C when ADDR pin connect to  5V or 3.3V
 typedef enum
@@ -61,24 +125,240 @@ typedef enum
     BH1750_ONE_TIME_LOW_RES_MODE = 0x23
 } BH1750_Mode;
 
+// Result of the non-blocking operations
+typedef enum
+{
+	BH1750_DONE = 0,
+	BH1750_IN_PROGRESS,
+	BH1750_ERROR,
+} BH1750_Status;
+
+// Status of a raw sample
+typedef enum
+{
+	BH1750_SAMPLE_OK = 0,
+	BH1750_SAMPLE_NOT_CONFIGURED,
+	BH1750_SAMPLE_READ_FAILED,
+} BH1750_SampleStatus;
+
+// Error of a failed call, see BH1750_lastError()
+typedef enum
+{
+	BH1750_OK = 0,
+	BH1750_ERR_NACK, // the sensor or its mux did not acknowledge a transfer
+	BH1750_ERR_TIMEOUT, // a transfer did not complete, e.g. a device held the bus
+	BH1750_ERR_INVALID_MODE, // invalid mode, or a call the configured mode does not allow
+	BH1750_ERR_OUT_OF_RANGE, // argument out of range, e.g. MTreg
+	BH1750_ERR_BUSY, // another operation is still in progress
+	BH1750_ERR_NOT_CONFIGURED,
+	BH1750_ERR_BAD_ADDRESS,
+	BH1750_ERR_NO_BUS, // I2C was not created
+	BH1750_ERR_NO_DEVICE, // NULL device structure
+	BH1750_ERR_REGISTRY_FULL,
+	BH1750_ERRORS,
+} BH1750_Error;
+
+// Per-sensor counters, see BH1750_getStats()
+struct BH1750_stats {
+	uint32_t transfers; // bus transactions sent to the sensor, reads included
+	uint32_t nacks;
+	uint32_t timeouts;
+	uint32_t invalidMode; // invalid modes, and calls the configured mode does not allow
+	uint32_t outOfRange;
+	uint32_t staleReads; // reads that came before the result, see BH1750_readiness.c
+};
+
+// Operations profiled with BH1750_PROFILE
+typedef enum
+{
+	BH1750_PROF_READ_LIGHT_LEVEL = 0,
+	BH1750_PROF_READ_RAW,
+	BH1750_PROF_CONFIGURE,
+	BH1750_PROF_SET_MTREG,
+	BH1750_PROF_I2C_WRITE, // metal_i2c_write(), mux selects included
+	BH1750_PROF_I2C_READ, // metal_i2c_read()
+	BH1750_PROF_OPS,
+} BH1750_ProfileOp;
+
+// log2 histogram of the cycles an operation took: bucket n counts the
+// calls that took 2^n ~ 2^(n+1)-1 cycles, bucket 0 also the ones under 1
+struct BH1750_histogram {
+	uint16_t buckets[BH1750_PROFILE_BUCKETS]; // saturate at UINT16_MAX
+	uint32_t max; // longest call, cycles
+};
+
+// Raw sample with what is needed to convert it later
+struct BH1750_sample {
+	uint32_t timestamp; // millis() of the read
+	uint16_t raw; // data register value
+	uint8_t mode; // BH1750_Mode at the time of the read
+	uint8_t MTreg; // MTreg at the time of the read
+	uint8_t status; // BH1750_SampleStatus
+};
+
+// Operation waiting for the sensor to settle
+typedef enum
+{
+	BH1750_OP_NONE = 0,
+	BH1750_OP_CONFIGURE,
+	BH1750_OP_SET_MTREG, // MTreg and mode
+} BH1750_Op;
+
+// Speed of a bus brought up with BH1750_busBringUp()
+typedef enum
+{
+	BH1750_BUS_FAST = 0,
+	BH1750_BUS_STANDARD,
+	BH1750_BUS_SPEEDS,
+} BH1750_BusSpeed;
+
+// Speed and per-speed error accounting of a bus
+struct BH1750_bus {
+	struct metal_i2c *i2c;
+	unsigned char speed; // BH1750_BusSpeed in use
+	unsigned char fallbacks; // times the bus dropped to standard mode
+	uint16_t windowTransactions;
+	uint16_t windowErrors;
+	uint32_t transactions[BH1750_BUS_SPEEDS];
+	uint32_t errors[BH1750_BUS_SPEEDS]; // NACKed or failed transactions
+	uint64_t bits[BH1750_BUS_SPEEDS]; // SCL periods, START and STOP included
+};
+
+// TCA9548A-style I2C multiplexer, one control byte selects the channel
+struct BH1750_mux {
+	struct metal_i2c *i2c;
+	unsigned char addr; // 0x70 ~ 0x77
+	unsigned char channel; // selected channel, cached to skip redundant selects
+	struct BH1750_mux *sibling; // ring of the muxes linked on the bus, itself if none
+};
+
 //#ifdef 0 // implemet class i2c
 struct BH1750_sensor {
 	struct metal_i2c *i2c;
+	struct BH1750_bus *bus; // speed and error accounting, NULL if none
+	struct BH1750_mux *mux; // NULL if the sensor is wired to the bus directly
+	unsigned char muxChannel;
 	unsigned int BH1750_I2CADDR; // default is 0x23
 	unsigned char BH1750_MTreg; // default is BH1750_DEFAULT_MTREG;
 	// Correction factor used to calculate lux. Typical value is 1.2 but can
 	// range from 0.96 to 1.44. See the data sheet (p.2, Measurement Accuracy)
 	// for more information.
-	const float BH1750_CONV_FACTOR; // default is 1.2;
+	float BH1750_CONV_FACTOR; // default is 1.2;
 	BH1750_Mode BH1750_MODE; // default is BH1750_UNCONFIGURED;  // default is BH1750_CONTINUOUS_HIGH_RES_MODE
-	unsigned long long lastReadTimestamp;
+	uint32_t lastReadTimestamp; // ticks32() of the last read or command
+	BH1750_Op op; // default is BH1750_OP_NONE
+	BH1750_Mode pendingMode; // applied when op completes
+	unsigned char pendingMTreg; // applied when op completes
+	deadline_t opDeadline; // when op completes
+	uint32_t luxMul; // millilux = (raw * luxMul) >> luxShift
+	unsigned char luxShift;
+	unsigned char shadowMode; // mode the sensor last accepted, 0 if unknown
+	unsigned char shadowMTreg; // MTreg the sensor holds, 0 if unknown
+	uint32_t txElided; // commands skipped, the sensor already held the value
+	struct BH1750_stats stats;
+	unsigned char lastError; // BH1750_Error of the last failed call
+#ifdef BH1750_PROFILE
+	struct BH1750_histogram profile[BH1750_PROF_OPS];
+#endif
 };
 //#endif
 
+// One sensor to start with BH1750_beginAll()
+struct BH1750_setup {
+	BH1750_Mode mode; // BH1750_UNCONFIGURED for the default mode
+	unsigned char addr;
+	struct metal_i2c *i2c;
+	struct BH1750_mux *mux; // NULL if the sensor is wired to the bus directly
+	unsigned char channel;
+	unsigned char MTreg; // 0 for default
+};
+
+// Outcome of BH1750_scan()
+struct BH1750_scanResult {
+	unsigned int sensors; // registered by the scan
+	unsigned int muxes; // found and initialized
+	unsigned int probes; // address probes sent
+	uint32_t micros; // duration of the scan
+};
+
+// Sensors keyed by bus, mux channel and address, in caller-provided storage
+struct BH1750_registry {
+	struct BH1750_sensor *sensors;
+	unsigned int capacity;
+	unsigned int count;
+	unsigned char lastError; // BH1750_Error of the last failed registration
+};
+
+// Receives the errors of the library; device is NULL for errors of a bus,
+// mux or registry. Message is a short constant string.
+typedef void (*BH1750_logSink_t)(const struct BH1750_sensor *device, BH1750_Error error, const char *message);
+
+#ifdef BH1750_NO_LOG
+#define BH1750_LOG(device, error, message) ((void)0)
+#define BH1750_setLogSink(sink) ((void)(sink))
+#else
+#define BH1750_LOG(device, error, message) BH1750_log(device, error, message)
+void BH1750_setLogSink(BH1750_logSink_t sink);
+void BH1750_log(const struct BH1750_sensor *device, BH1750_Error error, const char *message);
+#endif
+
+// Does a write of txLen bytes then a read of rxLen bytes at addr, either
+// length may be 0. Returns 0, BH1750_I2C_NACK or another failure code like
+// the Metal I2C calls.
+typedef int (*BH1750_transfer_t)(void *owner, unsigned char addr, const unsigned char *tx, unsigned int txLen,
+                                 unsigned char *rx, unsigned int rxLen);
+
+void BH1750_interruptEnter(void);
+void BH1750_interruptExit(void);
+int BH1750_setTransport(struct metal_i2c *i2c, BH1750_transfer_t transfer, void *owner);
+
 struct BH1750_sensor* BH1750_begin(BH1750_Mode mode, unsigned char addr, struct metal_i2c *i2c, unsigned char MTreg);
+struct BH1750_sensor* BH1750_beginAt(struct BH1750_registry *registry, BH1750_Mode mode, unsigned char addr,
+                                     struct metal_i2c *i2c, struct BH1750_mux *mux, unsigned char channel,
+                                     unsigned char MTreg);
+unsigned int BH1750_beginAll(struct BH1750_registry *registry, const struct BH1750_setup *setups, unsigned int count,
+                             struct BH1750_sensor **devices);
+void BH1750_registryInit(struct BH1750_registry *registry, struct BH1750_sensor *storage, unsigned int capacity);
+struct BH1750_sensor* BH1750_registryFind(struct BH1750_registry *registry, struct metal_i2c *i2c,
+                                          struct BH1750_mux *mux, unsigned char channel, unsigned char addr);
+int BH1750_scan(struct BH1750_registry *registry, struct metal_i2c *i2c, struct BH1750_mux *muxes,
+                unsigned int maxMuxes, struct BH1750_scanResult *result);
+int BH1750_busBringUp(struct BH1750_bus *bus, struct BH1750_registry *registry, struct metal_i2c *i2c);
+uint32_t BH1750_busTimeNs(const struct BH1750_bus *bus, BH1750_BusSpeed speed);
+void BH1750_muxInit(struct BH1750_mux *mux, struct metal_i2c *i2c, unsigned char addr);
+void BH1750_muxLink(struct BH1750_mux *mux, struct BH1750_mux *other);
+int BH1750_muxSelect(struct BH1750_mux *mux, unsigned char channel);
 int BH1750_configure(struct BH1750_sensor *device, BH1750_Mode mode);
 int BH1750_setMTreg(struct BH1750_sensor *device, unsigned char MTreg);
+BH1750_Status BH1750_startConfigure(struct BH1750_sensor *device, BH1750_Mode mode);
+BH1750_Status BH1750_startSetMTreg(struct BH1750_sensor *device, unsigned char MTreg);
+BH1750_Status BH1750_startSetRange(struct BH1750_sensor *device, BH1750_Mode mode, unsigned char MTreg);
+BH1750_Status BH1750_poll(struct BH1750_sensor *device);
+unsigned long BH1750_conversionTime(struct BH1750_sensor *device, int maxWait);
 int BH1750_measurementReady(struct BH1750_sensor *device, int maxWait);
 float BH1750_readLightLevel(struct BH1750_sensor *device);
+void BH1750_updateLuxScale(struct BH1750_sensor *device);
+uint32_t BH1750_rawToMilliLux(const struct BH1750_sensor *device, uint16_t raw);
+int BH1750_readMilliLux(struct BH1750_sensor *device, uint32_t *millilux);
+BH1750_SampleStatus BH1750_readRaw(struct BH1750_sensor *device, struct BH1750_sample *sample);
+int BH1750_powerDown(struct BH1750_sensor *device);
+int BH1750_powerOn(struct BH1750_sensor *device);
+int BH1750_reset(struct BH1750_sensor *device);
+void BH1750_sleepUntilReady(struct BH1750_sensor *device, int maxWait);
+BH1750_SampleStatus BH1750_readDutyCycled(struct BH1750_sensor *device, struct BH1750_sample *sample);
+int BH1750_trigger(struct BH1750_sensor *device);
+int BH1750_readRawRearm(struct BH1750_sensor *device, struct BH1750_sample *sample);
+float BH1750_convertSample(const struct BH1750_sample *sample, float convFactor);
+void BH1750_convertSamples(const struct BH1750_sample *samples, float *lux, unsigned int count, float convFactor);
+void BH1750_transactionCounts(const struct BH1750_sensor *device, uint32_t *issued, uint32_t *elided);
+void BH1750_convertSamplesMilliLux(const struct BH1750_sample *samples, uint32_t *millilux, unsigned int count, float convFactor);
+BH1750_Error BH1750_lastError(const struct BH1750_sensor *device);
+void BH1750_getStats(const struct BH1750_sensor *device, struct BH1750_stats *stats);
+void BH1750_clearStats(struct BH1750_sensor *device);
+const char *BH1750_errorName(BH1750_Error error);
+#ifdef BH1750_PROFILE
+void BH1750_profileClear(struct BH1750_sensor *device);
+unsigned int BH1750_profileDump(const struct BH1750_sensor *device, char *buf, unsigned int size);
+#endif
 
 #endif // BH1750_H
@@ -0,0 +1,164 @@
+/*
+
+  Non-blocking reads of BH1750 sensors through the shared-bus arbiter.
+
+*/
+#include <stdbool.h>
+#include <stddef.h>
+#include "BH1750_async.h"
+
+// Index of the mux control byte; the sibling closes go right before it
+#define BH1750_READ_CONTROL BH1750_ASYNC_MAX_SIBLINGS
+
+static const unsigned char BH1750_closeAll = 0;
+
+// At bus grant: skip the mux select if the channel is already connected,
+// else close the linked muxes that may be open first. Other requests may
+// have gone out since submit, so the cached channels are only valid now.
+static void BH1750_readDispatch(struct i2cRequest *request, void *arg) {
+  struct BH1750_read *read = (struct BH1750_read *)arg;
+  struct BH1750_sensor *device = read->device;
+  struct BH1750_mux *mux = device->mux;
+  if(mux->channel == device->muxChannel) {
+    request->first = BH1750_READ_CONTROL + 1;
+    return;
+  }
+  unsigned int first = BH1750_READ_CONTROL;
+  for(struct BH1750_mux *other = mux->sibling; other != mux; other = other->sibling) {
+    if(other->channel != BH1750_MUX_CLOSED && first > 0) {
+      read->transactions[--first] = (struct i2cTransaction){ .addr = other->addr, .tx = &BH1750_closeAll,
+                                                             .txLen = 1 };
+      other->channel = BH1750_MUX_CLOSED;
+    }
+  }
+  request->first = first;
+  read->control = 1 << device->muxChannel;
+  mux->channel = device->muxChannel;
+}
+
+static void BH1750_readComplete(struct i2cRequest *request, void *arg) {
+  struct BH1750_read *read = (struct BH1750_read *)arg;
+  struct BH1750_sensor *device = read->device;
+  device->lastReadTimestamp = ticks32();
+  read->sample.timestamp = millis();
+  if(request->status != I2C_OK) {
+    if(device->mux && read->request.first <= BH1750_READ_CONTROL) {
+      // Selections are unknown after a failed write
+      struct BH1750_mux *mux = device->mux;
+      do {
+        mux->channel = BH1750_MUX_NO_CHANNEL;
+        mux = mux->sibling;
+      } while(mux != device->mux);
+    }
+    // Counted, not logged: the log sink may not be safe in interrupt context
+    if(request->status == I2C_NACK) {
+      device->stats.nacks++;
+      device->lastError = BH1750_ERR_NACK;
+    } else {
+      device->stats.timeouts++;
+      device->lastError = BH1750_ERR_TIMEOUT;
+    }
+    read->sample.status = BH1750_SAMPLE_READ_FAILED;
+  } else {
+    read->sample.raw = (uint16_t)((read->buf[0] << 8) | read->buf[1]);
+    read->sample.status = BH1750_SAMPLE_OK;
+  }
+  if(read->done) {
+    read->done(read, read->arg);
+  }
+}
+
+/**
+ * Queue a read of the sensor's data register and return
+ * Same sample as BH1750_readRaw(), delivered by the I2C interrupt. The
+ * read structure must stay valid until the read completes, and the sensor
+ * must not be used through the blocking calls meanwhile. Identical reads
+ * of a sensor wired to the bus directly are coalesced by the arbiter.
+ * @param client Bus client of the BH1750 driver
+ * @param read structure, filled in here
+ * @param device structure
+ * @param done Called in interrupt context with the sample, may be NULL
+ * @param arg Passed to done
+ * @return true (1) if queued, false (0) if the sensor is not configured or
+ *         the read structure is still in flight
+ */
+int BH1750_submitRead(struct i2cArbiterClient *client, struct BH1750_read *read, struct BH1750_sensor *device,
+                      BH1750_readDone_t done, void *arg) {
+  if(read->request.status == I2C_PENDING) {
+    return false;
+  }
+  read->device = device;
+  read->done = done;
+  read->arg = arg;
+  read->sample.raw = 0;
+  read->sample.mode = device->BH1750_MODE;
+  read->sample.MTreg = device->BH1750_MTreg;
+  read->sample.timestamp = 0;
+  if(device->BH1750_MODE == BH1750_UNCONFIGURED) {
+    read->sample.status = BH1750_SAMPLE_NOT_CONFIGURED;
+    return false;
+  }
+
+  device->stats.transfers++;
+  struct i2cTransaction *control = &read->transactions[BH1750_READ_CONTROL];
+  *control = (struct i2cTransaction){ .tx = &read->control, .txLen = 1 };
+  control[1] = (struct i2cTransaction){ .addr = (unsigned char)device->BH1750_I2CADDR,
+                                        .rx = read->buf, .rxLen = 2 };
+  read->request.done = BH1750_readComplete;
+  read->request.arg = read;
+  if(device->mux) {
+    control->addr = device->mux->addr;
+    read->request.transactions = read->transactions;
+    read->request.count = BH1750_READ_CONTROL + 2;
+    read->request.dispatch = BH1750_readDispatch;
+  } else {
+    read->request.transactions = &control[1];
+    read->request.count = 1;
+    read->request.dispatch = NULL;
+  }
+  return i2cArbiterSubmit(client, &read->request);
+}
+
+/**
+ * Sleep until a submitted read completes
+ * @param client Bus client the read was submitted by
+ * @param read structure
+ * @return sample status, BH1750_SAMPLE_OK if read->sample.raw is valid
+ */
+BH1750_SampleStatus BH1750_waitRead(struct i2cArbiterClient *client, struct BH1750_read *read) {
+  i2cArbiterWait(client, &read->request);
+  return (BH1750_SampleStatus)read->sample.status;
+}
+
+// Blocking transfer of the library on a bus owned by the arbiter
+static int BH1750_arbiterTransfer(void *owner, unsigned char addr, const unsigned char *tx, unsigned int txLen,
+                                  unsigned char *rx, unsigned int rxLen) {
+  struct i2cArbiterClient *client = (struct i2cArbiterClient *)owner;
+  struct i2cTransaction transaction = { .addr = addr, .tx = tx, .txLen = txLen, .rx = rx, .rxLen = rxLen };
+  struct i2cRequest request = { .transactions = &transaction, .count = 1 };
+  if(!i2cArbiterSubmit(client, &request)) {
+    return -1;
+  }
+  switch (i2cArbiterWait(client, &request)) {
+    case I2C_OK:
+      return 0;
+    case I2C_NACK:
+      return BH1750_I2C_NACK;
+    default:
+      return -1;
+  }
+}
+
+/**
+ * Send the blocking calls of the library on a bus through the arbiter
+ * Configuration, blocking reads and mux selections of the sensors on the
+ * bus are queued as requests of client, so they no longer race the engine.
+ * They sleep until their request completes and must not be called from
+ * interrupt context. Attach before BH1750_beginAt() of the bus.
+ * @param i2c Object pointer of the bus the arbiter drives
+ * @param client Bus client of the BH1750 driver
+ * @return true (1) if success, otherwise false (0)
+ */
+int BH1750_attachArbiter(struct metal_i2c *i2c, struct i2cArbiterClient *client) {
+  return BH1750_setTransport(i2c, BH1750_arbiterTransfer, client);
+}
@@ -0,0 +1,50 @@
+/*
+
+  Non-blocking reads of BH1750 sensors through the shared-bus arbiter.
+
+  BH1750_submitRead() queues the mux select (when the channel changes,
+  after closing the open muxes linked with it) and the 2-byte data read as
+  one request of the sensor's bus client, then returns; the CPU is free
+  while the bytes go over the bus. The sample is filled in and the
+  callback called from the I2C interrupt when the read completes.
+
+  BH1750_attachArbiter() sends the blocking calls of the library on the
+  bus through the arbiter as well.
+
+*/
+
+#ifndef BH1750_ASYNC_H
+#define BH1750_ASYNC_H
+
+#include "BH1750.h"
+#include "i2c_arbiter.h"
+
+// Linked muxes a read can close before selecting its channel; the eight
+// addresses of a TCA9548A leave 7 others on a bus
+#ifndef BH1750_ASYNC_MAX_SIBLINGS
+#define BH1750_ASYNC_MAX_SIBLINGS (BH1750_MUX_LAST_ADDR - BH1750_MUX_FIRST_ADDR)
+#endif
+
+struct BH1750_read;
+
+typedef void (*BH1750_readDone_t)(struct BH1750_read *read, void *arg);
+
+// One read in flight, owned by the arbiter until it completes
+struct BH1750_read {
+	struct BH1750_sensor *device;
+	struct i2cRequest request;
+	// Sibling mux closes, mux control byte, data register
+	struct i2cTransaction transactions[BH1750_ASYNC_MAX_SIBLINGS + 2];
+	unsigned char control;
+	unsigned char buf[2];
+	struct BH1750_sample sample; // valid once request.status is not I2C_PENDING
+	BH1750_readDone_t done; // NULL if the caller waits or polls
+	void *arg;
+};
+
+int BH1750_submitRead(struct i2cArbiterClient *client, struct BH1750_read *read, struct BH1750_sensor *device,
+                      BH1750_readDone_t done, void *arg);
+BH1750_SampleStatus BH1750_waitRead(struct i2cArbiterClient *client, struct BH1750_read *read);
+int BH1750_attachArbiter(struct metal_i2c *i2c, struct i2cArbiterClient *client);
+
+#endif // BH1750_ASYNC_H
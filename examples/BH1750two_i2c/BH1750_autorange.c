@@ -0,0 +1,162 @@
+/*
+
+  Auto-ranging for the BH1750.
+
+*/
+#include <stdbool.h>
+#include <stddef.h>
+#include "BH1750_autorange.h"
+
+// MTreg the sensor takes
+#define BH1750_AUTORANGE_MTREG_MIN 32
+#define BH1750_AUTORANGE_MTREG_MAX 254
+
+// Range families, by sensitivity and conversion time per MTreg
+struct BH1750_family {
+	unsigned char continuous; // mode in continuous and one-time measurement
+	unsigned char oneTime;
+	unsigned char gain; // counts per MTreg, relative to H-resolution
+	unsigned char step; // counts the data register resolves
+	unsigned char maxMs; // maximum conversion time at the default MTreg
+};
+
+static const struct BH1750_family BH1750_families[3] = {
+  { BH1750_CONTINUOUS_LOW_RES_MODE, BH1750_ONE_TIME_LOW_RES_MODE, 1, 4, 24 },
+  { BH1750_CONTINUOUS_HIGH_RES_MODE, BH1750_ONE_TIME_HIGH_RES_MODE, 1, 1, 180 },
+  { BH1750_CONTINUOUS_HIGH_RES_MODE_2, BH1750_ONE_TIME_HIGH_RES_MODE_2, 2, 1, 180 },
+};
+
+static const struct BH1750_family* BH1750_familyOf(BH1750_Mode mode) {
+  for (unsigned int f = 0; f < sizeof(BH1750_families) / sizeof(BH1750_families[0]); f++) {
+    if (BH1750_families[f].continuous == mode || BH1750_families[f].oneTime == mode) {
+      return &BH1750_families[f];
+    }
+  }
+  return NULL;
+}
+
+static int BH1750_isOneTime(BH1750_Mode mode) {
+  return mode == BH1750_ONE_TIME_HIGH_RES_MODE || mode == BH1750_ONE_TIME_HIGH_RES_MODE_2 ||
+         mode == BH1750_ONE_TIME_LOW_RES_MODE;
+}
+
+/**
+ * Initialize auto-ranging with the default band, target and time budget
+ * @param autoRange structure
+ */
+void BH1750_autoRangeInit(struct BH1750_autoRange *autoRange) {
+  autoRange->target = BH1750_AUTORANGE_TARGET;
+  autoRange->low = BH1750_AUTORANGE_LOW;
+  autoRange->high = BH1750_AUTORANGE_HIGH;
+  autoRange->maxMs = BH1750_AUTORANGE_MAX_MS;
+  autoRange->changes = 0;
+}
+
+/**
+ * Pick the range for the next conversion from the last count
+ * Continuous sensors stay continuous and one-time sensors stay one-time.
+ * Every family gets the lowest MTreg that reaches the target, within the
+ * time budget and so the predicted count stays below high. The fastest
+ * family that reaches the target wins; when none does, the one that
+ * resolves the most counts.
+ * @param autoRange structure
+ * @param mode Mode the count was measured in
+ * @param MTreg MTreg the count was measured with
+ * @param raw Data register value
+ * @param newMode Mode for the next conversion
+ * @param newMTreg MTreg for the next conversion
+ * @return true (1) if the range should change, otherwise false (0)
+ */
+int BH1750_autoRangeSelect(const struct BH1750_autoRange *autoRange, BH1750_Mode mode, unsigned char MTreg,
+                           uint16_t raw, BH1750_Mode *newMode, unsigned char *newMTreg) {
+  const struct BH1750_family *current = BH1750_familyOf(mode);
+  const struct BH1750_family *best = &BH1750_families[0];
+  uint32_t bestMTreg = BH1750_AUTORANGE_MTREG_MIN, bestCount = 0, bestMs = UINT32_MAX;
+
+  *newMode = mode;
+  *newMTreg = MTreg;
+  if (current == NULL) {
+    return false;
+  }
+
+  // Hysteresis: keep the range while the count is inside the band
+  if (raw / current->step >= autoRange->low && raw <= autoRange->high) {
+    return false;
+  }
+
+  // Counts are proportional to gain * MTreg; a saturated count stands for
+  // a light level no range resolves, a count of 0 for one just above 0
+  uint32_t gain = current->gain * MTreg;
+  uint32_t count = raw == 0xFFFF ? UINT32_MAX / 2 : raw < current->step ? 1 : raw;
+
+  for (unsigned int f = 0; f < sizeof(BH1750_families) / sizeof(BH1750_families[0]); f++) {
+    const struct BH1750_family *family = &BH1750_families[f];
+    uint32_t limit = (uint32_t)autoRange->maxMs * BH1750_DEFAULT_MTREG / family->maxMs;
+    uint32_t next = ((uint64_t)autoRange->target * family->step * gain + count * family->gain - 1) /
+                    ((uint64_t)count * family->gain);
+    if (limit > BH1750_AUTORANGE_MTREG_MAX) {
+      limit = BH1750_AUTORANGE_MTREG_MAX;
+    }
+    if (next > limit) {
+      next = limit;
+    }
+    if (next < BH1750_AUTORANGE_MTREG_MIN) {
+      next = BH1750_AUTORANGE_MTREG_MIN;
+    }
+    uint64_t predicted = (uint64_t)count * family->gain * next / gain;
+    // Out of the budget even at the lowest MTreg, or too close to saturation
+    if (next > limit || predicted > autoRange->high) {
+      continue;
+    }
+    uint32_t resolved = (uint32_t)(predicted / family->step);
+    uint32_t ms = family->maxMs * next;
+    int reaches = resolved >= autoRange->target, bestReaches = bestCount >= autoRange->target;
+    if (reaches > bestReaches || (reaches && ms < bestMs) ||
+        (!reaches && !bestReaches && (resolved > bestCount || (resolved == bestCount && ms < bestMs)))) {
+      best = family;
+      bestMTreg = next;
+      bestCount = resolved;
+      bestMs = ms;
+    }
+  }
+
+  // When no range keeps the count below high, best stays the least
+  // sensitive and fastest one
+  *newMode = (BH1750_Mode)(BH1750_isOneTime(mode) ? best->oneTime : best->continuous);
+  *newMTreg = (unsigned char)bestMTreg;
+  return *newMode != mode || *newMTreg != MTreg;
+}
+
+/**
+ * Retune a sensor after a read
+ * The count must have been measured with the sensor's current mode and
+ * MTreg, e.g. from BH1750_readRaw().
+ * @param autoRange structure
+ * @param device structure
+ * @param raw Data register value
+ * @return BH1750_DONE if the range is kept, otherwise the status of
+ *         BH1750_startSetRange(); poll the sensor until it is done
+ */
+BH1750_Status BH1750_autoRangeUpdate(struct BH1750_autoRange *autoRange, struct BH1750_sensor *device, uint16_t raw) {
+  BH1750_Mode mode;
+  unsigned char MTreg;
+
+  if (!BH1750_autoRangeSelect(autoRange, device->BH1750_MODE, device->BH1750_MTreg, raw, &mode, &MTreg)) {
+    return BH1750_DONE;
+  }
+  autoRange->changes++;
+  return BH1750_startSetRange(device, mode, MTreg);
+}
+
+/**
+ * Effective resolution of a sensor in its current range
+ * In L-resolution mode this is the 4 counts the data register resolves.
+ * @param device structure
+ * @return millilux per resolved count
+ */
+uint32_t BH1750_autoRangeResolution(const struct BH1750_sensor *device) {
+  const struct BH1750_family *family = BH1750_familyOf(device->BH1750_MODE);
+  uint64_t step = family ? family->step : 1;
+  uint64_t half = device->luxShift ? 1ULL << (device->luxShift - 1) : 0;
+  return (uint32_t)((step * device->luxMul + half) >> device->luxShift);
+}
@@ -0,0 +1,46 @@
+/*
+
+  Auto-ranging for the BH1750.
+
+  From the last raw count the engine predicts the mode and MTreg that put
+  the next count near a target, the way a camera does autoexposure. The
+  target is a small fraction of full scale, so the reading keeps headroom
+  for a step up in light. Of the ranges that reach it, the one with the
+  shortest conversion wins: L-resolution mode in bright light, where it
+  loses nothing, H-resolution mode 2 in dim light. Conversions never exceed
+  a time budget; below the light level where the budget cannot reach the
+  target, the most sensitive range within it is used. The range only
+  changes when a count leaves the [low, high] band, so readings near a range
+  boundary do not flap. A saturated count jumps straight to the least
+  sensitive range, which cannot saturate below 117758 lx.
+
+*/
+
+#ifndef BH1750_AUTORANGE_H
+#define BH1750_AUTORANGE_H
+
+#include "BH1750.h"
+
+// Defaults: aim at 1/64 of full scale, retune below a quarter of that or
+// above 7/8 of full scale, and convert within the longest conversion of
+// the autoadjust example (H-resolution, MTreg 138)
+#define BH1750_AUTORANGE_TARGET 1024
+#define BH1750_AUTORANGE_LOW 256
+#define BH1750_AUTORANGE_HIGH 57344
+#define BH1750_AUTORANGE_MAX_MS 360
+
+struct BH1750_autoRange {
+	uint16_t target; // resolved count to aim for, a count of 4 in L-resolution mode is 1
+	uint16_t low; // resolved counts below this retune to a more sensitive range
+	uint16_t high; // counts above this retune to a less sensitive range
+	uint16_t maxMs; // longest conversion to pick, at its maximum time
+	uint32_t changes; // range changes so far
+};
+
+void BH1750_autoRangeInit(struct BH1750_autoRange *autoRange);
+int BH1750_autoRangeSelect(const struct BH1750_autoRange *autoRange, BH1750_Mode mode, unsigned char MTreg,
+                           uint16_t raw, BH1750_Mode *newMode, unsigned char *newMTreg);
+BH1750_Status BH1750_autoRangeUpdate(struct BH1750_autoRange *autoRange, struct BH1750_sensor *device, uint16_t raw);
+uint32_t BH1750_autoRangeResolution(const struct BH1750_sensor *device);
+
+#endif // BH1750_AUTORANGE_H
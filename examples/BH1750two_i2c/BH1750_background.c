@@ -0,0 +1,147 @@
+/*
+
+  Background sampling for BH1750 sensors.
+
+*/
+#include <stdbool.h>
+#include "BH1750_background.h"
+
+/**
+ * Initialize an empty ring
+ * @param ring structure
+ * @param entries Storage for size entries
+ * @param size Number of entries, a power of two
+ * @return true (1) or false (0) if size is not a power of two
+ */
+int BH1750_ringInit(struct BH1750_ring *ring, struct BH1750_ringEntry *entries, uint32_t size) {
+  if(size == 0 || (size & (size - 1)) != 0) {
+    return false;
+  }
+  ring->entries = entries;
+  ring->mask = size - 1;
+  ring->head = 0;
+  ring->tail = 0;
+  ring->dropped = 0;
+  return true;
+}
+
+/**
+ * Add an entry, producer side
+ * @param ring structure
+ * @param entry Copied into the ring
+ * @return true (1) or false (0) if the ring is full and the entry dropped
+ */
+int BH1750_ringPush(struct BH1750_ring *ring, const struct BH1750_ringEntry *entry) {
+  uint32_t head = ring->head;
+  if(head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) > ring->mask) {
+    ring->dropped++;
+    return false;
+  }
+  ring->entries[head & ring->mask] = *entry;
+  // Publish the entry before the new head
+  __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+/**
+ * Take up to max entries, consumer side
+ * @param ring structure
+ * @param entries Filled with the oldest entries
+ * @param max Size of entries
+ * @return number of entries taken
+ */
+unsigned int BH1750_ringPop(struct BH1750_ring *ring, struct BH1750_ringEntry *entries, unsigned int max) {
+  uint32_t tail = ring->tail;
+  uint32_t count = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - tail;
+  if(count > max) {
+    count = max;
+  }
+  for(uint32_t i = 0; i < count; i++) {
+    entries[i] = ring->entries[(tail + i) & ring->mask];
+  }
+  // Free the slots only after they are copied
+  __atomic_store_n(&ring->tail, tail + count, __ATOMIC_RELEASE);
+  return count;
+}
+
+// Alarm handler: read every sensor, then schedule the next instant
+static void BH1750_backgroundTick(void *arg) {
+  struct BH1750_background *background = arg;
+  struct BH1750_registry *registry = background->registry;
+
+  // Counted, not logged: the log sink may not be safe in interrupt context
+  BH1750_interruptEnter();
+  for(unsigned int i = 0; i < registry->count; i++) {
+    struct BH1750_sensor *device = &registry->sensors[i];
+    struct BH1750_ringEntry entry;
+    struct BH1750_sample sample;
+
+    // A sensor still settling after its configuration
+    if(device->op != BH1750_OP_NONE && BH1750_poll(device) == BH1750_IN_PROGRESS) {
+      continue;
+    }
+    entry.ticks = ticks32();
+    // In a one-time mode the next conversion starts with the read, as in
+    // the scheduler, with no settle time
+    BH1750_readRawRearm(device, &sample);
+    entry.status = sample.status;
+    entry.raw = sample.raw;
+    entry.sensor = (uint8_t)i;
+    BH1750_ringPush(background->ring, &entry);
+  }
+  BH1750_interruptExit();
+
+  // Keep to the period grid; skip instants already gone
+  background->next += background->periodTicks;
+  while(deadlineReached(background->next)) {
+    background->overruns++;
+    background->next += background->periodTicks;
+  }
+  if(background->running) {
+    alarmStart(background->next, BH1750_backgroundTick, background);
+  }
+}
+
+/**
+ * Start sampling every sensor of a registry from the timer interrupt
+ * Sensors are expected to be configured with BH1750_beginAt() already. The
+ * period must cover the maximum conversion time of every sensor; one-time
+ * sensors are re-armed by the read itself.
+ * @param background structure
+ * @param registry Sensors to sample
+ * @param ring Receives one entry per sensor and period
+ * @param periodMs Sampling period in milliseconds
+ * @return true (1) or false (0) if the period is too short or the timer
+ *         interrupt is not available
+ */
+int BH1750_backgroundStart(struct BH1750_background *background, struct BH1750_registry *registry,
+                           struct BH1750_ring *ring, uint32_t periodMs) {
+  for(unsigned int i = 0; i < registry->count; i++) {
+    struct BH1750_sensor *device = &registry->sensors[i];
+    if(periodMs < BH1750_conversionTime(device, 1)) {
+      BH1750_LOG(device, BH1750_ERR_OUT_OF_RANGE, "sampling period shorter than conversion time");
+      return false;
+    }
+  }
+
+  background->registry = registry;
+  background->ring = ring;
+  background->periodTicks = msToTicks(periodMs);
+  background->overruns = 0;
+  background->running = true;
+  background->next = ticks32() + background->periodTicks;
+  if(!alarmStart(background->next, BH1750_backgroundTick, background)) {
+    background->running = false;
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Stop sampling; the sensors belong to the foreground again
+ * @param background structure
+ */
+void BH1750_backgroundStop(struct BH1750_background *background) {
+  background->running = false;
+  alarmStop();
+}
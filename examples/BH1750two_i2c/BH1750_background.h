@@ -0,0 +1,53 @@
+/*
+
+  Background sampling for BH1750 sensors.
+
+  A machine timer alarm reads every sensor of a registry at a fixed period
+  from interrupt context and pushes timestamped raw counts into a
+  single-producer/single-consumer ring. The foreground drains the ring in
+  batches whenever it has time, so printf and other slow work no longer
+  shift the sampling instants. While sampling runs, the sensors of the
+  registry belong to the interrupt; the foreground only reads the ring.
+  Failed reads are counted in the sensor stats and the ring entry status,
+  never passed to the log sink from the interrupt.
+
+*/
+
+#ifndef BH1750_BACKGROUND_H
+#define BH1750_BACKGROUND_H
+
+#include "BH1750.h"
+
+struct BH1750_ringEntry {
+	uint32_t ticks; // ticks32() when the read started
+	uint16_t raw; // data register value
+	uint8_t sensor; // registry index
+	uint8_t status; // BH1750_SampleStatus
+};
+
+// Lock-free for one producer (the timer interrupt) and one consumer
+struct BH1750_ring {
+	struct BH1750_ringEntry *entries;
+	uint32_t mask; // size - 1, size is a power of two
+	uint32_t head; // written by the producer only
+	uint32_t tail; // written by the consumer only
+	uint32_t dropped; // entries lost to a full ring
+};
+
+struct BH1750_background {
+	struct BH1750_registry *registry;
+	struct BH1750_ring *ring;
+	uint32_t periodTicks;
+	deadline_t next; // next sampling instant
+	uint32_t overruns; // sampling instants missed
+	int running;
+};
+
+int BH1750_ringInit(struct BH1750_ring *ring, struct BH1750_ringEntry *entries, uint32_t size);
+int BH1750_ringPush(struct BH1750_ring *ring, const struct BH1750_ringEntry *entry);
+unsigned int BH1750_ringPop(struct BH1750_ring *ring, struct BH1750_ringEntry *entries, unsigned int max);
+int BH1750_backgroundStart(struct BH1750_background *background, struct BH1750_registry *registry,
+                           struct BH1750_ring *ring, uint32_t periodMs);
+void BH1750_backgroundStop(struct BH1750_background *background);
+
+#endif // BH1750_BACKGROUND_H
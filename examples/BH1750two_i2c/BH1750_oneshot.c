@@ -0,0 +1,99 @@
+/*
+
+  One-shot pipeline for the BH1750.
+
+*/
+#include <stdbool.h>
+#include <string.h>
+#include "BH1750_oneshot.h"
+
+/**
+ * Start the pipeline with a first conversion
+ * @param shot structure
+ * @param device structure, configured in a one-time mode
+ * @return true (1) if the first conversion was started, otherwise false (0)
+ */
+int BH1750_oneShotBegin(struct BH1750_oneShot *shot, struct BH1750_sensor *device) {
+  memset(shot, 0, sizeof(*shot));
+  shot->device = device;
+  shot->armed = BH1750_trigger(device);
+  if(!shot->armed) {
+    shot->failed++;
+  }
+  return shot->armed;
+}
+
+/**
+ * When the running conversion is done, at its maximum conversion time
+ * @param shot structure
+ * @return deadline for delayUntil() or deadlineReached()
+ */
+deadline_t BH1750_oneShotDue(const struct BH1750_oneShot *shot) {
+  return shot->device->lastReadTimestamp + msToTicks(BH1750_conversionTime(shot->device, 1));
+}
+
+/**
+ * Check whether the running conversion is done, or the next one needs
+ * to be started after a failure
+ * @param shot structure
+ * @return true (1) if BH1750_oneShotRead() can be called, otherwise false (0)
+ */
+int BH1750_oneShotReady(const struct BH1750_oneShot *shot) {
+  return !shot->armed || deadlineReached(BH1750_oneShotDue(shot));
+}
+
+/**
+ * Read the finished conversion and start the next one
+ * If no conversion is running, after a failed read or trigger, this
+ * starts one and returns BH1750_SAMPLE_READ_FAILED.
+ * @param shot structure
+ * @param sample Filled as by BH1750_readRaw()
+ * @return sample status, BH1750_SAMPLE_OK if the count is valid
+ */
+BH1750_SampleStatus BH1750_oneShotRead(struct BH1750_oneShot *shot, struct BH1750_sample *sample) {
+  if(!shot->armed) {
+    shot->armed = BH1750_trigger(shot->device);
+    sample->status = BH1750_SAMPLE_READ_FAILED;
+    return sample->status;
+  }
+  shot->armed = BH1750_readRawRearm(shot->device, sample);
+  if(sample->status != BH1750_SAMPLE_OK || !shot->armed) {
+    shot->failed++;
+  }
+  if(sample->status == BH1750_SAMPLE_OK) {
+    // Each step is well within the tick wraparound, the whole run may not be
+    if(shot->samples != 0) {
+      shot->spanTicks += shot->device->lastReadTimestamp - shot->lastTicks;
+    }
+    shot->lastTicks = shot->device->lastReadTimestamp;
+    shot->samples++;
+  }
+  return sample->status;
+}
+
+/**
+ * Effective sample period, averaged from the first sample to the last
+ * @param shot structure
+ * @return microseconds between samples, 0 before the second sample
+ */
+uint32_t BH1750_oneShotPeriodUs(const struct BH1750_oneShot *shot) {
+  if(shot->samples < 2) {
+    return 0;
+  }
+  return ticksToUs((uint32_t)(shot->spanTicks / (shot->samples - 1)));
+}
+
+/**
+ * Share of the sample period the sensor spends converting
+ * @param shot structure
+ * @return typical conversion time per sample period, in permille,
+ *         0 before the second sample
+ */
+uint32_t BH1750_oneShotDutyPermille(const struct BH1750_oneShot *shot) {
+  uint32_t period = BH1750_oneShotPeriodUs(shot);
+  if(period == 0) {
+    return 0;
+  }
+  uint32_t duty = (uint32_t)((uint64_t)BH1750_conversionTime(shot->device, 0) * 1000000 / period);
+  return duty > 1000 ? 1000 : duty;
+}
@@ -0,0 +1,38 @@
+/*
+
+  One-shot pipeline for the BH1750.
+
+  In a one-time mode the sensor converts once and powers down. The
+  pipeline reads each result and starts the next conversion in the same
+  bus session (BH1750_readRawRearm()), so the sensor converts while the
+  host works on the last sample, and is powered down between samples
+  only for the part of the period the host takes beyond the conversion.
+
+  The effective sample period is measured between reads; the duty cycle
+  is the share of it the sensor spends converting, from the typical
+  conversion time.
+
+*/
+
+#ifndef BH1750_ONESHOT_H
+#define BH1750_ONESHOT_H
+
+#include "BH1750.h"
+
+struct BH1750_oneShot {
+	struct BH1750_sensor *device;
+	unsigned char armed; // a conversion was started and not read yet
+	uint32_t samples; // reads that returned a sample
+	uint32_t failed; // failed reads and triggers
+	uint32_t lastTicks; // ticks32() of the last sample
+	uint64_t spanTicks; // ticks from the first sample to the last, summed sample to sample
+};
+
+int BH1750_oneShotBegin(struct BH1750_oneShot *shot, struct BH1750_sensor *device);
+deadline_t BH1750_oneShotDue(const struct BH1750_oneShot *shot);
+int BH1750_oneShotReady(const struct BH1750_oneShot *shot);
+BH1750_SampleStatus BH1750_oneShotRead(struct BH1750_oneShot *shot, struct BH1750_sample *sample);
+uint32_t BH1750_oneShotPeriodUs(const struct BH1750_oneShot *shot);
+uint32_t BH1750_oneShotDutyPermille(const struct BH1750_oneShot *shot);
+
+#endif // BH1750_ONESHOT_H
@@ -0,0 +1,134 @@
+/*
+
+  Readiness learning for the BH1750.
+
+*/
+#include <stdbool.h>
+#include <string.h>
+#include "BH1750_readiness.h"
+
+/**
+ * Initialize readiness tracking of a sensor
+ * @param readiness structure
+ * @param device structure, configured in a one-time or continuous mode;
+ *        samples are taken with the one-time mode of its resolution
+ * @param policy When to read the result
+ */
+void BH1750_readinessInit(struct BH1750_readiness *readiness, struct BH1750_sensor *device,
+                          BH1750_ReadyPolicy policy) {
+  memset(readiness, 0, sizeof(*readiness));
+  readiness->device = device;
+  readiness->policy = policy;
+}
+
+// Learn an observed conversion time and move the safe point
+static void BH1750_readinessObserve(struct BH1750_readiness *readiness, uint32_t permille) {
+  unsigned int bin = 0;
+  if(permille > BH1750_READINESS_MIN_PERMILLE) {
+    bin = (permille - BH1750_READINESS_MIN_PERMILLE + BH1750_READINESS_STEP_PERMILLE - 1) /
+          BH1750_READINESS_STEP_PERMILLE;
+  }
+  if(bin >= BH1750_READINESS_BINS) {
+    bin = BH1750_READINESS_BINS - 1;
+  }
+  if(readiness->hist[bin] == UINT16_MAX) {
+    // Age the histogram rather than saturate it
+    for(unsigned int i = 0; i < BH1750_READINESS_BINS; i++) {
+      readiness->hist[i] /= 2;
+    }
+  }
+  readiness->hist[bin]++;
+  readiness->observations++;
+
+  uint32_t total = 0, count = 0;
+  for(unsigned int i = 0; i < BH1750_READINESS_BINS; i++) {
+    total += readiness->hist[i];
+  }
+  for(unsigned int i = 0; i < BH1750_READINESS_BINS; i++) {
+    count += readiness->hist[i];
+    if(count * 100 >= total * BH1750_READINESS_PERCENTILE) {
+      // Upper bound of the bin, plus one step of margin
+      readiness->safePermille = BH1750_READINESS_MIN_PERMILLE + (i + 1) * BH1750_READINESS_STEP_PERMILLE;
+      break;
+    }
+  }
+}
+
+/**
+ * Take one sample, reading it at the point the policy gives
+ * The data register is cleared and a one-time conversion started; reads
+ * before the result is in count as stale and are retried one step later,
+ * so the sample is always fresh. The sensor powers down after the
+ * conversion.
+ * @param readiness structure
+ * @param sample Filled as by BH1750_readRaw()
+ * @return sample status, BH1750_SAMPLE_OK if the count is valid
+ */
+BH1750_SampleStatus BH1750_readinessSample(struct BH1750_readiness *readiness, struct BH1750_sample *sample) {
+  struct BH1750_sensor *device = readiness->device;
+  BH1750_Mode mode = device->BH1750_MODE;
+  uint32_t typical = msToTicks(BH1750_conversionTime(device, 0));
+  uint32_t step = typical * BH1750_READINESS_STEP_PERMILLE / 1000;
+  uint32_t permille = 1000;
+  int learning = false;
+
+  if(readiness->dark) {
+    // No point polling for a 0 that the last sample already saw
+    permille = BH1750_READINESS_DARK_PERMILLE;
+  } else if(readiness->policy == BH1750_READY_MAX) {
+    permille = 1500;
+  } else if(readiness->policy == BH1750_READY_LEARNED) {
+    learning = readiness->observations < BH1750_READINESS_LEARN ||
+               readiness->samples % BH1750_READINESS_PROBE_EVERY == 0;
+    permille = learning ? BH1750_READINESS_MIN_PERMILLE : readiness->safePermille;
+    if(learning && readiness->observations >= BH1750_READINESS_LEARN &&
+       readiness->safePermille > BH1750_READINESS_MIN_PERMILLE + BH1750_READINESS_PROBE_STEPS * BH1750_READINESS_STEP_PERMILLE) {
+      // Probes only look for a unit that got faster
+      permille = readiness->safePermille - BH1750_READINESS_PROBE_STEPS * BH1750_READINESS_STEP_PERMILLE;
+    }
+  }
+  readiness->samples++;
+
+  // One-time conversion of the configured resolution into a cleared register
+  device->BH1750_MODE = (BH1750_Mode)((mode & 0x0F) | BH1750_ONE_TIME_HIGH_RES_MODE);
+  int started = BH1750_powerOn(device) && BH1750_reset(device) && BH1750_trigger(device);
+  device->BH1750_MODE = mode;
+  if(!started) {
+    BH1750_readRaw(device, sample);
+    sample->status = BH1750_SAMPLE_READ_FAILED;
+    return sample->status;
+  }
+  // Powered down after the conversion
+  device->shadowMode = 0;
+  uint32_t start = device->lastReadTimestamp;
+  deadline_t dark = start + (uint32_t)((uint64_t)typical * BH1750_READINESS_DARK_PERMILLE / 1000);
+
+  delayUntil(start + (uint32_t)((uint64_t)typical * permille / 1000));
+  readiness->dark = false;
+  for(unsigned int retries = 0;; retries++) {
+    readiness->reads++;
+    if(BH1750_readRaw(device, sample) != BH1750_SAMPLE_OK) {
+      return sample->status;
+    }
+    uint32_t elapsed = ticks32() - start;
+    if(sample->raw != 0) {
+      if(retries && !learning) {
+        readiness->stale++;
+        device->stats.staleReads++;
+      }
+      if(retries || learning) {
+        BH1750_readinessObserve(readiness, (uint32_t)((uint64_t)elapsed * 1000 / typical));
+      }
+      break;
+    }
+    if(deadlineReached(dark)) {
+      // No light: 0 is the result
+      readiness->dark = true;
+      break;
+    }
+    // The last poll of a dark sensor falls on the maximum time
+    deadline_t next = ticks32() + step;
+    delayUntil((int32_t)(next - dark) > 0 ? dark : next);
+  }
+  return sample->status;
+}
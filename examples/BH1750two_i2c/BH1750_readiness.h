@@ -0,0 +1,73 @@
+/*
+
+  Readiness learning for the BH1750.
+
+  The datasheet gives a typical and a maximum conversion time, 1.5 times
+  apart; a given unit converts in a fixed share of the typical time. Each
+  sample here clears the data register (BH1750_reset()) before starting a
+  one-time conversion, so a read that returns 0 is known to come before
+  the end of the conversion: a stale read, retried one step later.
+
+  With BH1750_READY_LEARNED the first BH1750_READINESS_LEARN samples, and
+  every BH1750_READINESS_PROBE_EVERY-th sample after them, poll from
+  BH1750_READINESS_MIN_PERMILLE of the typical time in steps of
+  BH1750_READINESS_STEP_PERMILLE until the result is in. The observed
+  times go to a histogram in steps, and the other samples are read at its
+  BH1750_READINESS_PERCENTILE percentile plus one step. A stale read at
+  that point is also observed, so the point moves up if the unit slows
+  down; once learned, probes start BH1750_READINESS_PROBE_STEPS steps
+  before the point and move it down if the unit speeds up.
+
+  A sample that still reads 0 at the datasheet maximum time,
+  BH1750_READINESS_DARK_PERMILLE of the typical time, is taken as
+  darkness, not as a stale read; polling stops there, so a dark sensor is
+  never read later than with BH1750_READY_MAX. The next sample of a dark
+  sensor is read once, at that time, until it sees light again.
+
+*/
+
+#ifndef BH1750_READINESS_H
+#define BH1750_READINESS_H
+
+#include "BH1750.h"
+
+#define BH1750_READINESS_MIN_PERMILLE 600
+#define BH1750_READINESS_STEP_PERMILLE 20
+#define BH1750_READINESS_BINS 64
+#define BH1750_READINESS_DARK_PERMILLE 1500
+#ifndef BH1750_READINESS_LEARN
+#define BH1750_READINESS_LEARN 8
+#endif
+#ifndef BH1750_READINESS_PROBE_EVERY
+#define BH1750_READINESS_PROBE_EVERY 16
+#endif
+#define BH1750_READINESS_PROBE_STEPS 4
+#ifndef BH1750_READINESS_PERCENTILE
+#define BH1750_READINESS_PERCENTILE 99
+#endif
+
+// When BH1750_readinessSample() reads the result
+typedef enum
+{
+	BH1750_READY_TYPICAL = 0, // datasheet typical time, maxWait = 0
+	BH1750_READY_MAX, // datasheet maximum time, maxWait = 1
+	BH1750_READY_LEARNED, // learned safe point
+} BH1750_ReadyPolicy;
+
+struct BH1750_readiness {
+	struct BH1750_sensor *device;
+	unsigned char policy; // BH1750_ReadyPolicy
+	uint16_t safePermille; // learned read point, share of the typical time, 0 until learned
+	uint16_t hist[BH1750_READINESS_BINS]; // observed conversion times, in steps from the minimum
+	uint32_t observations;
+	uint32_t samples;
+	uint32_t stale; // samples whose first read came before the result
+	uint32_t reads; // reads of the data register, retries included
+	unsigned char dark; // the last sample read 0 at the maximum time
+};
+
+void BH1750_readinessInit(struct BH1750_readiness *readiness, struct BH1750_sensor *device,
+                          BH1750_ReadyPolicy policy);
+BH1750_SampleStatus BH1750_readinessSample(struct BH1750_readiness *readiness, struct BH1750_sample *sample);
+
+#endif // BH1750_READINESS_H
@@ -0,0 +1,101 @@
+/*
+
+  Measurement scheduler for many BH1750 sensors.
+
+*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "BH1750_scheduler.h"
+
+// Keep the earlier of the next deadline and due, both relative to now
+static void BH1750_earliest(deadline_t *next, int *found, deadline_t due, uint32_t now) {
+  if(!*found || (int32_t)(due - now) < (int32_t)(*next - now)) {
+    *next = due;
+    *found = true;
+  }
+}
+
+/**
+ * Initialize a scheduler over the sensors of a registry
+ * Sensors are expected to be configured with BH1750_beginAt() already.
+ * @param scheduler structure
+ * @param registry Sensors to read
+ * @param maxWait a boolean if to wait for typical or maximum delay
+ * @param handler Called with every sample read
+ * @param arg Passed to handler
+ */
+void BH1750_schedulerInit(struct BH1750_scheduler *scheduler, struct BH1750_registry *registry,
+                          int maxWait, BH1750_sampleHandler handler, void *arg) {
+  scheduler->registry = registry;
+  scheduler->maxWait = maxWait;
+  scheduler->handler = handler;
+  scheduler->arg = arg;
+  scheduler->nextDeadline = 0;
+}
+
+/**
+ * Read every sensor whose conversion is done, without blocking
+ * @param scheduler structure
+ * @return true (1) if a sensor is due later, at scheduler->nextDeadline,
+ *         false (0) if no sensor is configured
+ */
+int BH1750_schedulerPoll(struct BH1750_scheduler *scheduler) {
+  struct BH1750_registry *registry = scheduler->registry;
+  deadline_t next = 0;
+  int found = false;
+  uint32_t now = ticks32();
+
+  for(unsigned int i = 0; i < registry->count; i++) {
+    struct BH1750_sensor *device = &registry->sensors[i];
+    deadline_t due;
+
+    // A configure or MTreg change still settling
+    if(device->op != BH1750_OP_NONE && BH1750_poll(device) == BH1750_IN_PROGRESS) {
+      BH1750_earliest(&next, &found, device->opDeadline, now);
+      continue;
+    }
+    if(device->BH1750_MODE == BH1750_UNCONFIGURED) {
+      continue;
+    }
+
+    due = device->lastReadTimestamp + msToTicks(BH1750_conversionTime(device, scheduler->maxWait));
+    if(deadlineReached(due)) {
+      float lux = BH1750_readLightLevel(device);
+      if(scheduler->handler) {
+        scheduler->handler(device, lux, scheduler->arg);
+      }
+      switch (device->BH1750_MODE) {
+        case BH1750_ONE_TIME_HIGH_RES_MODE:
+        case BH1750_ONE_TIME_HIGH_RES_MODE_2:
+        case BH1750_ONE_TIME_LOW_RES_MODE:
+          // Sensor powered down after the conversion, start the next one;
+          // with no settle wait it is due a conversion time after the command
+          if(!BH1750_trigger(device)) {
+            // Try again a conversion time from now rather than spin on it
+            due = now + msToTicks(BH1750_conversionTime(device, scheduler->maxWait));
+            BH1750_earliest(&next, &found, due, now);
+            continue;
+          }
+          break;
+        default:
+          break;
+      }
+      due = device->lastReadTimestamp + msToTicks(BH1750_conversionTime(device, scheduler->maxWait));
+    }
+    BH1750_earliest(&next, &found, due, now);
+  }
+
+  scheduler->nextDeadline = next;
+  return found;
+}
+
+/**
+ * Read every sensor that is due, then sleep until the next one is
+ * @param scheduler structure
+ */
+void BH1750_schedulerRun(struct BH1750_scheduler *scheduler) {
+  if(!BH1750_schedulerPoll(scheduler)) {
+    return;
+  }
+  delayUntil(scheduler->nextDeadline);
+}
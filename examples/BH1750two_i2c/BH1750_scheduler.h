@@ -0,0 +1,34 @@
+/*
+
+  Measurement scheduler for many BH1750 sensors.
+
+  Every sensor of a registry is read as soon as its conversion is done,
+  according to its own mode and MTreg (see BH1750_conversionTime()), and the
+  caller sleeps only until the earliest next conversion. Sensors in one-time
+  modes are re-armed after each read with BH1750_trigger(), and read again
+  a conversion time after that command.
+
+*/
+
+#ifndef BH1750_SCHEDULER_H
+#define BH1750_SCHEDULER_H
+
+#include "BH1750.h"
+
+// Called for every sample the scheduler reads
+typedef void (*BH1750_sampleHandler)(struct BH1750_sensor *device, float lux, void *arg);
+
+struct BH1750_scheduler {
+	struct BH1750_registry *registry;
+	int maxWait; // use maximum instead of typical conversion times
+	BH1750_sampleHandler handler;
+	void *arg;
+	deadline_t nextDeadline; // when the next sensor is due
+};
+
+void BH1750_schedulerInit(struct BH1750_scheduler *scheduler, struct BH1750_registry *registry,
+                          int maxWait, BH1750_sampleHandler handler, void *arg);
+int BH1750_schedulerPoll(struct BH1750_scheduler *scheduler);
+void BH1750_schedulerRun(struct BH1750_scheduler *scheduler);
+
+#endif // BH1750_SCHEDULER_H
@@ -0,0 +1,241 @@
+/*
+
+  Packed sensor table for hundreds of BH1750 sensors.
+
+*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "BH1750_table.h"
+
+// Measurement modes by the mode index of the config byte
+static const unsigned char BH1750_tableModes[6] = {
+  BH1750_CONTINUOUS_HIGH_RES_MODE,
+  BH1750_CONTINUOUS_HIGH_RES_MODE_2,
+  BH1750_CONTINUOUS_LOW_RES_MODE,
+  BH1750_ONE_TIME_HIGH_RES_MODE,
+  BH1750_ONE_TIME_HIGH_RES_MODE_2,
+  BH1750_ONE_TIME_LOW_RES_MODE,
+};
+
+// Typical conversion time, or the maximum one, in ticks
+static uint32_t BH1750_tableConversion(unsigned char mode, unsigned char MTreg, int maxWait) {
+  unsigned long ms;
+  if((mode & 0x0F) == 0x03) {
+    ms = (maxWait ? 24 : 16) * MTreg / BH1750_DEFAULT_MTREG;
+  } else {
+    ms = (maxWait ? 180 : 120) * MTreg / BH1750_DEFAULT_MTREG;
+  }
+  return msToTicks(ms);
+}
+
+// Send one command byte to a sensor, its route selected
+static int BH1750_tableCommand(struct metal_i2c *i2c, unsigned char addr, unsigned char command) {
+  return metal_i2c_write(i2c, addr, 1, &command, METAL_I2C_STOP_ENABLE) == 0;
+}
+
+/**
+ * Initialize an empty table
+ * @param table structure
+ */
+void BH1750_tableInit(struct BH1750_table *table) {
+  memset(table, 0, sizeof(*table));
+}
+
+/**
+ * Add a route, a bus and the mux behind which sensors sit
+ * Muxes sharing a bus are expected to be linked with BH1750_muxLink().
+ * @param table structure
+ * @param i2c Bus
+ * @param mux Mux on that bus, NULL for sensors wired to the bus directly
+ * @return route index, or -1 if the table holds BH1750_TABLE_ROUTES already
+ */
+int BH1750_tableRoute(struct BH1750_table *table, struct metal_i2c *i2c, struct BH1750_mux *mux) {
+  if(table->routeCount >= BH1750_TABLE_ROUTES) {
+    BH1750_LOG(NULL, BH1750_ERR_REGISTRY_FULL, "table routes are full");
+    return -1;
+  }
+  table->routes[table->routeCount].i2c = i2c;
+  table->routes[table->routeCount].mux = mux;
+  return table->routeCount++;
+}
+
+/**
+ * Add a conversion factor shared by the sensors that use its index
+ * @param table structure
+ * @param convFactor Correction factor, 1.2 typical, 0.96 to 1.44
+ * @return calibration index, or -1 if the table holds
+ *         BH1750_TABLE_CALIBRATIONS already
+ */
+int BH1750_tableCalibration(struct BH1750_table *table, float convFactor) {
+  if(table->calibrationCount >= BH1750_TABLE_CALIBRATIONS) {
+    BH1750_LOG(NULL, BH1750_ERR_REGISTRY_FULL, "table calibrations are full");
+    return -1;
+  }
+  table->calibration[table->calibrationCount] = convFactor;
+  return table->calibrationCount++;
+}
+
+/**
+ * Add a sensor and start its first conversion
+ * @param table structure
+ * @param addr Address of the sensor (0x23 or 0x5C)
+ * @param route Route index from BH1750_tableRoute()
+ * @param channel Mux channel (0 ~ 7), ignored without a mux
+ * @param mode Measurement mode
+ * @param MTreg a value between 32 and 254
+ * @param calibration Index from BH1750_tableCalibration()
+ * @return table index of the sensor, or -1 on a bad parameter, a full
+ *         table or a sensor that did not acknowledge
+ */
+int BH1750_tableAdd(struct BH1750_table *table, unsigned char addr, unsigned char route, unsigned char channel,
+                    BH1750_Mode mode, unsigned char MTreg, unsigned char calibration) {
+  unsigned int modeIndex = 0;
+  while(modeIndex < sizeof(BH1750_tableModes) && BH1750_tableModes[modeIndex] != mode) {
+    modeIndex++;
+  }
+  if(addr != 0x23 && addr != 0x5C) {
+    BH1750_LOG(NULL, BH1750_ERR_BAD_ADDRESS, "bad address");
+    return -1;
+  }
+  if(modeIndex == sizeof(BH1750_tableModes)) {
+    BH1750_LOG(NULL, BH1750_ERR_INVALID_MODE, "invalid mode");
+    return -1;
+  }
+  if(MTreg <= 31 || MTreg > 254) {
+    BH1750_LOG(NULL, BH1750_ERR_OUT_OF_RANGE, "MTreg out of range");
+    return -1;
+  }
+  if(route >= table->routeCount || channel > 7 || calibration >= table->calibrationCount) {
+    BH1750_LOG(NULL, BH1750_ERR_NO_BUS, "no such route, channel or calibration");
+    return -1;
+  }
+  if(table->count >= BH1750_TABLE_SIZE) {
+    BH1750_LOG(NULL, BH1750_ERR_REGISTRY_FULL, "table is full");
+    return -1;
+  }
+
+  const struct BH1750_tableRoute *r = &table->routes[route];
+  int ok = BH1750_muxSelect(r->mux, channel);
+  // MTreg always goes out: the sensor may keep another one from before a
+  // reset of the host
+  if(ok) {
+    //   High bit: 01000_MT[7,6,5]
+    //    Low bit: 011_MT[4,3,2,1,0]
+    ok = BH1750_tableCommand(r->i2c, addr, (0b01000 << 3) | (MTreg >> 5)) &&
+         BH1750_tableCommand(r->i2c, addr, (0b011 << 5) | (MTreg & 0b11111));
+  }
+  ok = ok && BH1750_tableCommand(r->i2c, addr, mode);
+  if(!ok) {
+    BH1750_LOG(NULL, BH1750_ERR_NACK, "sensor did not acknowledge");
+    return -1;
+  }
+
+  unsigned int i = table->count++;
+  table->location[i] = BH1750_TABLE_LOCATION(addr, route, channel);
+  table->config[i] = BH1750_TABLE_CONFIG(calibration, modeIndex);
+  table->MTreg[i] = MTreg;
+  table->raw[i] = 0;
+  // The first conversion runs after the command settles
+  table->deadline[i] = ticks32() + msToTicks(BH1750_SETTLE_MS) + BH1750_tableConversion(mode, MTreg, 1);
+  return i;
+}
+
+/**
+ * Measurement mode of a sensor
+ * @param table structure
+ * @param index Table index of the sensor
+ */
+BH1750_Mode BH1750_tableMode(const struct BH1750_table *table, unsigned int index) {
+  return (BH1750_Mode)BH1750_tableModes[BH1750_TABLE_MODE(table->config[index])];
+}
+
+// Read a sensor that is due into raw[i] and set its next deadline
+static int BH1750_tableRead(struct BH1750_table *table, unsigned int i) {
+  unsigned char location = table->location[i];
+  unsigned char mode = BH1750_tableModes[BH1750_TABLE_MODE(table->config[i])];
+  const struct BH1750_tableRoute *r = &table->routes[BH1750_TABLE_ROUTE(location)];
+  unsigned char addr = BH1750_TABLE_ADDR(location);
+  int oneTime = (mode & BH1750_ONE_TIME_HIGH_RES_MODE) != 0;
+  unsigned char tmp[2];
+  int ok;
+
+  ok = BH1750_muxSelect(r->mux, BH1750_TABLE_CHANNEL(location)) &&
+       metal_i2c_read(r->i2c, addr, 2, tmp, oneTime ? METAL_I2C_STOP_DISABLE : METAL_I2C_STOP_ENABLE) == 0;
+  if(ok) {
+    table->raw[i] = (uint16_t)((tmp[0] << 8) | tmp[1]);
+  }
+  // A one-time mode converts once, the command after a repeated START
+  // starts the next conversion
+  if(ok && oneTime) {
+    ok = metal_i2c_write(r->i2c, addr, 1, &mode, METAL_I2C_STOP_ENABLE) == 0;
+  }
+  table->deadline[i] = ticks32() + BH1750_tableConversion(mode, table->MTreg[i], oneTime);
+  if(!ok) {
+    table->failed++;
+  }
+  return ok;
+}
+
+/**
+ * Read every sensor whose conversion is done, without blocking
+ * Only the deadline array is scanned; a sensor is read when its
+ * conversion is done, at the typical conversion time in a continuous mode
+ * and the maximum one in a one-time mode. A failed read is tried again
+ * after another conversion time.
+ * @param table structure
+ * @param handler Called with the index of every sensor read, may be NULL
+ * @param arg Passed to handler
+ * @return true (1) if a sensor is due later, at table->nextDeadline,
+ *         false (0) if the table is empty
+ */
+int BH1750_tablePoll(struct BH1750_table *table, BH1750_tableHandler handler, void *arg) {
+  uint32_t now = ticks32();
+  int32_t nextIn = INT32_MAX;
+
+  for(unsigned int i = 0; i < table->count; i++) {
+    int32_t in = (int32_t)(table->deadline[i] - now);
+    if(in <= 0) {
+      if(BH1750_tableRead(table, i) && handler) {
+        handler(table, i, arg);
+      }
+      now = ticks32();
+      in = (int32_t)(table->deadline[i] - now);
+    }
+    if(in < nextIn) {
+      nextIn = in;
+    }
+  }
+
+  table->nextDeadline = now + (nextIn > 0 ? nextIn : 0);
+  return table->count != 0;
+}
+
+/**
+ * Read every sensor that is due, then sleep until the next one is
+ * @param table structure
+ * @param handler Called with the index of every sensor read, may be NULL
+ * @param arg Passed to handler
+ */
+void BH1750_tableRun(struct BH1750_table *table, BH1750_tableHandler handler, void *arg) {
+  if(!BH1750_tablePoll(table, handler, arg)) {
+    return;
+  }
+  delayUntil(table->nextDeadline);
+}
+
+/**
+ * Light level of the last sample of a sensor
+ * @param table structure
+ * @param index Table index of the sensor
+ * @return Light level in lux
+ */
+float BH1750_tableLux(const struct BH1750_table *table, unsigned int index) {
+  unsigned char config = table->config[index];
+  unsigned char mode = BH1750_tableModes[BH1750_TABLE_MODE(config)];
+  float level = table->raw[index] * ((float)BH1750_DEFAULT_MTREG / table->MTreg[index]);
+  if((mode & 0x0F) == 0x01) {
+    level /= 2;
+  }
+  return level / table->calibration[BH1750_TABLE_CALIBRATION(config)];
+}
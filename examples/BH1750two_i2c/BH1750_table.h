@@ -0,0 +1,86 @@
+/*
+
+  Packed sensor table for hundreds of BH1750 sensors.
+
+  struct BH1750_sensor suits a few sensors; for hundreds the table keeps
+  each field of every sensor in its own array, packed:
+
+    location  address bit, route (bus and mux) and mux channel, 1 byte
+    config    calibration index and mode, 1 byte
+    MTreg     1 byte
+    deadline  ticks32() when the running conversion is done, 4 bytes
+    raw       last data register value, 2 bytes
+
+  Buses and muxes are shared by up to 16 sensors each through the routes
+  table, and conversion factors through the calibration table. The poll
+  loop scans the deadline array alone and touches the other arrays only
+  for the sensors it reads. The columns take 9 bytes per sensor; with the
+  routes and calibrations a table of 256 sensors takes about 10.6.
+
+*/
+
+#ifndef BH1750_TABLE_H
+#define BH1750_TABLE_H
+
+#include "BH1750.h"
+
+// Number of sensors in a table; 256 is every address, route and channel
+// the location byte can hold
+#ifndef BH1750_TABLE_SIZE
+#define BH1750_TABLE_SIZE 256
+#endif
+
+#define BH1750_TABLE_ROUTES 16
+#define BH1750_TABLE_CALIBRATIONS 32
+
+// location: bit 7 address 0x5C, bits 6..3 route, bits 2..0 mux channel
+#define BH1750_TABLE_ADDR_HIGH 0x80
+#define BH1750_TABLE_LOCATION(addr, route, channel) \
+  (((addr) == 0x5C ? BH1750_TABLE_ADDR_HIGH : 0) | ((route) << 3) | ((channel) & 0x07))
+#define BH1750_TABLE_ADDR(location) (((location) & BH1750_TABLE_ADDR_HIGH) ? 0x5C : 0x23)
+#define BH1750_TABLE_ROUTE(location) (((location) >> 3) & 0x0F)
+#define BH1750_TABLE_CHANNEL(location) ((location) & 0x07)
+
+// config: bits 7..3 calibration index, bits 2..0 mode index
+#define BH1750_TABLE_CONFIG(calibration, mode) (((calibration) << 3) | (mode))
+#define BH1750_TABLE_CALIBRATION(config) ((config) >> 3)
+#define BH1750_TABLE_MODE(config) ((config) & 0x07)
+
+// A bus, and the mux the sensors sit behind, NULL if on the bus itself
+struct BH1750_tableRoute {
+	struct metal_i2c *i2c;
+	struct BH1750_mux *mux;
+};
+
+struct BH1750_table;
+
+// Called for every sample BH1750_tablePoll() reads, in table->raw[index]
+typedef void (*BH1750_tableHandler)(struct BH1750_table *table, unsigned int index, void *arg);
+
+struct BH1750_table {
+	uint8_t location[BH1750_TABLE_SIZE];
+	uint8_t config[BH1750_TABLE_SIZE];
+	uint8_t MTreg[BH1750_TABLE_SIZE];
+	uint32_t deadline[BH1750_TABLE_SIZE];
+	uint16_t raw[BH1750_TABLE_SIZE];
+	unsigned int count;
+	struct BH1750_tableRoute routes[BH1750_TABLE_ROUTES];
+	unsigned char routeCount;
+	// Correction factors used to calculate lux, 1.2 typical
+	float calibration[BH1750_TABLE_CALIBRATIONS];
+	unsigned char calibrationCount;
+	deadline_t nextDeadline; // when the next sensor is due
+	uint32_t failed; // failed reads and re-arms
+};
+
+void BH1750_tableInit(struct BH1750_table *table);
+int BH1750_tableRoute(struct BH1750_table *table, struct metal_i2c *i2c, struct BH1750_mux *mux);
+int BH1750_tableCalibration(struct BH1750_table *table, float convFactor);
+int BH1750_tableAdd(struct BH1750_table *table, unsigned char addr, unsigned char route, unsigned char channel,
+                    BH1750_Mode mode, unsigned char MTreg, unsigned char calibration);
+BH1750_Mode BH1750_tableMode(const struct BH1750_table *table, unsigned int index);
+int BH1750_tablePoll(struct BH1750_table *table, BH1750_tableHandler handler, void *arg);
+void BH1750_tableRun(struct BH1750_table *table, BH1750_tableHandler handler, void *arg);
+float BH1750_tableLux(const struct BH1750_table *table, unsigned int index);
+
+#endif // BH1750_TABLE_H
@@ -0,0 +1,118 @@
+/*
+
+  Stackless tasks for reading many BH1750 sensors on one core.
+
+*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "BH1750_task.h"
+
+// Keep the earlier of the next deadline and due, both relative to now
+static void BH1750_earliest(deadline_t *next, int *found, deadline_t due, uint32_t now) {
+  if(!*found || (int32_t)(due - now) < (int32_t)(*next - now)) {
+    *next = due;
+    *found = true;
+  }
+}
+
+/**
+ * Initialize an executor over a pool of task slots
+ * @param executor structure
+ * @param tasks Slots, for the life of the executor
+ * @param size Number of slots
+ */
+void BH1750_executorInit(struct BH1750_executor *executor, struct BH1750_task *tasks, unsigned int size) {
+  memset(tasks, 0, size * sizeof(*tasks));
+  executor->tasks = tasks;
+  executor->size = size;
+  executor->live = 0;
+  executor->nextDeadline = 0;
+  executor->resumes = 0;
+}
+
+/**
+ * Start a task in a free slot, it first runs at the next executor pass
+ * @param executor structure
+ * @param run Body of the task
+ * @param arg Stored in task->arg
+ * @return the task, or NULL if every slot is taken
+ */
+struct BH1750_task* BH1750_spawn(struct BH1750_executor *executor, BH1750_taskFn run, void *arg) {
+  for(unsigned int i = 0; i < executor->size; i++) {
+    struct BH1750_task *task = &executor->tasks[i];
+    if(task->run == NULL) {
+      memset(task, 0, sizeof(*task));
+      task->run = run;
+      task->arg = arg;
+      task->state = BH1750_TASK_READY;
+      executor->live++;
+      return task;
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Resume every task that is due, without blocking
+ * @param executor structure
+ * @return true (1) if a task is left, due at executor->nextDeadline,
+ *         false (0) if all are done
+ */
+int BH1750_executorPoll(struct BH1750_executor *executor) {
+  deadline_t next = 0;
+  int found = false;
+  uint32_t now = ticks32();
+
+  for(unsigned int i = 0; i < executor->size; i++) {
+    struct BH1750_task *task = &executor->tasks[i];
+    if(task->run == NULL) {
+      continue;
+    }
+    if(task->state == BH1750_TASK_SLEEPING && !deadlineReached(task->wake)) {
+      BH1750_earliest(&next, &found, task->wake, now);
+      continue;
+    }
+    executor->resumes++;
+    task->state = task->run(task);
+    if(task->state == BH1750_TASK_DONE) {
+      task->run = NULL;
+      executor->live--;
+      continue;
+    }
+    BH1750_earliest(&next, &found, task->state == BH1750_TASK_SLEEPING ? task->wake : now, now);
+  }
+
+  executor->nextDeadline = next;
+  return found;
+}
+
+/**
+ * Resume every task that is due, then sleep until the next one is
+ * @param executor structure
+ * @return true (1) if a task is left, false (0) if all are done
+ */
+int BH1750_executorRun(struct BH1750_executor *executor) {
+  if(!BH1750_executorPoll(executor)) {
+    return false;
+  }
+  delayUntil(executor->nextDeadline);
+  return true;
+}
+
+/**
+ * Check whether the conversion of a sensor is done, for BH1750_AWAIT_READ()
+ * Completes a pending configure or MTreg change first.
+ * @param task Waiting task, its wake deadline is set to when it is done
+ * @param device structure
+ * @param maxWait a boolean if to wait for typical or maximum delay
+ * @return true (1) if the sensor can be read, otherwise false (0)
+ */
+int BH1750_taskReady(struct BH1750_task *task, struct BH1750_sensor *device, int maxWait) {
+  if(device->op != BH1750_OP_NONE && BH1750_poll(device) == BH1750_IN_PROGRESS) {
+    task->wake = device->opDeadline;
+    return false;
+  }
+  task->wake = device->lastReadTimestamp + msToTicks(BH1750_conversionTime(device, maxWait));
+  return deadlineReached(task->wake);
+}
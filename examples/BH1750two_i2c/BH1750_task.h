@@ -0,0 +1,102 @@
+/*
+
+  Stackless tasks for reading many BH1750 sensors on one core.
+
+  A task is a function that the executor resumes where it last waited, so
+  the logic of a sensor reads top to bottom instead of being spread over
+  polling checks or callbacks:
+
+    static char sensorTask(struct BH1750_task *task) {
+      struct BH1750_sensor *device = task->arg;
+      BH1750_TASK_BEGIN(task);
+      while(1) {
+        BH1750_AWAIT_READ(task, device, 0);
+        lux = BH1750_convertSample(&task->sample, device->BH1750_CONV_FACTOR);
+        BH1750_SLEEP(task, 1000);
+      }
+      BH1750_TASK_END(task);
+    }
+
+  Tasks come from a pool the caller provides, so there is no heap, and run
+  on a single-threaded executor that sleeps in delayUntil() until the
+  earliest task is due. A task keeps no stack between resumptions: locals
+  do not survive a wait, keep state behind task->arg. The wait macros are
+  switch cases, so one per line, and not inside a switch of the task.
+
+*/
+
+#ifndef BH1750_TASK_H
+#define BH1750_TASK_H
+
+#include "BH1750.h"
+
+typedef enum
+{
+	BH1750_TASK_DONE = 0, // returned, the slot is free again
+	BH1750_TASK_SLEEPING, // resumes at task->wake
+	BH1750_TASK_READY // resumes at the next executor pass
+} BH1750_TaskState;
+
+struct BH1750_task;
+
+// Body of a task, returns a BH1750_TaskState
+typedef char (*BH1750_taskFn)(struct BH1750_task *task);
+
+struct BH1750_task {
+	BH1750_taskFn run; // NULL if the slot is free
+	void *arg;
+	unsigned short line; // resume point, 0 at the start
+	unsigned char state; // BH1750_TaskState
+	deadline_t wake; // when a sleeping task is due
+	struct BH1750_sample sample; // result of the last BH1750_AWAIT_READ()
+};
+
+struct BH1750_executor {
+	struct BH1750_task *tasks;
+	unsigned int size;
+	unsigned int live; // tasks spawned and not done
+	deadline_t nextDeadline; // when the next task is due
+	uint32_t resumes; // task resumptions
+};
+
+// The resume points fall through from the statement before them on purpose
+#if defined(__has_attribute)
+#if __has_attribute(fallthrough)
+#define BH1750_FALLTHROUGH __attribute__((fallthrough))
+#endif
+#endif
+#ifndef BH1750_FALLTHROUGH
+#define BH1750_FALLTHROUGH ((void)0)
+#endif
+
+#define BH1750_TASK_BEGIN(task) switch((task)->line) { case 0:
+#define BH1750_TASK_END(task) } (task)->line = 0; return BH1750_TASK_DONE
+
+// Suspend until cond holds, evaluated again at each resumption; state
+// tells the executor when to resume
+#define BH1750_TASK_WAIT(task, cond, state) \
+  do { (task)->line = __LINE__; BH1750_FALLTHROUGH; case __LINE__: if(!(cond)) return (state); } while(0)
+
+// Let the other tasks run once
+#define BH1750_YIELD(task) \
+  do { (task)->line = __LINE__; return BH1750_TASK_READY; case __LINE__:; } while(0)
+
+#define BH1750_SLEEP_UNTIL(task, deadline) \
+  do { (task)->wake = (deadline); \
+       BH1750_TASK_WAIT(task, deadlineReached((task)->wake), BH1750_TASK_SLEEPING); } while(0)
+
+#define BH1750_SLEEP(task, ms) BH1750_SLEEP_UNTIL(task, deadlineAfter(ms))
+
+// Wait for the conversion of device, then read it into task->sample; in a
+// one-time mode the read starts the next conversion
+#define BH1750_AWAIT_READ(task, device, maxWait) \
+  do { BH1750_TASK_WAIT(task, BH1750_taskReady((task), (device), (maxWait)), BH1750_TASK_SLEEPING); \
+       BH1750_readRawRearm((device), &(task)->sample); } while(0)
+
+void BH1750_executorInit(struct BH1750_executor *executor, struct BH1750_task *tasks, unsigned int size);
+struct BH1750_task* BH1750_spawn(struct BH1750_executor *executor, BH1750_taskFn run, void *arg);
+int BH1750_executorPoll(struct BH1750_executor *executor);
+int BH1750_executorRun(struct BH1750_executor *executor);
+int BH1750_taskReady(struct BH1750_task *task, struct BH1750_sensor *device, int maxWait);
+
+#endif // BH1750_TASK_H
@@ -39,6 +39,7 @@
 struct metal_i2c *i2c;
 struct BH1750_sensor *bh1750_a;
 struct BH1750_sensor *bh1750_b;
+struct BH1750_bus bus;
 static int error_counter_1_a = 0;
 static int error_counter_2_a = 0;
 static int error_counter_1_b = 0;
@@ -46,6 +47,15 @@ static int error_counter_2_b = 0;
 
 extern void delay(uint32_t miliseconds);
 
+// Print the errors of the BH1750 library
+static void log_error(const struct BH1750_sensor *device, BH1750_Error error, const char *message) {
+  if (device) {
+    printf("[BH1750] ERROR: 0x%02X %s: %s\r\n", device->BH1750_I2CADDR, BH1750_errorName(error), message);
+  } else {
+    printf("[BH1750] ERROR: %s: %s\r\n", BH1750_errorName(error), message);
+  }
+}
+
 int main() {
   asm (".global _printf_float");  // add this line for printf and scanf be able to support float type
 
@@ -56,9 +66,11 @@ int main() {
     return -1;
   }
   metal_i2c_init(i2c, 100000, METAL_I2C_MASTER); // configure to 100000Hz, master mode
+  BH1750_setLogSink(log_error);
 
   bh1750_a = BH1750_begin(BH1750_CONTINUOUS_HIGH_RES_MODE, 0x23, i2c, 0);  // sensor A, address 0x23
   bh1750_b = BH1750_begin(BH1750_CONTINUOUS_HIGH_RES_MODE, 0x5C, i2c, 0);  // sensor B, address 0x5C
+  BH1750_busBringUp(&bus, NULL, i2c);  // 400000Hz if both sensors answer at it, else 100000Hz
   printf("BH1750 Test begin\r\n");
 
   while(1) {
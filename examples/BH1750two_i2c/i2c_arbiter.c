@@ -0,0 +1,291 @@
+/*
+
+  Shared-bus arbiter on top of the I2C transfer engine.
+
+*/
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include "delay.h"
+#include "i2c_arbiter.h"
+
+static void i2cArbiterIssue(struct i2cArbiter *arbiter);
+
+/**
+ * Initialize an arbiter over an engine that is already initialized
+ * @param arbiter structure
+ * @param engine Engine of the shared bus, used only through the arbiter
+ */
+void i2cArbiterInit(struct i2cArbiter *arbiter, struct i2cEngine *engine) {
+  memset(arbiter, 0, sizeof(*arbiter));
+  arbiter->engine = engine;
+}
+
+/**
+ * Register a client of the bus
+ * @param client structure
+ * @param arbiter structure
+ * @param priority Higher goes first
+ * @param maxWaitMs Queueing time after which a request goes before all
+ *        others, 0 for none
+ * @param flags I2C_ARBITER_MERGE_WRITES or 0
+ */
+void i2cArbiterClientInit(struct i2cArbiterClient *client, struct i2cArbiter *arbiter, unsigned char priority,
+                          uint32_t maxWaitMs, unsigned char flags) {
+  memset(client, 0, sizeof(*client));
+  client->arbiter = arbiter;
+  client->priority = priority;
+  client->flags = flags;
+  client->maxWaitTicks = msToTicks(maxWaitMs);
+}
+
+static void i2cArbiterUnlink(struct i2cArbiter *arbiter, struct i2cRequest *prev, struct i2cRequest *request) {
+  if(prev) {
+    prev->next = request->next;
+  } else {
+    arbiter->head = request->next;
+  }
+  if(arbiter->tail == request) {
+    arbiter->tail = prev;
+  }
+  request->next = NULL;
+}
+
+static void i2cArbiterRecord(struct i2cRequest *request, uint32_t now) {
+  struct i2cArbiterClient *client = request->client;
+  uint32_t wait = now - request->queued;
+  unsigned int bin = wait ? 31 - __builtin_clz(wait) : 0;
+  if(bin >= I2C_ARBITER_HIST_BINS) {
+    bin = I2C_ARBITER_HIST_BINS - 1;
+  }
+  client->latency[bin]++;
+  if(wait > client->maxLatency) {
+    client->maxLatency = wait;
+  }
+}
+
+// Serve request with the transfer of the granted leader, if it can be
+static int i2cArbiterCoalesce(struct i2cArbiter *arbiter, struct i2cRequest *leader, struct i2cRequest *request) {
+  const struct i2cTransaction *lead = &leader->transactions[0];
+  const struct i2cTransaction *tr = &request->transactions[0];
+  if(request->count != 1 || request->dispatch || tr->addr != lead->addr) {
+    return false;
+  }
+  if(lead->rxLen > 0) {
+    // Identical read, the bytes read once serve both
+    return tr->rxLen == lead->rxLen && tr->txLen == lead->txLen &&
+           (tr->txLen == 0 || memcmp(tr->tx, lead->tx, tr->txLen) == 0);
+  }
+  struct i2cTransaction *merged = &arbiter->merged;
+  unsigned int len = merged->txLen ? merged->txLen : lead->txLen;
+  if(tr->rxLen != 0 || tr->txLen == 0 || request->client != leader->client ||
+     !(leader->client->flags & I2C_ARBITER_MERGE_WRITES) || len + tr->txLen > I2C_ARBITER_MERGE_MAX) {
+    return false;
+  }
+  if(merged->txLen == 0) {
+    memcpy(arbiter->mergeBuf, lead->tx, lead->txLen);
+    merged->addr = lead->addr;
+    merged->tx = arbiter->mergeBuf;
+    merged->txLen = lead->txLen;
+  }
+  memcpy(arbiter->mergeBuf + merged->txLen, tr->tx, tr->txLen);
+  merged->txLen += tr->txLen;
+  return true;
+}
+
+// Request the bus goes to next, NULL if nothing is waiting
+static struct i2cRequest *i2cArbiterBest(struct i2cArbiter *arbiter, uint32_t now, struct i2cRequest **bestPrev,
+                                         int *bestOverdue) {
+  struct i2cRequest *best = NULL, *prev = NULL;
+  *bestPrev = NULL;
+  *bestOverdue = false;
+  for(struct i2cRequest *r = arbiter->head; r; prev = r, r = r->next) {
+    uint32_t bound = r->client->maxWaitTicks;
+    int overdue = bound != 0 && now - r->queued >= bound;
+    // Overdue requests first, oldest first; then priority, oldest first
+    if(!best || (overdue && !*bestOverdue) ||
+       (!overdue && !*bestOverdue && r->client->priority > best->client->priority)) {
+      best = r;
+      *bestPrev = prev;
+      *bestOverdue = overdue;
+    }
+  }
+  return best;
+}
+
+// Grant the bus to the next request; called with the I2C interrupt masked
+// or from it. Returns false if nothing is waiting.
+static int i2cArbiterGrant(struct i2cArbiter *arbiter) {
+  uint32_t now = ticks32();
+  struct i2cRequest *best, *bestPrev;
+  int bestOverdue;
+
+  best = i2cArbiterBest(arbiter, now, &bestPrev, &bestOverdue);
+  if(!best) {
+    return false;
+  }
+  i2cArbiterUnlink(arbiter, bestPrev, best);
+  i2cArbiterRecord(best, now);
+  if(bestOverdue) {
+    best->client->overdue++;
+  }
+  best->first = 0;
+  if(best->dispatch) {
+    best->dispatch(best, best->arg);
+  }
+  arbiter->active = best;
+  arbiter->grants++;
+  arbiter->merged.txLen = 0;
+  arbiter->merged.status = I2C_OK;
+
+  if(best->count == 1 && best->first == 0 && !best->dispatch) {
+    // The requests that would be granted next, up to one that does not
+    // fit: coalescing never lets a request overtake another
+    struct i2cRequest *last = best, *r, *prev;
+    int overdue;
+    while((r = i2cArbiterBest(arbiter, now, &prev, &overdue)) && i2cArbiterCoalesce(arbiter, best, r)) {
+      i2cArbiterUnlink(arbiter, prev, r);
+      i2cArbiterRecord(r, now);
+      if(overdue) {
+        r->client->overdue++;
+      }
+      r->client->coalesced++;
+      last->next = r;
+      last = r;
+    }
+  }
+  arbiter->remaining = arbiter->merged.txLen ? 1 : best->count - best->first;
+  arbiter->result = I2C_OK;
+  return true;
+}
+
+// The granted request and the ones coalesced into it are done
+static void i2cArbiterComplete(struct i2cArbiter *arbiter) {
+  struct i2cRequest *leader = arbiter->active;
+  const struct i2cTransaction *lead = &leader->transactions[0];
+  int result = arbiter->result;
+
+  arbiter->active = NULL;
+  for(struct i2cRequest *r = leader, *next; r; r = next) {
+    next = r->next;
+    r->next = NULL;
+    if(r != leader) {
+      struct i2cTransaction *tr = &r->transactions[0];
+      if(tr->rxLen > 0 && result == I2C_OK) {
+        memcpy(tr->rx, lead->rx, tr->rxLen);
+      }
+      tr->status = result;
+    }
+    r->status = result;
+    if(r->done) {
+      // May submit, which grants the bus if it is free
+      r->done(r, r->arg);
+    }
+  }
+  if(arbiter->active == NULL && i2cArbiterGrant(arbiter)) {
+    i2cArbiterIssue(arbiter);
+  }
+}
+
+static void i2cArbiterTransactionDone(struct i2cTransaction *transaction, void *arg) {
+  struct i2cArbiter *arbiter = (struct i2cArbiter *)arg;
+  if(transaction->status != I2C_OK && arbiter->result == I2C_OK) {
+    arbiter->result = transaction->status;
+  }
+  if(--arbiter->remaining == 0) {
+    i2cArbiterComplete(arbiter);
+  }
+}
+
+// Hand the transactions of the granted request to the engine, back to back
+static void i2cArbiterIssue(struct i2cArbiter *arbiter) {
+  struct i2cRequest *leader = arbiter->active;
+  if(arbiter->remaining == 0) {
+    // The dispatch hook skipped every transaction
+    i2cArbiterComplete(arbiter);
+    return;
+  }
+  if(arbiter->merged.txLen) {
+    arbiter->merged.done = i2cArbiterTransactionDone;
+    arbiter->merged.arg = arbiter;
+    arbiter->transactions++;
+    i2cEngineSubmit(arbiter->engine, &arbiter->merged);
+    return;
+  }
+  for(unsigned int i = leader->first; i < leader->count; i++) {
+    leader->transactions[i].done = i2cArbiterTransactionDone;
+    leader->transactions[i].arg = arbiter;
+  }
+  for(unsigned int i = leader->first; i < leader->count; i++) {
+    arbiter->transactions++;
+    i2cEngineSubmit(arbiter->engine, &leader->transactions[i]);
+  }
+}
+
+/**
+ * Queue a request for the bus
+ * The request and its transactions must stay valid until it completes.
+ * May be called from interrupt context, completion callbacks included.
+ * @param client structure
+ * @param request transactions, count, dispatch, done and arg filled in
+ * @return true (1) if queued, false (0) if empty or already queued
+ */
+int i2cArbiterSubmit(struct i2cArbiterClient *client, struct i2cRequest *request) {
+  struct i2cArbiter *arbiter = client->arbiter;
+  struct i2cEngine *engine = arbiter->engine;
+  if(request->status == I2C_PENDING || request->count == 0) {
+    return false;
+  }
+  request->client = client;
+  request->status = I2C_PENDING;
+  request->next = NULL;
+  request->queued = ticks32();
+  client->submitted++;
+
+  metal_interrupt_disable(engine->plic, engine->irq);
+  if(arbiter->tail) {
+    arbiter->tail->next = request;
+  } else {
+    arbiter->head = request;
+  }
+  arbiter->tail = request;
+  int granted = arbiter->active == NULL && i2cArbiterGrant(arbiter);
+  metal_interrupt_enable(engine->plic, engine->irq);
+  // Nothing of the arbiter is on the engine, so no interrupt can race this
+  if(granted) {
+    i2cArbiterIssue(arbiter);
+  }
+  return true;
+}
+
+/**
+ * Sleep until a request completes
+ * @param client structure the request was submitted by
+ * @param request structure
+ * @return status of the request
+ */
+int i2cArbiterWait(struct i2cArbiterClient *client, struct i2cRequest *request) {
+  return i2cEngineWaitStatus(client->arbiter->engine, &request->status);
+}
+
+/**
+ * Queueing latency that a share of the client's requests stayed within
+ * @param client structure
+ * @param percent 1 ~ 100
+ * @return upper bound of the histogram bin holding the percentile, or the
+ *         longest wait if lower, in ticks
+ */
+uint32_t i2cArbiterPercentile(const struct i2cArbiterClient *client, unsigned int percent) {
+  uint64_t total = 0, count = 0;
+  for(unsigned int i = 0; i < I2C_ARBITER_HIST_BINS; i++) {
+    total += client->latency[i];
+  }
+  for(unsigned int i = 0; i < I2C_ARBITER_HIST_BINS; i++) {
+    count += client->latency[i];
+    if(count * 100 >= total * percent) {
+      uint32_t bound = (uint32_t)((2ULL << i) - 1);
+      return bound < client->maxLatency ? bound : client->maxLatency;
+    }
+  }
+  return client->maxLatency;
+}
@@ -0,0 +1,95 @@
+/*
+
+  Shared-bus arbiter on top of the I2C transfer engine.
+
+  Several clients (the BH1750 driver, other sensors on the same bus) queue
+  requests of one or more transactions; the arbiter grants the bus to one
+  request at a time, and the transactions of a request go out back to
+  back, so a mux select and the read behind it stay together.
+
+  The next request is the one of the highest client priority, first come
+  first served among equals. A client with a maxWaitTicks bound is not
+  starved: once a request of it has waited that long it goes next, oldest
+  overdue request first, so it waits at most the bound plus the requests
+  on the bus or overdue before it.
+
+  The requests that would be granted next are coalesced into the granted
+  one instead of going out on their own, up to the first one that cannot
+  be, so no request goes ahead of another it would not overtake otherwise:
+  identical reads get a copy of the bytes read once, and writes of a client
+  that allows it are sent as one longer write.
+
+  Each client keeps a log2 histogram of its queueing latency, from submit
+  to bus grant: bin b counts waits of 2^b to 2^(b+1) - 1 ticks, bin 0 also
+  counts waits of 0 ticks.
+
+*/
+
+#ifndef I2C_ARBITER_H
+#define I2C_ARBITER_H
+
+#include <stdint.h>
+#include "i2c_engine.h"
+
+#define I2C_ARBITER_HIST_BINS 24
+
+// Longest write the arbiter builds from coalesced writes
+#ifndef I2C_ARBITER_MERGE_MAX
+#define I2C_ARBITER_MERGE_MAX 8
+#endif
+
+// Client flag: consecutive writes of the client to an address may be
+// sent as one write, for devices that take every byte as a command
+#define I2C_ARBITER_MERGE_WRITES 0x01
+
+struct i2cArbiter;
+struct i2cRequest;
+
+typedef void (*i2c_request_fn_t)(struct i2cRequest *request, void *arg);
+
+struct i2cArbiterClient {
+	struct i2cArbiter *arbiter;
+	unsigned char priority; // higher goes first
+	unsigned char flags; // I2C_ARBITER_MERGE_WRITES
+	uint32_t maxWaitTicks; // 0 if the client may wait forever
+	uint32_t submitted;
+	uint32_t coalesced; // requests served by another request's transfer
+	uint32_t overdue; // requests granted for waiting past maxWaitTicks
+	uint32_t maxLatency; // ticks
+	uint32_t latency[I2C_ARBITER_HIST_BINS];
+};
+
+struct i2cRequest {
+	struct i2cTransaction *transactions; // done and arg are the arbiter's
+	unsigned int count;
+	unsigned int first; // transactions before it are skipped, see dispatch
+	i2c_request_fn_t dispatch; // called at bus grant, may set first, may be NULL
+	i2c_request_fn_t done; // called in interrupt context, may be NULL
+	void *arg;
+	struct i2cArbiterClient *client;
+	uint32_t queued; // ticks32() at submit
+	volatile int status; // i2c_status_t, the first failure of the request
+	struct i2cRequest *next; // owned by the arbiter
+};
+
+struct i2cArbiter {
+	struct i2cEngine *engine;
+	struct i2cRequest *head; // waiting, in submit order
+	struct i2cRequest *tail;
+	struct i2cRequest *active; // granted, followed by the requests coalesced into it
+	unsigned int remaining; // transactions of the active request still on the engine
+	int result; // first failure of the active request
+	struct i2cTransaction merged; // coalesced writes
+	unsigned char mergeBuf[I2C_ARBITER_MERGE_MAX];
+	uint32_t grants;
+	uint32_t transactions; // sent to the engine
+};
+
+void i2cArbiterInit(struct i2cArbiter *arbiter, struct i2cEngine *engine);
+void i2cArbiterClientInit(struct i2cArbiterClient *client, struct i2cArbiter *arbiter, unsigned char priority,
+                          uint32_t maxWaitMs, unsigned char flags);
+int i2cArbiterSubmit(struct i2cArbiterClient *client, struct i2cRequest *request);
+int i2cArbiterWait(struct i2cArbiterClient *client, struct i2cRequest *request);
+uint32_t i2cArbiterPercentile(const struct i2cArbiterClient *client, unsigned int percent);
+
+#endif // I2C_ARBITER_H
@@ -0,0 +1,284 @@
+/*
+
+  Interrupt-driven transfer engine for the FE310 I2C master.
+
+*/
+#include <stdbool.h>
+#include <stddef.h>
+#include <metal/cpu.h>
+#include <metal/io.h>
+#include "i2c_engine.h"
+
+// OpenCores I2C registers, at a 4-byte stride on the FE310
+#define I2C_REG_PRERLO 0x00
+#define I2C_REG_PRERHI 0x04
+#define I2C_REG_CTR 0x08
+#define I2C_REG_TXR 0x0C // write
+#define I2C_REG_RXR 0x0C // read
+#define I2C_REG_CR 0x10 // write
+#define I2C_REG_SR 0x10 // read
+
+#define I2C_CTR_EN 0x80
+#define I2C_CTR_IEN 0x40
+
+#define I2C_CR_STA 0x80
+#define I2C_CR_STO 0x40
+#define I2C_CR_RD 0x20
+#define I2C_CR_WR 0x10
+#define I2C_CR_NACK 0x08 // ACK bit: 1 = do not acknowledge the byte read
+#define I2C_CR_IACK 0x01
+
+#define I2C_SR_RXACK 0x80 // 1 = not acknowledged
+#define I2C_SR_AL 0x20
+#define I2C_SR_IF 0x01
+
+typedef enum
+{
+	I2C_ENGINE_IDLE = 0,
+	I2C_ENGINE_WRITE, // address or data byte written
+	I2C_ENGINE_READ_ADDR, // address for the read phase written
+	I2C_ENGINE_READ, // data byte read
+	I2C_ENGINE_STOP, // STOP after a NACK
+} i2cEngineState;
+
+static uint32_t i2cRead(struct i2cEngine *engine, uintptr_t reg) {
+#ifdef METAL_SIM_MMIO
+  return metal_sim_mmio_read32(engine->base + reg);
+#else
+  return __METAL_ACCESS_ONCE((__metal_io_u32 *)(engine->base + reg));
+#endif
+}
+
+static void i2cWrite(struct i2cEngine *engine, uintptr_t reg, uint32_t value) {
+#ifdef METAL_SIM_MMIO
+  metal_sim_mmio_write32(engine->base + reg, value);
+#else
+  __METAL_ACCESS_ONCE((__metal_io_u32 *)(engine->base + reg)) = value;
+#endif
+}
+
+// Issue a command, acknowledging the interrupt of the previous one
+static void i2cEngineCommand(struct i2cEngine *engine, unsigned char cmd) {
+  engine->cmd = cmd;
+  i2cWrite(engine, I2C_REG_CR, cmd | I2C_CR_IACK);
+}
+
+// START and address of the transaction at the head of the queue
+static void i2cEngineStart(struct i2cEngine *engine) {
+  struct i2cTransaction *tr = engine->head;
+  engine->index = 0;
+  engine->result = I2C_OK;
+  if(tr->txLen > 0 || tr->rxLen == 0) {
+    // An empty transaction only probes the address
+    engine->state = I2C_ENGINE_WRITE;
+    i2cWrite(engine, I2C_REG_TXR, tr->addr << 1);
+    i2cEngineCommand(engine, I2C_CR_STA | I2C_CR_WR | (tr->txLen == 0 ? I2C_CR_STO : 0));
+  } else {
+    engine->state = I2C_ENGINE_READ_ADDR;
+    i2cWrite(engine, I2C_REG_TXR, (tr->addr << 1) | 1);
+    i2cEngineCommand(engine, I2C_CR_STA | I2C_CR_WR);
+  }
+}
+
+// Next command of the transaction on the wire, STOP with the last byte
+static void i2cEngineNext(struct i2cEngine *engine, struct i2cTransaction *tr) {
+  switch(engine->state) {
+    case I2C_ENGINE_WRITE:
+      if(engine->index < tr->txLen) {
+        i2cWrite(engine, I2C_REG_TXR, tr->tx[engine->index++]);
+        i2cEngineCommand(engine, I2C_CR_WR | (engine->index == tr->txLen && tr->rxLen == 0 ? I2C_CR_STO : 0));
+      } else {
+        engine->state = I2C_ENGINE_READ_ADDR;
+        i2cWrite(engine, I2C_REG_TXR, (tr->addr << 1) | 1);
+        i2cEngineCommand(engine, I2C_CR_STA | I2C_CR_WR);
+      }
+      break;
+    case I2C_ENGINE_READ_ADDR:
+    case I2C_ENGINE_READ:
+      engine->state = I2C_ENGINE_READ;
+      // The last byte is not acknowledged, which ends the read phase
+      i2cEngineCommand(engine, I2C_CR_RD | (engine->index + 1 == tr->rxLen ? I2C_CR_NACK | I2C_CR_STO : 0));
+      break;
+    default:
+      break;
+  }
+}
+
+// Retire the transaction on the wire and start the next one
+static void i2cEngineComplete(struct i2cEngine *engine) {
+  struct i2cTransaction *tr = engine->head;
+  engine->head = tr->next;
+  if(engine->head == NULL) {
+    engine->tail = NULL;
+  }
+  engine->state = I2C_ENGINE_IDLE;
+  i2cWrite(engine, I2C_REG_CR, I2C_CR_IACK);
+  if(engine->result == I2C_OK) {
+    engine->completed++;
+  } else {
+    engine->failed++;
+  }
+  tr->status = engine->result;
+  if(tr->done) {
+    // May submit, which starts the queue if it was empty
+    tr->done(tr, tr->arg);
+  }
+  if(engine->head && engine->state == I2C_ENGINE_IDLE) {
+    i2cEngineStart(engine);
+  }
+}
+
+// One interrupt per command: the byte (and STOP, if any) is on the wire
+static void i2cEngineInterrupt(int id, void *priv) {
+  struct i2cEngine *engine = (struct i2cEngine *)priv;
+  struct i2cTransaction *tr = engine->head;
+  (void)id;
+
+  engine->interrupts++;
+  uint32_t sr = i2cRead(engine, I2C_REG_SR);
+  if(tr == NULL || engine->state == I2C_ENGINE_IDLE || !(sr & I2C_SR_IF)) {
+    i2cWrite(engine, I2C_REG_CR, I2C_CR_IACK);
+    return;
+  }
+  if(sr & I2C_SR_AL) {
+    // The core has given up the bus
+    engine->result = I2C_ARBITRATION_LOST;
+    i2cEngineComplete(engine);
+    return;
+  }
+  if(engine->state == I2C_ENGINE_READ) {
+    tr->rx[engine->index++] = (unsigned char)i2cRead(engine, I2C_REG_RXR);
+  } else if(engine->state != I2C_ENGINE_STOP && (sr & I2C_SR_RXACK)) {
+    engine->result = I2C_NACK;
+    if(!(engine->cmd & I2C_CR_STO)) {
+      engine->state = I2C_ENGINE_STOP;
+      i2cEngineCommand(engine, I2C_CR_STO);
+      return;
+    }
+  }
+  if(engine->cmd & I2C_CR_STO) {
+    i2cEngineComplete(engine);
+  } else {
+    i2cEngineNext(engine, tr);
+  }
+}
+
+/**
+ * Take over an I2C core and hook its interrupt
+ * Enables interrupts globally.
+ * @param engine structure
+ * @param base Address of the core, I2C_ENGINE_FE310_BASE on the FE310
+ * @param irq PLIC source of the core, I2C_ENGINE_FE310_IRQ on the FE310
+ * @param clockHz Clock of the core, the bus clock (tlclk) on the FE310
+ * @param baud SCL rate, rounded down to what the prescaler can do
+ * @return I2C_ENGINE_OK, or why the engine cannot run
+ */
+i2c_engine_error_t i2cEngineInit(struct i2cEngine *engine, uintptr_t base, int irq, uint32_t clockHz, uint32_t baud) {
+  struct metal_cpu *cpu = metal_cpu_get(metal_cpu_get_current_hartid());
+  engine->base = base;
+  engine->irq = irq;
+  engine->cpuIntr = cpu ? metal_cpu_interrupt_controller(cpu) : NULL;
+  engine->plic = metal_interrupt_get_controller(METAL_PLIC_CONTROLLER, 0);
+  engine->head = NULL;
+  engine->tail = NULL;
+  engine->state = I2C_ENGINE_IDLE;
+  engine->completed = 0;
+  engine->failed = 0;
+  engine->interrupts = 0;
+  if(engine->cpuIntr == NULL || engine->plic == NULL || baud == 0) {
+    return I2C_ENGINE_NO_CONTROLLER;
+  }
+
+  // SCL = clockHz / (5 * (prescale + 1)), rounded to not exceed baud
+  uint32_t prescale = (clockHz + 5 * baud - 1) / (5 * baud);
+  prescale = prescale > 0 ? prescale - 1 : 0;
+  // The prescaler may only change while the core is disabled
+  i2cWrite(engine, I2C_REG_CTR, 0);
+  i2cWrite(engine, I2C_REG_PRERLO, prescale & 0xff);
+  i2cWrite(engine, I2C_REG_PRERHI, (prescale >> 8) & 0xff);
+  i2cWrite(engine, I2C_REG_CTR, I2C_CTR_EN | I2C_CTR_IEN);
+
+  metal_interrupt_init(engine->cpuIntr);
+  metal_interrupt_init(engine->plic);
+  if(metal_interrupt_register_handler(engine->plic, irq, i2cEngineInterrupt, engine) != 0 ||
+     metal_interrupt_set_priority(engine->plic, irq, I2C_ENGINE_PRIORITY) != 0 ||
+     metal_interrupt_enable(engine->plic, irq) != 0) {
+    return I2C_ENGINE_NO_IRQ;
+  }
+  metal_interrupt_enable(engine->cpuIntr, 0);
+  return I2C_ENGINE_OK;
+}
+
+/**
+ * Queue a transaction, without waiting for the bus
+ * The transaction, its buffers and the callback argument must stay valid
+ * until it completes. May be called from a completion callback.
+ * @param engine structure
+ * @param transaction addr, tx/txLen, rx/rxLen, done and arg filled in
+ * @return true (1) if queued, false (0) if the transaction is already queued
+ */
+int i2cEngineSubmit(struct i2cEngine *engine, struct i2cTransaction *transaction) {
+  if(transaction->status == I2C_PENDING) {
+    return false;
+  }
+  transaction->status = I2C_PENDING;
+  transaction->next = NULL;
+  metal_interrupt_disable(engine->plic, engine->irq);
+  if(engine->tail) {
+    engine->tail->next = transaction;
+  } else {
+    engine->head = transaction;
+  }
+  engine->tail = transaction;
+  if(engine->state == I2C_ENGINE_IDLE) {
+    i2cEngineStart(engine);
+  }
+  metal_interrupt_enable(engine->plic, engine->irq);
+  return true;
+}
+
+/**
+ * @param engine structure
+ * @return true (1) if no transaction is queued or on the wire
+ */
+int i2cEngineIdle(struct i2cEngine *engine) {
+  return engine->head == NULL;
+}
+
+static void i2cWaitForInterrupt(void) {
+#ifdef METAL_SIM_WFI
+  metal_sim_wfi();
+#else
+  __asm__ volatile("wfi");
+#endif
+}
+
+/**
+ * Sleep while a status is I2C_PENDING, other interrupts keep being served
+ * Not for use in interrupt context.
+ * @param engine structure
+ * @param status Set from interrupt context when the work completes
+ * @return the final status
+ */
+int i2cEngineWaitStatus(struct i2cEngine *engine, volatile int *status) {
+  metal_interrupt_disable(engine->cpuIntr, 0);
+  while(*status == I2C_PENDING) {
+    // A pending interrupt wakes wfi with interrupts off, so a completion
+    // that comes before wfi is not lost
+    i2cWaitForInterrupt();
+    metal_interrupt_enable(engine->cpuIntr, 0);
+    metal_interrupt_disable(engine->cpuIntr, 0);
+  }
+  metal_interrupt_enable(engine->cpuIntr, 0);
+  return *status;
+}
+
+/**
+ * Sleep until a transaction completes
+ * @param engine structure
+ * @param transaction Submitted with i2cEngineSubmit()
+ * @return status of the transaction
+ */
+int i2cEngineWait(struct i2cEngine *engine, struct i2cTransaction *transaction) {
+  return i2cEngineWaitStatus(engine, &transaction->status);
+}
@@ -0,0 +1,86 @@
+/*
+
+  Interrupt-driven transfer engine for the FE310 I2C master.
+
+  The FE310 has an OpenCores I2C core. The Metal driver polls its status
+  register byte by byte, so the CPU is busy for the whole transfer. The
+  engine instead issues one command per I2C interrupt from a queue of
+  transactions: a write phase, a repeated START and a read phase, either
+  phase may be empty. Each transaction completes with a status and an
+  optional callback, called in interrupt context.
+
+  The engine owns the core once initialized; do not mix it with the
+  metal_i2c_*() calls on the same core.
+
+*/
+
+#ifndef I2C_ENGINE_H
+#define I2C_ENGINE_H
+
+#include <stdint.h>
+#include <metal/interrupt.h>
+
+// I2C0 of the FE310-G002 and its PLIC source
+#define I2C_ENGINE_FE310_BASE 0x10016000
+#define I2C_ENGINE_FE310_IRQ 52
+
+// PLIC priority of the I2C interrupt
+#ifndef I2C_ENGINE_PRIORITY
+#define I2C_ENGINE_PRIORITY 2
+#endif
+
+typedef enum
+{
+	I2C_OK = 0,
+	I2C_PENDING,
+	I2C_NACK, // address or data byte not acknowledged
+	I2C_ARBITRATION_LOST,
+} i2c_status_t;
+
+// Outcome of i2cEngineInit()
+typedef enum
+{
+	I2C_ENGINE_OK = 0,
+	I2C_ENGINE_NO_CONTROLLER, // no CPU or PLIC interrupt controller, or a baud rate of 0
+	I2C_ENGINE_NO_IRQ, // the PLIC source cannot be hooked
+} i2c_engine_error_t;
+
+struct i2cTransaction;
+
+typedef void (*i2c_done_t)(struct i2cTransaction *transaction, void *arg);
+
+struct i2cTransaction {
+	unsigned char addr; // 7-bit address
+	const unsigned char *tx; // written first
+	unsigned int txLen;
+	unsigned char *rx; // read after a repeated START
+	unsigned int rxLen;
+	i2c_done_t done; // NULL if the caller waits or polls status
+	void *arg;
+	volatile int status; // i2c_status_t
+	struct i2cTransaction *next; // queue link, owned by the engine
+};
+
+struct i2cEngine {
+	uintptr_t base;
+	int irq;
+	struct metal_interrupt *cpuIntr;
+	struct metal_interrupt *plic;
+	struct i2cTransaction *head; // on the wire
+	struct i2cTransaction *tail;
+	unsigned char state;
+	unsigned char cmd; // last command written to CR
+	unsigned char result; // status of the transaction on the wire
+	unsigned int index; // next byte of the current phase
+	uint32_t completed;
+	uint32_t failed;
+	uint32_t interrupts;
+};
+
+i2c_engine_error_t i2cEngineInit(struct i2cEngine *engine, uintptr_t base, int irq, uint32_t clockHz, uint32_t baud);
+int i2cEngineSubmit(struct i2cEngine *engine, struct i2cTransaction *transaction);
+int i2cEngineIdle(struct i2cEngine *engine);
+int i2cEngineWaitStatus(struct i2cEngine *engine, volatile int *status);
+int i2cEngineWait(struct i2cEngine *engine, struct i2cTransaction *transaction);
+
+#endif // I2C_ENGINE_H
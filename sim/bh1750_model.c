@@ -0,0 +1,166 @@
+/*
+ * bh1750_model.c
+ *
+ * Behavioral model of a BH1750FVI. Timing and scaling follow the datasheet:
+ * H-resolution conversions take 120 ms (L-resolution 16 ms) at the default
+ * MTreg of 69 and scale linearly with MTreg; one count is 1/1.2 lx at
+ * MTreg 69, H-resolution mode 2 counts half steps and L-resolution mode
+ * only resolves 4 counts.
+ */
+#include <stddef.h>
+#include "bh1750_model.h"
+
+#define OP_POWER_DOWN 0x00
+#define OP_POWER_ON 0x01
+#define OP_RESET 0x07
+#define OP_MT_HIGH 0x40  // 01000_MT[7,6,5]
+#define OP_MT_LOW 0x60   // 011_MT[4,3,2,1,0]
+#define DEFAULT_MTREG 69
+
+static int is_measurement(unsigned char op) {
+  switch (op) {
+    case 0x10: case 0x11: case 0x13:
+    case 0x20: case 0x21: case 0x23:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+static int is_one_time(unsigned char op) {
+  return (op & 0x20) != 0;
+}
+
+static int is_low_res(unsigned char op) {
+  return (op & 0x0f) == 0x03;
+}
+
+uint16_t bh1750_model_count(unsigned char mode, unsigned char mtreg, double lux) {
+  double count = lux * 1.2 * mtreg / DEFAULT_MTREG;
+  if ((mode & 0x0f) == 0x01) {
+    count *= 2;
+  }
+  if (count >= 65535.0) {
+    return 65535;
+  }
+  uint16_t raw = (uint16_t)count;
+  if (is_low_res(mode)) {
+    raw &= ~3u;
+  }
+  return raw;
+}
+
+uint64_t bh1750_model_conversion_cycles(unsigned char mode, unsigned char mtreg,
+                                        unsigned int conv_permille) {
+  uint64_t us = is_low_res(mode) ? 16000 : 120000;
+  us = us * mtreg / DEFAULT_MTREG * conv_permille / 1000;
+  return us * SIM_TIMEBASE_HZ / 1000000;
+}
+
+static void power_on(struct bh1750_model *m, uint64_t now) {
+  if (!m->powered) {
+    m->powered = 1;
+    m->powered_since = now;
+  }
+}
+
+static void power_off(struct bh1750_model *m, uint64_t at) {
+  if (m->powered) {
+    m->active_cycles += at - m->powered_since;
+    m->powered = 0;
+  }
+}
+
+// Complete every conversion that has finished by now
+static void model_sync(struct bh1750_model *m) {
+  uint64_t now = sim_cycles();
+  if (m->mode == 0 || now < m->conv_end) {
+    return;
+  }
+  m->data = bh1750_model_count(m->mode, m->conv_mtreg, m->lux);
+  if (is_one_time(m->mode)) {
+    // One-time modes drop to power down after the conversion
+    m->conversions++;
+    m->mode = 0;
+    power_off(m, m->conv_end);
+    return;
+  }
+  uint64_t period = bh1750_model_conversion_cycles(m->mode, m->conv_mtreg, m->conv_permille);
+  uint64_t n = (now - m->conv_end) / period + 1;
+  m->conversions += (uint32_t)n;
+  m->conv_end += n * period;
+}
+
+static void model_command(struct bh1750_model *m, unsigned char op) {
+  uint64_t now = sim_cycles();
+  m->commands++;
+  if (op == OP_POWER_DOWN) {
+    m->mode = 0;
+    power_off(m, now);
+  } else if (op == OP_POWER_ON) {
+    power_on(m, now);
+  } else if (op == OP_RESET) {
+    // Not accepted in power down
+    if (m->powered) {
+      m->data = 0;
+    }
+  } else if (is_measurement(op)) {
+    power_on(m, now);
+    m->mode = op;
+    m->conv_mtreg = m->mtreg;
+    m->conv_end = now + bh1750_model_conversion_cycles(op, m->mtreg, m->conv_permille);
+  } else if ((op & 0xf8) == OP_MT_HIGH) {
+    m->mtreg = (unsigned char)((m->mtreg & 0x1f) | ((op & 0x07) << 5));
+  } else if ((op & 0xe0) == OP_MT_LOW) {
+    m->mtreg = (unsigned char)((m->mtreg & 0xe0) | (op & 0x1f));
+  }
+}
+
+static int model_write(struct sim_i2c_device *dev, const unsigned char *buf, unsigned int len) {
+  struct bh1750_model *m = (struct bh1750_model *)dev;
+  model_sync(m);
+  for (unsigned int i = 0; i < len; i++) {
+    model_command(m, buf[i]);
+  }
+  return 0;
+}
+
+static int model_read(struct sim_i2c_device *dev, unsigned char *buf, unsigned int len) {
+  struct bh1750_model *m = (struct bh1750_model *)dev;
+  model_sync(m);
+  m->reads++;
+  for (unsigned int i = 0; i < len; i++) {
+    if (i == 0) {
+      buf[i] = (unsigned char)(m->data >> 8);
+    } else if (i == 1) {
+      buf[i] = (unsigned char)(m->data & 0xff);
+    } else {
+      buf[i] = 0xff;
+    }
+  }
+  return 0;
+}
+
+void bh1750_model_init(struct bh1750_model *m, unsigned int addr, double lux) {
+  *m = (struct bh1750_model){
+    .dev = { .addr = addr, .write = model_write, .read = model_read },
+    .lux = lux,
+    .conv_permille = 1000,
+    .mtreg = DEFAULT_MTREG,
+    .conv_mtreg = DEFAULT_MTREG,
+  };
+}
+
+void bh1750_model_set_lux(struct bh1750_model *m, double lux) {
+  // Conversions that completed before the change saw the old value
+  model_sync(m);
+  m->lux = lux;
+}
+
+uint64_t bh1750_model_active_cycles(struct bh1750_model *m) {
+  model_sync(m);
+  if (m->powered) {
+    return m->active_cycles + (sim_cycles() - m->powered_since);
+  }
+  return m->active_cycles;
+}
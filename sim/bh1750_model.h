@@ -0,0 +1,62 @@
+/*
+ * bh1750_model.h
+ *
+ * Behavioral model of a BH1750FVI for the host-side simulator.
+ *
+ * The model decodes the instruction set from the datasheet (power down,
+ * power on, reset, the six measurement modes and the two-part MTreg
+ * command), runs conversions against the virtual clock and returns the
+ * data register big-endian on reads, like the real part.
+ */
+#ifndef BH1750_MODEL_H
+#define BH1750_MODEL_H
+
+#include <stdint.h>
+#include "sim.h"
+
+struct bh1750_model {
+  struct sim_i2c_device dev;
+  // Illuminance seen by the sensor
+  double lux;
+  // Conversion time of this unit relative to the datasheet typical time,
+  // 1000 = typical, 1500 = datasheet maximum
+  unsigned int conv_permille;
+
+  int powered;
+  unsigned char mode;        // measurement in progress, 0 if idle
+  unsigned char mtreg;       // value written through the MTreg commands
+  unsigned char conv_mtreg;  // MTreg latched by the measurement command
+  uint64_t conv_end;         // virtual time the current conversion completes
+  uint16_t data;
+  uint64_t powered_since;
+
+  uint32_t commands;
+  uint32_t conversions;
+  uint32_t reads;
+  uint64_t active_cycles;
+};
+
+void bh1750_model_init(struct bh1750_model *m, unsigned int addr, double lux);
+void bh1750_model_set_lux(struct bh1750_model *m, double lux);
+
+/**
+ * @return cycles the sensor has been powered so far
+ */
+uint64_t bh1750_model_active_cycles(struct bh1750_model *m);
+
+/**
+ * Data register value a conversion yields
+ * @param mode measurement opcode
+ * @param mtreg MTreg value
+ * @param lux illuminance
+ */
+uint16_t bh1750_model_count(unsigned char mode, unsigned char mtreg, double lux);
+
+/**
+ * Conversion time of a measurement
+ * @return core clock cycles
+ */
+uint64_t bh1750_model_conversion_cycles(unsigned char mode, unsigned char mtreg,
+                                        unsigned int conv_permille);
+
+#endif // BH1750_MODEL_H
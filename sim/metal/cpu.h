@@ -0,0 +1,34 @@
+/*
+ * metal/cpu.h
+ *
+ * Host-side stand-in for the Freedom Metal CPU API: the machine timer
+ * (mtime/mtimecmp) and the interrupt controllers of the hart. mtime runs
+ * from the simulated 32.768 kHz real-time clock, as on the FE310.
+ */
+#ifndef METAL__CPU_H
+#define METAL__CPU_H
+
+#include <metal/interrupt.h>
+
+// Not part of Metal: sleep with metal_sim_wfi() instead of the wfi
+// instruction, which the host cannot execute
+#define METAL_SIM_WFI 1
+
+struct metal_cpu;
+
+int metal_cpu_get_current_hartid(void);
+struct metal_cpu *metal_cpu_get(unsigned int hartid);
+unsigned long long metal_cpu_get_mtime(struct metal_cpu *cpu);
+int metal_cpu_set_mtimecmp(struct metal_cpu *cpu, unsigned long long time);
+struct metal_interrupt *metal_cpu_interrupt_controller(struct metal_cpu *cpu);
+struct metal_interrupt *metal_cpu_timer_interrupt_controller(struct metal_cpu *cpu);
+int metal_cpu_timer_get_interrupt_id(struct metal_cpu *cpu);
+
+/*
+ * Wait for interrupt: let virtual time run to the next timer interrupt.
+ * Like wfi, it wakes on a pending enabled interrupt even while interrupts
+ * are globally disabled; the handler then runs once they are enabled.
+ */
+void metal_sim_wfi(void);
+
+#endif // METAL__CPU_H
@@ -0,0 +1,37 @@
+/*
+ * metal/i2c.h
+ *
+ * Host-side stand-in for the Freedom Metal I2C API. Only the calls used by
+ * the BH1750 library and its examples are provided; they are implemented by
+ * sim/sim.c on top of a virtual clock and simulated bus devices.
+ */
+#ifndef METAL__I2C_H
+#define METAL__I2C_H
+
+#include <stdint.h>
+
+typedef enum {
+  METAL_I2C_SLAVE = 0,
+  METAL_I2C_MASTER = 1
+} metal_i2c_mode_t;
+
+typedef enum {
+  METAL_I2C_STOP_DISABLE = 0,
+  METAL_I2C_STOP_ENABLE = 1
+} metal_i2c_stop_bit_t;
+
+struct metal_i2c;
+
+struct metal_i2c *metal_i2c_get_device(unsigned int device_num);
+void metal_i2c_init(struct metal_i2c *i2c, unsigned int baud, metal_i2c_mode_t mode);
+int metal_i2c_write(struct metal_i2c *i2c, unsigned int addr, unsigned int len,
+                    unsigned char buf[], metal_i2c_stop_bit_t stop_bit);
+int metal_i2c_read(struct metal_i2c *i2c, unsigned int addr, unsigned int len,
+                   unsigned char buf[], metal_i2c_stop_bit_t stop_bit);
+int metal_i2c_transfer(struct metal_i2c *i2c, unsigned int addr,
+                       unsigned char txbuf[], unsigned int txlen,
+                       unsigned char rxbuf[], unsigned int rxlen);
+int metal_i2c_get_baud_rate(struct metal_i2c *i2c);
+int metal_i2c_set_baud_rate(struct metal_i2c *i2c, int baud_rate);
+
+#endif // METAL__I2C_H
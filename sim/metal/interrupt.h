@@ -0,0 +1,31 @@
+/*
+ * metal/interrupt.h
+ *
+ * Host-side stand-in for the Freedom Metal interrupt API. The simulated
+ * hart takes the machine timer interrupt and external interrupts through a
+ * PLIC; id 0 of the CPU interrupt controller is the global interrupt
+ * enable. As on the real PLIC, a source with priority 0 never interrupts.
+ */
+#ifndef METAL__INTERRUPT_H
+#define METAL__INTERRUPT_H
+
+struct metal_interrupt;
+
+typedef enum {
+  METAL_CPU_CONTROLLER = 0,
+  METAL_CLINT_CONTROLLER = 1,
+  METAL_CLIC_CONTROLLER = 2,
+  METAL_PLIC_CONTROLLER = 3
+} metal_intr_cntrl_type;
+
+typedef void (*metal_interrupt_handler_t)(int id, void *priv);
+
+struct metal_interrupt *metal_interrupt_get_controller(metal_intr_cntrl_type cntrl, int id);
+void metal_interrupt_init(struct metal_interrupt *controller);
+int metal_interrupt_register_handler(struct metal_interrupt *controller, int id,
+                                     metal_interrupt_handler_t handler, void *priv);
+int metal_interrupt_set_priority(struct metal_interrupt *controller, int id, unsigned int priority);
+int metal_interrupt_enable(struct metal_interrupt *controller, int id);
+int metal_interrupt_disable(struct metal_interrupt *controller, int id);
+
+#endif // METAL__INTERRUPT_H
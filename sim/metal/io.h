@@ -0,0 +1,24 @@
+/*
+ * metal/io.h
+ *
+ * Host-side stand-in for the Freedom Metal MMIO helpers. The host cannot
+ * dereference peripheral addresses, so register accesses go through
+ * metal_sim_mmio_read32()/metal_sim_mmio_write32() to the models mapped
+ * with sim_mmio_map().
+ */
+#ifndef METAL__IO_H
+#define METAL__IO_H
+
+#include <stdint.h>
+
+// Not part of Metal: access registers with the functions below
+#define METAL_SIM_MMIO 1
+
+#define __METAL_ACCESS_ONCE(x) (*(__typeof__(*x) volatile *)(x))
+
+typedef uint32_t __metal_io_u32;
+
+uint32_t metal_sim_mmio_read32(uintptr_t addr);
+void metal_sim_mmio_write32(uintptr_t addr, uint32_t value);
+
+#endif // METAL__IO_H
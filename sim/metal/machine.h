@@ -0,0 +1,11 @@
+/*
+ * metal/machine.h
+ *
+ * Host-side stand-in for the generated Freedom Metal machine header. The
+ * simulated machine has no devicetree; everything it provides lives in
+ * sim/sim.h.
+ */
+#ifndef METAL__MACHINE_H
+#define METAL__MACHINE_H
+
+#endif // METAL__MACHINE_H
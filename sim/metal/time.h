@@ -0,0 +1,13 @@
+/*
+ * metal/time.h
+ *
+ * Host-side stand-in for the Freedom Metal time API.
+ */
+#ifndef METAL__TIME_H
+#define METAL__TIME_H
+
+#include <time.h>
+
+time_t metal_time(void);
+
+#endif // METAL__TIME_H
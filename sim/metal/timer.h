@@ -0,0 +1,15 @@
+/*
+ * metal/timer.h
+ *
+ * Host-side stand-in for the Freedom Metal timer API. The cycle counter is
+ * the simulator's virtual clock (see sim/sim.h).
+ */
+#ifndef METAL__TIMER_H
+#define METAL__TIMER_H
+
+int metal_timer_get_cyclecount(int hartid, unsigned long long *cyclecount);
+int metal_timer_get_timebase_frequency(int hartid, unsigned long long *timebase);
+int metal_timer_get_machine_time(int hartid);
+int metal_timer_set_machine_time(int hartid, unsigned long long time);
+
+#endif // METAL__TIMER_H
@@ -0,0 +1,173 @@
+/*
+ * ocores_i2c_model.c
+ *
+ * Register-level model of the OpenCores I2C master.
+ */
+#include <stddef.h>
+#include <string.h>
+#include "ocores_i2c_model.h"
+
+#define REG_PRERLO 0x00
+#define REG_PRERHI 0x04
+#define REG_CTR 0x08
+#define REG_TXR_RXR 0x0C
+#define REG_CR_SR 0x10
+
+#define CTR_EN 0x80
+#define CTR_IEN 0x40
+
+#define CR_STA 0x80
+#define CR_STO 0x40
+#define CR_RD 0x20
+#define CR_WR 0x10
+#define CR_ACK 0x08
+#define CR_IACK 0x01
+
+#define SR_RXACK 0x80
+#define SR_BUSY 0x40
+#define SR_AL 0x20
+#define SR_TIP 0x02
+#define SR_IF 0x01
+
+static void update_irq(struct ocores_i2c_model *m) {
+  sim_irq_set(m->irq, (m->ctr & CTR_IEN) && (m->sr & SR_IF));
+}
+
+// Hand the bytes written since the address to the device
+static void flush_write(struct ocores_i2c_model *m) {
+  if (m->dev && !m->reading && m->wlen > 0 && m->dev->write(m->dev, m->wbuf, m->wlen) != 0) {
+    sim_bus_nack(m->bus);
+  }
+  m->wlen = 0;
+}
+
+static void address(struct ocores_i2c_model *m, unsigned char byte) {
+  m->addressing = 0;
+  m->reading = byte & 1;
+  m->wlen = 0;
+  m->rpos = 0;
+  m->dev = sim_bus_find(m->bus, byte >> 1);
+  if (m->dev && m->reading) {
+    memset(m->rbuf, 0xff, sizeof(m->rbuf));
+    if (m->dev->read(m->dev, m->rbuf, sizeof(m->rbuf)) != 0) {
+      m->dev = NULL;
+    }
+  }
+}
+
+// The command written to CR has gone out on the wire
+static void command_done(void *ctx) {
+  struct ocores_i2c_model *m = (struct ocores_i2c_model *)ctx;
+  unsigned int starts = 0, bytes = 0, bits = 0;
+
+  if (m->cmd & CR_STA) {
+    // Repeated START ends the write phase like a STOP would
+    flush_write(m);
+    m->sr |= SR_BUSY;
+    m->addressing = 1;
+    starts = 1;
+    bits += 1;
+  }
+  if (m->cmd & CR_WR) {
+    int ack;
+    if (m->addressing) {
+      address(m, m->txr);
+      ack = m->dev != NULL;
+    } else {
+      ack = m->dev != NULL && !m->reading && m->wlen < sizeof(m->wbuf);
+      if (ack) {
+        m->wbuf[m->wlen++] = m->txr;
+      }
+    }
+    if (ack) {
+      m->sr &= ~SR_RXACK;
+    } else {
+      m->sr |= SR_RXACK;
+      sim_bus_nack(m->bus);
+    }
+    bytes++;
+    bits += 9;
+  } else if (m->cmd & CR_RD) {
+    m->rxr = m->dev && m->reading && m->rpos < sizeof(m->rbuf) ? m->rbuf[m->rpos++] : 0xff;
+    bytes++;
+    bits += 9;
+  }
+  if (m->cmd & CR_STO) {
+    flush_write(m);
+    m->dev = NULL;
+    m->sr &= ~SR_BUSY;
+    bits += 1;
+  }
+  sim_bus_account(m->bus, starts, bytes, bits);
+  m->cmd = 0;
+  m->sr = (m->sr & ~SR_TIP) | SR_IF;
+  update_irq(m);
+}
+
+static void write_command(struct ocores_i2c_model *m, uint8_t cr) {
+  if (cr & CR_IACK) {
+    m->sr &= ~SR_IF;
+  }
+  uint8_t cmd = cr & (CR_STA | CR_STO | CR_RD | CR_WR);
+  if (cmd && (m->ctr & CTR_EN)) {
+    if (m->sr & SR_TIP) {
+      m->ignored++;
+    } else {
+      unsigned int bits = (cmd & CR_STA ? 1 : 0) + (cmd & (CR_RD | CR_WR) ? 9 : 0) + (cmd & CR_STO ? 1 : 0);
+      m->commands++;
+      m->cmd = cmd;
+      m->sr |= SR_TIP;
+      sim_schedule(sim_cycles() + bits * 5 * ((uint64_t)m->prescale + 1), command_done, m);
+    }
+  }
+  update_irq(m);
+}
+
+static uint32_t model_read32(void *ctx, uintptr_t offset) {
+  struct ocores_i2c_model *m = (struct ocores_i2c_model *)ctx;
+  switch (offset) {
+  case REG_PRERLO:
+    return m->prescale & 0xff;
+  case REG_PRERHI:
+    return m->prescale >> 8;
+  case REG_CTR:
+    return m->ctr;
+  case REG_TXR_RXR:
+    return m->rxr;
+  case REG_CR_SR:
+    return m->sr;
+  default:
+    return 0;
+  }
+}
+
+static void model_write32(void *ctx, uintptr_t offset, uint32_t value) {
+  struct ocores_i2c_model *m = (struct ocores_i2c_model *)ctx;
+  switch (offset) {
+  case REG_PRERLO:
+    m->prescale = (uint16_t)((m->prescale & 0xff00) | (value & 0xff));
+    break;
+  case REG_PRERHI:
+    m->prescale = (uint16_t)((m->prescale & 0x00ff) | ((value & 0xff) << 8));
+    break;
+  case REG_CTR:
+    m->ctr = (uint8_t)(value & (CTR_EN | CTR_IEN));
+    update_irq(m);
+    break;
+  case REG_TXR_RXR:
+    m->txr = (uint8_t)value;
+    break;
+  case REG_CR_SR:
+    write_command(m, (uint8_t)value);
+    break;
+  default:
+    break;
+  }
+}
+
+static const struct sim_mmio_ops model_ops = { model_read32, model_write32 };
+
+void ocores_i2c_model_init(struct ocores_i2c_model *m, uintptr_t base, int irq, struct metal_i2c *bus) {
+  *m = (struct ocores_i2c_model){ .bus = bus, .irq = irq, .prescale = 0xffff };
+  sim_mmio_map(base, OCORES_I2C_MODEL_SIZE, &model_ops, m);
+}
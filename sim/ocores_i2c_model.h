@@ -0,0 +1,50 @@
+/*
+ * ocores_i2c_model.h
+ *
+ * Register-level model of the OpenCores I2C master in the FE310 for the
+ * host-side simulator. The registers sit at a 4-byte stride as on the
+ * FE310: PRERlo, PRERhi, CTR, TXR/RXR and CR/SR. A command written to CR
+ * takes as many SCL periods as it would on the wire (5 * (prescale + 1)
+ * core cycles each), then sets IF and, with CTR.IEN, raises the interrupt
+ * line. The model drives the simulated devices of a bus, so the same
+ * devices answer the Metal driver and code that programs the core
+ * directly.
+ */
+#ifndef OCORES_I2C_MODEL_H
+#define OCORES_I2C_MODEL_H
+
+#include <stdint.h>
+#include "sim.h"
+
+#define OCORES_I2C_MODEL_SIZE 0x1000
+
+// Bytes a device can return for one read phase
+#define OCORES_I2C_MODEL_BUFFER 16
+
+struct ocores_i2c_model {
+  struct metal_i2c *bus;
+  int irq;
+  uint16_t prescale;
+  uint8_t ctr;
+  uint8_t txr;
+  uint8_t rxr;
+  uint8_t sr;
+  uint8_t cmd;                // command in progress
+  int addressing;             // next WR carries the address byte
+  int reading;                // addressed for a read
+  struct sim_i2c_device *dev; // addressed device, NULL if NACKed
+  unsigned char wbuf[OCORES_I2C_MODEL_BUFFER];
+  unsigned int wlen;
+  unsigned char rbuf[OCORES_I2C_MODEL_BUFFER];
+  unsigned int rpos;
+
+  uint32_t commands;
+  uint32_t ignored; // commands written while one was in progress
+};
+
+/**
+ * Map the core at base and connect it to a bus and a PLIC source
+ */
+void ocores_i2c_model_init(struct ocores_i2c_model *m, uintptr_t base, int irq, struct metal_i2c *bus);
+
+#endif // OCORES_I2C_MODEL_H
@@ -0,0 +1,586 @@
+/*
+ * sim.c
+ *
+ * Virtual clock and I2C buses behind the Metal stand-in headers.
+ */
+#include <stddef.h>
+#include <string.h>
+#include <metal/i2c.h>
+#include <metal/timer.h>
+#include <metal/time.h>
+#include <metal/cpu.h>
+#include <metal/interrupt.h>
+#include "sim.h"
+
+struct metal_i2c {
+  unsigned int baud;
+  unsigned int fault_baud;     // transfers faster than this may fail
+  unsigned int fault_permille;
+  int stuck;                   // a device holds the bus, transfers time out
+  struct sim_i2c_device *devices[SIM_I2C_MAX_DEVICES];
+  unsigned int ndevices;
+  struct sim_bus_stats stats;
+};
+
+struct metal_cpu {
+  int hartid;
+};
+
+// Kind of controller: the CPU's (id 0 = global enable), the timer's or the PLIC
+struct metal_interrupt {
+  int type;
+};
+
+#define SIM_INTC_CPU 0
+#define SIM_INTC_TIMER 1
+#define SIM_INTC_PLIC 2
+
+struct sim_plic_line {
+  metal_interrupt_handler_t handler;
+  void *priv;
+  unsigned int priority;
+  int enabled;
+  int level;
+};
+
+struct sim_event {
+  uint64_t cycle;
+  sim_event_fn fn;
+  void *ctx;
+};
+
+struct sim_mmio_region {
+  uintptr_t base;
+  uintptr_t size;
+  const struct sim_mmio_ops *ops;
+  void *ctx;
+};
+
+static struct metal_i2c _bus[SIM_I2C_BUSES];
+static uint64_t _cycles;
+static uint32_t _fault_seed;
+
+static struct metal_cpu _cpu;
+static struct metal_interrupt _cpu_intc = { SIM_INTC_CPU };
+static struct metal_interrupt _timer_intc = { SIM_INTC_TIMER };
+static struct metal_interrupt _plic = { SIM_INTC_PLIC };
+static uint64_t _mtimecmp;
+static int _global_enabled;
+static int _timer_enabled;
+static metal_interrupt_handler_t _timer_handler;
+static void *_timer_priv;
+static struct sim_plic_line _plic_line[SIM_PLIC_SOURCES];
+static int _in_handler;
+static struct sim_cpu_stats _cpu_stats;
+
+static struct sim_event _events[SIM_MAX_EVENTS];
+static unsigned int _nevents;
+static struct sim_mmio_region _mmio[SIM_MAX_MMIO];
+static unsigned int _nmmio;
+
+static uint64_t mtime(void) {
+  // SIM_TIMEBASE_HZ / SIM_MTIME_HZ = 15625 / 32 for 16 MHz and 32.768 kHz
+  return _cycles * (SIM_MTIME_HZ / 1024) / (SIM_TIMEBASE_HZ / 1024);
+}
+
+// First cycle at which mtime reaches mtimecmp
+static uint64_t timer_fire_cycle(void) {
+  return (_mtimecmp * (SIM_TIMEBASE_HZ / 1024) + (SIM_MTIME_HZ / 1024) - 1) / (SIM_MTIME_HZ / 1024);
+}
+
+static int timer_pending(void) {
+  return _timer_enabled && _mtimecmp != UINT64_MAX && mtime() >= _mtimecmp;
+}
+
+// Highest priority PLIC source that is asserted and enabled, 0 if none
+static int plic_pending(void) {
+  int best = 0;
+  for (int id = 1; id < SIM_PLIC_SOURCES; id++) {
+    struct sim_plic_line *line = &_plic_line[id];
+    if (line->level && line->enabled && line->priority > 0 &&
+        (best == 0 || line->priority > _plic_line[best].priority)) {
+      best = id;
+    }
+  }
+  return best;
+}
+
+// Run the events that are due, in time order
+static void run_events(void) {
+  while (_nevents > 0) {
+    unsigned int first = 0;
+    for (unsigned int i = 1; i < _nevents; i++) {
+      if (_events[i].cycle < _events[first].cycle) {
+        first = i;
+      }
+    }
+    if (_events[first].cycle > _cycles) {
+      return;
+    }
+    struct sim_event ev = _events[first];
+    _events[first] = _events[--_nevents];
+    ev.fn(ev.ctx);
+  }
+}
+
+// Earliest cycle something can happen without the CPU: an event, or the
+// timer if its interrupt would be taken (any: if it would wake wfi)
+static uint64_t next_wake(int any) {
+  uint64_t next = UINT64_MAX;
+  for (unsigned int i = 0; i < _nevents; i++) {
+    if (_events[i].cycle < next) {
+      next = _events[i].cycle;
+    }
+  }
+  int takeable = any || (_global_enabled && !_in_handler && _timer_handler);
+  if (takeable && _timer_enabled && _mtimecmp != UINT64_MAX && timer_fire_cycle() < next) {
+    next = timer_fire_cycle();
+  }
+  return next;
+}
+
+/*
+ * Take one pending interrupt if interrupts are enabled: external (PLIC)
+ * before timer, as the hart prioritizes them. Entry and exit cost
+ * SIM_IRQ_CYCLES on top of the handler's own work.
+ * @return 1 if a handler ran, -1 if it left its interrupt pending, else 0
+ */
+static int irq_deliver(void) {
+  if (!_global_enabled || _in_handler) {
+    return 0;
+  }
+  int id = plic_pending();
+  if (id != 0 && _plic_line[id].handler) {
+    _in_handler = 1;
+    _cpu_stats.external_interrupts++;
+    _cycles += SIM_IRQ_CYCLES;
+    _plic_line[id].handler(id, _plic_line[id].priv);
+    _in_handler = 0;
+    return plic_pending() == id ? -1 : 1;
+  }
+  if (timer_pending() && _timer_handler) {
+    uint64_t mtimecmp = _mtimecmp;
+    _in_handler = 1;
+    _cpu_stats.timer_interrupts++;
+    _cycles += SIM_IRQ_CYCLES;
+    _timer_handler(METAL_SIM_TIMER_ID, _timer_priv);
+    _in_handler = 0;
+    return _mtimecmp == mtimecmp && timer_pending() ? -1 : 1;
+  }
+  return 0;
+}
+
+/*
+ * Let the CPU work for some cycles. Events and interrupts that come due in
+ * between happen at their cycle; an interrupt preempts the work, which
+ * finishes later by as long as the handler ran.
+ */
+static void advance(uint64_t cycles) {
+  uint64_t end = _cycles + cycles;
+  for (;;) {
+    uint64_t next = next_wake(0);
+    if (next > end) {
+      break;
+    }
+    if (next > _cycles) {
+      _cycles = next;
+    }
+    run_events();
+    uint64_t before = _cycles;
+    int taken = irq_deliver();
+    end += _cycles - before;
+    if (taken < 0) {
+      break; // handler left the interrupt pending
+    }
+  }
+  _cycles = end;
+  run_events();
+  irq_deliver();
+}
+
+void sim_reset(void) {
+  memset(_bus, 0, sizeof(_bus));
+  _cycles = 0;
+  _fault_seed = 1;
+  // Handlers and the global enable belong to the code under test, whose
+  // static state survives a reset of the simulation
+  _mtimecmp = UINT64_MAX;
+  _timer_enabled = 0;
+  for (int id = 0; id < SIM_PLIC_SOURCES; id++) {
+    _plic_line[id].level = 0;
+  }
+  _nevents = 0;
+  _nmmio = 0;
+  memset(&_cpu_stats, 0, sizeof(_cpu_stats));
+}
+
+uint64_t sim_cycles(void) {
+  return _cycles;
+}
+
+void sim_advance_cycles(uint64_t cycles) {
+  advance(cycles);
+}
+
+void sim_advance_us(uint32_t us) {
+  advance((uint64_t)us * SIM_TIMEBASE_HZ / 1000000);
+}
+
+void sim_cpu_stats(struct sim_cpu_stats *stats) {
+  *stats = _cpu_stats;
+}
+
+int sim_attach(unsigned int bus, struct sim_i2c_device *dev) {
+  if (bus >= SIM_I2C_BUSES || _bus[bus].ndevices >= SIM_I2C_MAX_DEVICES) {
+    return -1;
+  }
+  _bus[bus].devices[_bus[bus].ndevices++] = dev;
+  return 0;
+}
+
+void sim_bus_stats(struct metal_i2c *i2c, struct sim_bus_stats *stats) {
+  *stats = i2c->stats;
+}
+
+void sim_bus_stats_reset(struct metal_i2c *i2c) {
+  memset(&i2c->stats, 0, sizeof(i2c->stats));
+}
+
+uint64_t sim_bus_time_ns(uint64_t bits, unsigned int baud) {
+  return bits * 1000000000ULL / baud;
+}
+
+/*
+ * Account one addressed phase (START or repeated START, address, payload,
+ * optional STOP) and block the CPU for as long as it takes on the wire.
+ */
+static void bus_clock(struct metal_i2c *i2c, unsigned int bytes, int stop) {
+  uint64_t bits = 1 + 9 * (uint64_t)bytes + (stop ? 1 : 0);
+  sim_bus_account(i2c, 1, bytes, bits);
+  advance(bits * SIM_TIMEBASE_HZ / (i2c->baud ? i2c->baud : 100000));
+}
+
+void sim_bus_account(struct metal_i2c *i2c, unsigned int starts, unsigned int bytes, uint64_t bits) {
+  i2c->stats.transactions += starts;
+  i2c->stats.bytes += bytes;
+  i2c->stats.bits += bits;
+}
+
+void sim_bus_nack(struct metal_i2c *i2c) {
+  i2c->stats.nacks++;
+}
+
+void sim_bus_set_faults(struct metal_i2c *i2c, unsigned int max_baud, unsigned int permille) {
+  i2c->fault_baud = max_baud;
+  i2c->fault_permille = permille;
+}
+
+void sim_bus_set_stuck(struct metal_i2c *i2c, int stuck) {
+  i2c->stuck = stuck;
+}
+
+// Held bus: the driver waits for the bus, then gives up
+static int bus_stuck(struct metal_i2c *i2c) {
+  if (!i2c->stuck) {
+    return 0;
+  }
+  advance(SIM_I2C_TIMEOUT_US * SIM_TIMEBASE_HZ / 1000000);
+  return 1;
+}
+
+// Marginal wiring: some transfers above the bus's reliable speed fail
+static int bus_fault(struct metal_i2c *i2c) {
+  if (i2c->fault_permille == 0 || i2c->baud <= i2c->fault_baud) {
+    return 0;
+  }
+  _fault_seed = _fault_seed * 1103515245u + 12345u;
+  return (_fault_seed >> 16) % 1000 < i2c->fault_permille;
+}
+
+struct sim_i2c_device *sim_bus_find(struct metal_i2c *i2c, unsigned int addr) {
+  for (unsigned int i = 0; i < i2c->ndevices; i++) {
+    if (i2c->devices[i]->addr == addr) {
+      return i2c->devices[i];
+    }
+  }
+  // Devices behind a switch answer only while their segment is connected
+  for (unsigned int i = 0; i < i2c->ndevices; i++) {
+    if (i2c->devices[i]->route) {
+      struct sim_i2c_device *dev = i2c->devices[i]->route(i2c->devices[i], addr);
+      if (dev) {
+        return dev;
+      }
+    }
+  }
+  return NULL;
+}
+
+struct metal_i2c *metal_i2c_get_device(unsigned int device_num) {
+  if (device_num >= SIM_I2C_BUSES) {
+    return NULL;
+  }
+  return &_bus[device_num];
+}
+
+void metal_i2c_init(struct metal_i2c *i2c, unsigned int baud, metal_i2c_mode_t mode) {
+  (void)mode;
+  i2c->baud = baud;
+}
+
+int metal_i2c_get_baud_rate(struct metal_i2c *i2c) {
+  return (int)i2c->baud;
+}
+
+int metal_i2c_set_baud_rate(struct metal_i2c *i2c, int baud_rate) {
+  i2c->baud = (unsigned int)baud_rate;
+  return 0;
+}
+
+int metal_i2c_write(struct metal_i2c *i2c, unsigned int addr, unsigned int len,
+                    unsigned char buf[], metal_i2c_stop_bit_t stop_bit) {
+  if (bus_stuck(i2c)) {
+    return SIM_I2C_TIMEOUT;
+  }
+  struct sim_i2c_device *dev = sim_bus_find(i2c, addr);
+  if (dev == NULL || bus_fault(i2c) || dev->write(dev, buf, len) != 0) {
+    // Address or data NACKed, the driver releases the bus right away
+    bus_clock(i2c, 1, 1);
+    sim_bus_nack(i2c);
+    return SIM_I2C_NACK;
+  }
+  bus_clock(i2c, 1 + len, stop_bit == METAL_I2C_STOP_ENABLE);
+  return SIM_I2C_OK;
+}
+
+int metal_i2c_read(struct metal_i2c *i2c, unsigned int addr, unsigned int len,
+                   unsigned char buf[], metal_i2c_stop_bit_t stop_bit) {
+  if (bus_stuck(i2c)) {
+    return SIM_I2C_TIMEOUT;
+  }
+  struct sim_i2c_device *dev = sim_bus_find(i2c, addr);
+  if (dev == NULL || bus_fault(i2c) || dev->read(dev, buf, len) != 0) {
+    bus_clock(i2c, 1, 1);
+    sim_bus_nack(i2c);
+    return SIM_I2C_NACK;
+  }
+  bus_clock(i2c, 1 + len, stop_bit == METAL_I2C_STOP_ENABLE);
+  return SIM_I2C_OK;
+}
+
+int metal_i2c_transfer(struct metal_i2c *i2c, unsigned int addr,
+                       unsigned char txbuf[], unsigned int txlen,
+                       unsigned char rxbuf[], unsigned int rxlen) {
+  // Same sequence as the FE310 driver: write, repeated START, read, STOP
+  int ret = metal_i2c_write(i2c, addr, txlen, txbuf, METAL_I2C_STOP_DISABLE);
+  if (ret != SIM_I2C_OK) {
+    return ret;
+  }
+  return metal_i2c_read(i2c, addr, rxlen, rxbuf, METAL_I2C_STOP_ENABLE);
+}
+
+int metal_timer_get_cyclecount(int hartid, unsigned long long *cyclecount) {
+  (void)hartid;
+  advance(SIM_TIMER_READ_CYCLES);
+  *cyclecount = _cycles;
+  return 0;
+}
+
+int metal_timer_get_timebase_frequency(int hartid, unsigned long long *timebase) {
+  (void)hartid;
+  *timebase = SIM_TIMEBASE_HZ;
+  return 0;
+}
+
+int metal_timer_get_machine_time(int hartid) {
+  (void)hartid;
+  return (int)_cycles;
+}
+
+int metal_timer_set_machine_time(int hartid, unsigned long long time) {
+  (void)hartid;
+  _cycles = time;
+  return 0;
+}
+
+int metal_cpu_get_current_hartid(void) {
+  return 0;
+}
+
+struct metal_cpu *metal_cpu_get(unsigned int hartid) {
+  return hartid == 0 ? &_cpu : NULL;
+}
+
+unsigned long long metal_cpu_get_mtime(struct metal_cpu *cpu) {
+  (void)cpu;
+  // mtime is a CLINT register, as costly to read as the cycle counter
+  advance(SIM_TIMER_READ_CYCLES);
+  return mtime();
+}
+
+int metal_cpu_set_mtimecmp(struct metal_cpu *cpu, unsigned long long time) {
+  (void)cpu;
+  _mtimecmp = time;
+  irq_deliver();
+  return 0;
+}
+
+struct metal_interrupt *metal_cpu_interrupt_controller(struct metal_cpu *cpu) {
+  (void)cpu;
+  return &_cpu_intc;
+}
+
+struct metal_interrupt *metal_cpu_timer_interrupt_controller(struct metal_cpu *cpu) {
+  (void)cpu;
+  return &_timer_intc;
+}
+
+int metal_cpu_timer_get_interrupt_id(struct metal_cpu *cpu) {
+  (void)cpu;
+  return METAL_SIM_TIMER_ID;
+}
+
+void metal_sim_wfi(void) {
+  uint64_t start = _cycles;
+  _cpu_stats.wfi++;
+  // Like wfi, wake on a pending enabled interrupt whatever the global enable
+  while (!timer_pending() && plic_pending() == 0) {
+    uint64_t next = next_wake(1);
+    if (next == UINT64_MAX) {
+      // Nothing would wake the hart
+      _cpu_stats.stuck++;
+      break;
+    }
+    if (next > _cycles) {
+      _cycles = next;
+    }
+    run_events();
+  }
+  _cpu_stats.sleep_cycles += _cycles - start;
+  irq_deliver();
+}
+
+struct metal_interrupt *metal_interrupt_get_controller(metal_intr_cntrl_type cntrl, int id) {
+  if (id != 0) {
+    return NULL;
+  }
+  switch (cntrl) {
+  case METAL_CPU_CONTROLLER:
+    return &_cpu_intc;
+  case METAL_CLINT_CONTROLLER:
+    return &_timer_intc;
+  case METAL_PLIC_CONTROLLER:
+    return &_plic;
+  default:
+    return NULL;
+  }
+}
+
+void metal_interrupt_init(struct metal_interrupt *controller) {
+  (void)controller;
+}
+
+int metal_interrupt_register_handler(struct metal_interrupt *controller, int id,
+                                     metal_interrupt_handler_t handler, void *priv) {
+  if (controller->type == SIM_INTC_PLIC && id > 0 && id < SIM_PLIC_SOURCES) {
+    _plic_line[id].handler = handler;
+    _plic_line[id].priv = priv;
+    return 0;
+  }
+  if (controller->type != SIM_INTC_TIMER || id != METAL_SIM_TIMER_ID) {
+    return -1;
+  }
+  _timer_handler = handler;
+  _timer_priv = priv;
+  return 0;
+}
+
+int metal_interrupt_set_priority(struct metal_interrupt *controller, int id, unsigned int priority) {
+  if (controller->type != SIM_INTC_PLIC || id <= 0 || id >= SIM_PLIC_SOURCES || priority > 7) {
+    return -1;
+  }
+  _plic_line[id].priority = priority;
+  irq_deliver();
+  return 0;
+}
+
+static int intc_set(struct metal_interrupt *controller, int id, int enabled) {
+  switch (controller->type) {
+  case SIM_INTC_TIMER:
+    if (id != METAL_SIM_TIMER_ID) {
+      return -1;
+    }
+    _timer_enabled = enabled;
+    return 0;
+  case SIM_INTC_PLIC:
+    if (id <= 0 || id >= SIM_PLIC_SOURCES) {
+      return -1;
+    }
+    _plic_line[id].enabled = enabled;
+    return 0;
+  default:
+    _global_enabled = enabled;
+    return 0;
+  }
+}
+
+int metal_interrupt_enable(struct metal_interrupt *controller, int id) {
+  int ret = intc_set(controller, id, 1);
+  irq_deliver();
+  return ret;
+}
+
+int metal_interrupt_disable(struct metal_interrupt *controller, int id) {
+  return intc_set(controller, id, 0);
+}
+
+int sim_schedule(uint64_t cycle, sim_event_fn fn, void *ctx) {
+  if (_nevents >= SIM_MAX_EVENTS) {
+    return -1;
+  }
+  _events[_nevents++] = (struct sim_event){ cycle, fn, ctx };
+  return 0;
+}
+
+void sim_irq_set(int id, int level) {
+  if (id > 0 && id < SIM_PLIC_SOURCES) {
+    _plic_line[id].level = level;
+  }
+}
+
+int sim_mmio_map(uintptr_t base, uintptr_t size, const struct sim_mmio_ops *ops, void *ctx) {
+  if (_nmmio >= SIM_MAX_MMIO) {
+    return -1;
+  }
+  _mmio[_nmmio++] = (struct sim_mmio_region){ base, size, ops, ctx };
+  return 0;
+}
+
+static struct sim_mmio_region *mmio_find(uintptr_t addr) {
+  for (unsigned int i = 0; i < _nmmio; i++) {
+    if (addr - _mmio[i].base < _mmio[i].size) {
+      return &_mmio[i];
+    }
+  }
+  return NULL;
+}
+
+uint32_t metal_sim_mmio_read32(uintptr_t addr) {
+  advance(SIM_MMIO_CYCLES);
+  struct sim_mmio_region *region = mmio_find(addr);
+  // Unmapped addresses read as zero
+  return region ? region->ops->read32(region->ctx, addr - region->base) : 0;
+}
+
+void metal_sim_mmio_write32(uintptr_t addr, uint32_t value) {
+  advance(SIM_MMIO_CYCLES);
+  struct sim_mmio_region *region = mmio_find(addr);
+  if (region) {
+    region->ops->write32(region->ctx, addr - region->base, value);
+  }
+  // A write may raise an interrupt line
+  irq_deliver();
+}
+
+time_t metal_time(void) {
+  return (time_t)(_cycles / SIM_TIMEBASE_HZ);
+}
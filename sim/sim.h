@@ -0,0 +1,174 @@
+/*
+ * sim.h
+ *
+ * Host-side simulation of the parts of a HiFive1 Rev B that the BH1750
+ * library touches: a virtual cycle counter and a set of I2C buses with
+ * simulated devices attached to them.
+ *
+ * The virtual clock only moves when the code under test does something that
+ * costs time on the board: reading the cycle counter, or clocking bytes over
+ * an I2C bus (the Metal driver polls the I2C core, so the CPU is blocked for
+ * the whole transfer). A busy-wait in delay() therefore terminates, and the
+ * time it reports is what the board would have spent.
+ *
+ * Register-level peripheral models map MMIO regions and schedule events on
+ * the virtual clock; an event may raise a PLIC interrupt line, whose
+ * handler preempts the CPU like the timer's does.
+ */
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include <metal/i2c.h>
+
+// Core clock reported by metal_timer_get_timebase_frequency()
+#define SIM_TIMEBASE_HZ 16000000ULL
+
+// Rate of mtime, the machine timer behind mtimecmp interrupts
+#define SIM_MTIME_HZ 32768ULL
+
+// Interrupt id of the machine timer on the timer interrupt controller
+#define METAL_SIM_TIMER_ID 7
+
+// Cycles charged for every read of the cycle counter
+#define SIM_TIMER_READ_CYCLES 8
+
+// Cycles charged for every peripheral register access
+#define SIM_MMIO_CYCLES 4
+
+// Cycles charged for entering and leaving an interrupt handler
+#define SIM_IRQ_CYCLES 64
+
+// Interrupt sources of the PLIC stand-in (the FE310 has 52)
+#define SIM_PLIC_SOURCES 64
+
+#define SIM_MAX_EVENTS 16
+#define SIM_MAX_MMIO 4
+
+#define SIM_I2C_BUSES 4
+#define SIM_I2C_MAX_DEVICES 16
+
+// Return codes of the Metal I2C calls
+#define SIM_I2C_OK 0
+#define SIM_I2C_NACK -1
+#define SIM_I2C_TIMEOUT -2
+
+// Time a transfer waits on a held bus before the driver gives up
+#define SIM_I2C_TIMEOUT_US 1000
+
+/*
+ * A device on a simulated bus. write() and read() are called once per
+ * addressed transaction with the whole payload; a non-zero return NACKs it.
+ * Switches such as I2C multiplexers also implement route(), which returns
+ * the downstream device currently reachable at an address, or NULL.
+ */
+struct sim_i2c_device {
+  unsigned int addr;
+  int (*write)(struct sim_i2c_device *dev, const unsigned char *buf, unsigned int len);
+  int (*read)(struct sim_i2c_device *dev, unsigned char *buf, unsigned int len);
+  struct sim_i2c_device *(*route)(struct sim_i2c_device *dev, unsigned int addr);
+};
+
+struct sim_bus_stats {
+  uint32_t transactions; // START conditions, repeated starts included
+  uint32_t bytes;        // bytes on the wire, address bytes included
+  uint32_t nacks;
+  uint64_t bits;         // SCL periods, START/STOP included
+};
+
+struct sim_cpu_stats {
+  uint32_t wfi;              // wfi executed (metal_sim_wfi() calls)
+  uint32_t stuck;            // wfi with no interrupt that could wake the hart
+  uint32_t timer_interrupts; // timer handler invocations
+  uint32_t external_interrupts; // PLIC handler invocations
+  uint64_t sleep_cycles;     // virtual time spent asleep in wfi
+};
+
+// Called at a cycle of the virtual clock
+typedef void (*sim_event_fn)(void *ctx);
+
+// Register file of a peripheral model, offsets relative to its base
+struct sim_mmio_ops {
+  uint32_t (*read32)(void *ctx, uintptr_t offset);
+  void (*write32)(void *ctx, uintptr_t offset, uint32_t value);
+};
+
+/**
+ * Reset the virtual clock and the machine timer, lower all interrupt lines,
+ * drop pending events and MMIO regions, and detach all devices from all
+ * buses
+ */
+void sim_reset(void);
+
+/**
+ * @return virtual time in core clock cycles
+ */
+uint64_t sim_cycles(void);
+
+/**
+ * Let virtual time pass, e.g. to model work the host code does not do
+ */
+void sim_advance_cycles(uint64_t cycles);
+void sim_advance_us(uint32_t us);
+
+void sim_cpu_stats(struct sim_cpu_stats *stats);
+
+/**
+ * Attach a device to a bus
+ * @return 0 on success, -1 if the bus is full or does not exist
+ */
+int sim_attach(unsigned int bus, struct sim_i2c_device *dev);
+
+/**
+ * Make transfers of the Metal driver fail (NACK) at a rate when the bus
+ * runs faster than max_baud, as with marginal pull-ups or long wires
+ * @param permille Failure rate, 0 to turn faults off
+ */
+void sim_bus_set_faults(struct metal_i2c *i2c, unsigned int max_baud, unsigned int permille);
+
+/**
+ * Hold the bus, as a device stuck mid-byte does: transfers wait
+ * SIM_I2C_TIMEOUT_US and fail with SIM_I2C_TIMEOUT until released
+ * @param stuck 1 to hold the bus, 0 to release it
+ */
+void sim_bus_set_stuck(struct metal_i2c *i2c, int stuck);
+
+void sim_bus_stats(struct metal_i2c *i2c, struct sim_bus_stats *stats);
+void sim_bus_stats_reset(struct metal_i2c *i2c);
+
+/**
+ * Device answering an address on a bus, directly or behind a switch
+ * @return NULL if nobody would ACK the address
+ */
+struct sim_i2c_device *sim_bus_find(struct metal_i2c *i2c, unsigned int addr);
+
+/**
+ * Account bus traffic generated by a peripheral model
+ */
+void sim_bus_account(struct metal_i2c *i2c, unsigned int starts, unsigned int bytes, uint64_t bits);
+void sim_bus_nack(struct metal_i2c *i2c);
+
+/**
+ * Call fn at a cycle of the virtual clock
+ * @return 0 on success, -1 if the event queue is full
+ */
+int sim_schedule(uint64_t cycle, sim_event_fn fn, void *ctx);
+
+/**
+ * Drive a level-triggered PLIC interrupt line
+ */
+void sim_irq_set(int id, int level);
+
+/**
+ * Map a peripheral model at a physical address range
+ * @return 0 on success, -1 if there are too many regions
+ */
+int sim_mmio_map(uintptr_t base, uintptr_t size, const struct sim_mmio_ops *ops, void *ctx);
+
+/**
+ * Time the given number of SCL periods takes at a bus speed
+ * @return nanoseconds
+ */
+uint64_t sim_bus_time_ns(uint64_t bits, unsigned int baud);
+
+#endif // SIM_H
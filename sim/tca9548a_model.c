@@ -0,0 +1,54 @@
+/*
+ * tca9548a_model.c
+ *
+ * Behavioral model of a TCA9548A 1-to-8 I2C switch.
+ */
+#include <stddef.h>
+#include "tca9548a_model.h"
+
+static int model_write(struct sim_i2c_device *dev, const unsigned char *buf, unsigned int len) {
+  struct tca9548a_model *m = (struct tca9548a_model *)dev;
+  for (unsigned int i = 0; i < len; i++) {
+    m->control = buf[i];
+    m->control_writes++;
+  }
+  return 0;
+}
+
+static int model_read(struct sim_i2c_device *dev, unsigned char *buf, unsigned int len) {
+  struct tca9548a_model *m = (struct tca9548a_model *)dev;
+  for (unsigned int i = 0; i < len; i++) {
+    buf[i] = m->control;
+  }
+  return 0;
+}
+
+static struct sim_i2c_device *model_route(struct sim_i2c_device *dev, unsigned int addr) {
+  struct tca9548a_model *m = (struct tca9548a_model *)dev;
+  for (unsigned int ch = 0; ch < TCA9548A_CHANNELS; ch++) {
+    if (!(m->control & (1u << ch))) {
+      continue;
+    }
+    for (unsigned int i = 0; i < m->ndevices[ch]; i++) {
+      if (m->devices[ch][i]->addr == addr) {
+        return m->devices[ch][i];
+      }
+    }
+  }
+  return NULL;
+}
+
+void tca9548a_model_init(struct tca9548a_model *m, unsigned int addr) {
+  *m = (struct tca9548a_model){
+    .dev = { .addr = addr, .write = model_write, .read = model_read, .route = model_route },
+  };
+}
+
+int tca9548a_model_attach(struct tca9548a_model *m, unsigned int channel,
+                          struct sim_i2c_device *dev) {
+  if (channel >= TCA9548A_CHANNELS || m->ndevices[channel] >= SIM_I2C_MAX_DEVICES) {
+    return -1;
+  }
+  m->devices[channel][m->ndevices[channel]++] = dev;
+  return 0;
+}
@@ -0,0 +1,33 @@
+/*
+ * tca9548a_model.h
+ *
+ * Behavioral model of a TCA9548A 1-to-8 I2C switch for the host-side
+ * simulator. Writing the control register connects the downstream segments
+ * whose bits are set; reading returns the control register.
+ */
+#ifndef TCA9548A_MODEL_H
+#define TCA9548A_MODEL_H
+
+#include <stdint.h>
+#include "sim.h"
+
+#define TCA9548A_CHANNELS 8
+
+struct tca9548a_model {
+  struct sim_i2c_device dev;
+  unsigned char control;
+  struct sim_i2c_device *devices[TCA9548A_CHANNELS][SIM_I2C_MAX_DEVICES];
+  unsigned int ndevices[TCA9548A_CHANNELS];
+  uint32_t control_writes;
+};
+
+void tca9548a_model_init(struct tca9548a_model *m, unsigned int addr);
+
+/**
+ * Attach a device to a downstream segment
+ * @return 0 on success, -1 if the segment is full or does not exist
+ */
+int tca9548a_model_attach(struct tca9548a_model *m, unsigned int channel,
+                          struct sim_i2c_device *dev);
+
+#endif // TCA9548A_MODEL_H